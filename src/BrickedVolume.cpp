@@ -0,0 +1,41 @@
+//
+// Created by Joshua Lowe on 17.10.26.
+//
+
+#include "BrickedVolume.h"
+
+#include <algorithm>
+
+BrickedVolume::BrickedVolume(const VolumeStorage& source)
+    : dim(source.dimension()), bricks((dim + kBrick - 1) / kBrick) {
+  data.resize(kBrickSize * bricks * bricks * bricks);
+  // Apron voxels past the edge of the volume repeat the last voxel, so
+  // partial bricks at the border need no special case when sampling.
+  auto clampToVolume = [&](int i) { return std::min(i, dim - 1); };
+  for (int bz = 0; bz < bricks; bz++) {
+    for (int by = 0; by < bricks; by++) {
+      for (int bx = 0; bx < bricks; bx++) {
+        float* brick =
+            data.data() + locate(bx * kBrick, by * kBrick, bz * kBrick);
+        for (int lz = 0; lz < kStride; lz++) {
+          int iz = clampToVolume(bz * kBrick + lz);
+          for (int ly = 0; ly < kStride; ly++) {
+            int iy = clampToVolume(by * kBrick + ly);
+            // Source rows are contiguous per component, the brick row
+            // interleaves them.
+            float* row = brick + (ly + kStride * lz) * kStride *
+                                     VolumeStorage::kComponents;
+            for (int lx = 0; lx < kStride; lx++) {
+              int ix = clampToVolume(bx * kBrick + lx);
+              std::size_t i = source.index(ix, iy, iz);
+              for (int c = 0; c < VolumeStorage::kComponents; c++) {
+                row[lx * VolumeStorage::kComponents + c] =
+                    source.component(c)[i];
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+}
@@ -0,0 +1,76 @@
+//
+// Created by Joshua Lowe on 17.10.26.
+//
+
+#ifndef CODE_BRICKEDVOLUME_H
+#define CODE_BRICKEDVOLUME_H
+
+#include <QVector3D>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+#include "VolumeStorage.h"
+
+// Float volume cut into 8x8x8 bricks for cache-local trilinear sampling.
+// Each brick also stores a one-voxel apron on its +x, +y and +z faces, a
+// copy of the neighbouring voxels, so the 8 corners of any cell live in the
+// brick of its base voxel. Inside a brick the three components of a voxel
+// are interleaved and voxels run x fastest, so a cell reads two spans of
+// 132 bytes (one per z, two or three cache lines each). In the linear
+// layout the same cell reads twelve rows spread over three planes, with
+// the z neighbours dim^2 floats apart. The apron costs 42% more memory
+// than the linear layout (9^3 / 8^3).
+class BrickedVolume {
+ public:
+  static constexpr int kBrickShift = 3;
+  static constexpr int kBrick = 1 << kBrickShift;
+  static constexpr int kStride = kBrick + 1;  // brick edge with apron
+  static constexpr std::size_t kBrickSize =
+      (std::size_t)kStride * kStride * kStride * VolumeStorage::kComponents;
+
+  explicit BrickedVolume(const VolumeStorage&);
+
+  auto dimension() const -> int { return dim; }
+  auto byteSize() const -> std::size_t { return data.size() * sizeof(float); }
+
+  // Offset of the first component of voxel (ix, iy, iz) in data.
+  auto locate(int ix, int iy, int iz) const -> std::size_t {
+    std::size_t brick =
+        (ix >> kBrickShift) +
+        (std::size_t)bricks *
+            ((iy >> kBrickShift) + (std::size_t)bricks * (iz >> kBrickShift));
+    int local = (ix & (kBrick - 1)) +
+                kStride * ((iy & (kBrick - 1)) + kStride * (iz & (kBrick - 1)));
+    return brick * kBrickSize + local * VolumeStorage::kComponents;
+  }
+
+  auto value(int ix, int iy, int iz, int c) const -> float {
+    const float* v = data.data() + locate(ix, iy, iz);
+    if (c < VolumeStorage::kComponents) return v[c];
+    return std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+  }
+  auto vector(int ix, int iy, int iz) const -> QVector3D {
+    const float* v = data.data() + locate(ix, iy, iz);
+    return {v[0], v[1], v[2]};
+  }
+  // Corner k of the cell with base voxel (ix, iy, iz) is the voxel offset
+  // by (k & 1, k >> 1 & 1, k >> 2). One brick lookup serves all eight.
+  auto cell(int ix, int iy, int iz, QVector3D* corners) const -> void {
+    constexpr int dy = kStride * VolumeStorage::kComponents;
+    constexpr int dz = kStride * dy;
+    const float* v = data.data() + locate(ix, iy, iz);
+    for (int k = 0; k < 8; k++) {
+      const float* corner = v + (k & 1) * VolumeStorage::kComponents +
+                            (k >> 1 & 1) * dy + (k >> 2) * dz;
+      corners[k] = {corner[0], corner[1], corner[2]};
+    }
+  }
+
+ private:
+  int dim;
+  int bricks;  // per axis
+  std::vector<float> data;
+};
+
+#endif  // CODE_BRICKEDVOLUME_H
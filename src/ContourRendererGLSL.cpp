@@ -4,6 +4,7 @@
 #include <QOpenGLBuffer>
 #include <QOpenGLContext>
 #include <QOpenGLFunctions>
+#include <algorithm>
 #include <fstream>
 #include <iostream>
 
@@ -29,7 +30,9 @@ auto ContourRendererGLSL::drawContour(QMatrix4x4 mvpMatrix) -> void {
   shaderProgram.setUniformValue("mvpMatrix", mvpMatrix);
   shaderProgram.setUniformValue("currentStep",
                                 (float)currentStep / (float)maxSteps);
-  shaderProgram.setUniformValue("component", component);
+  // Derived components are uploaded in place of x.
+  shaderProgram.setUniformValue("component",
+                                isDerivedComponent(component) ? 0 : component);
 
   // Issue OpenGL draw commands.
   QOpenGLFunctions* f = QOpenGLContext::currentContext()->functions();
@@ -126,35 +129,62 @@ auto ContourRendererGLSL::setMaxSteps() -> void {
 }
 
 auto ContourRendererGLSL::updateIso() -> void {
+  // The slice data does not depend on the isovalues, which are uniforms, so
+  // only re-upload when the frame, the slice or the level actually changed.
+  // A derived component is uploaded by itself; the shader picks x, y, z or
+  // the magnitude from the velocity.
+  bool derived = isDerivedComponent(component);
+  int uploaded = derived ? component : 0;
+  auto frame =
+      derived ? datasource->acquireDerived(currentStep, currentStep + 1)
+              : datasource->acquireLevel(level, currentStep, currentStep + 1);
+  int l = derived ? 0 : std::min(level, frame->getLevelCount() - 1);
+  if (frame->getGeneration() == uploadedGeneration &&
+      currentStep == uploadedStep && l == uploadedLevel &&
+      uploaded == uploadedComponent)
+    return;
+  uploadedGeneration = frame->getGeneration();
+  uploadedStep = currentStep;
+  uploadedLevel = l;
+  uploadedComponent = uploaded;
+
+  // Coarser levels cover the same square with fewer cells.
+  int steps = frame->getLevelDimension(l) - 1;
+  int iz = frame->getLevelIndex(currentStep, l);
   input.clear();
-  datasource->createData();
-  for (int i = 0; i < maxSteps; i++) {
-    for (int j = 0; j < maxSteps; j++) {
-      input.append({(float)j / (float)maxSteps, (float)i / (float)maxSteps, 0});
-      input.append({datasource->getDataValue(j, i, currentStep, 0),
-                    datasource->getDataValue(j, i, currentStep, 1),
-                    datasource->getDataValue(j, i, currentStep, 2)});
-
-      input.append(
-          {(float)(j + 1) / (float)maxSteps, (float)i / (float)maxSteps, 0});
-      input.append({datasource->getDataValue(j + 1, i, currentStep, 0),
-                    datasource->getDataValue(j + 1, i, currentStep, 1),
-                    datasource->getDataValue(j + 1, i, currentStep, 2)});
-
-      input.append({(float)(j + 1) / (float)maxSteps,
-                    (float)(i + 1) / (float)maxSteps, 0});
-      input.append({datasource->getDataValue(j + 1, i + 1, currentStep, 0),
-                    datasource->getDataValue(j + 1, i + 1, currentStep, 1),
-                    datasource->getDataValue(j + 1, i + 1, currentStep, 2)});
-
-      input.append(
-          {(float)j / (float)maxSteps, (float)(i + 1) / (float)maxSteps, 0});
-      input.append({datasource->getDataValue(j, i + 1, currentStep, 0),
-                    datasource->getDataValue(j, i + 1, currentStep, 1),
-                    datasource->getDataValue(j, i + 1, currentStep, 2)});
+  frame->visitComponent(l, component, [&](const auto& volume) {
+    auto data = [&](int x, int y) -> QVector3D {
+      if (derived) return {volume.value(x, y, iz, component), 0, 0};
+      return {volume.value(x, y, iz, 0), volume.value(x, y, iz, 1),
+              volume.value(x, y, iz, 2)};
+    };
+    for (int i = 0; i < steps; i++) {
+      for (int j = 0; j < steps; j++) {
+        input.append({(float)j / (float)steps, (float)i / (float)steps, 0});
+        input.append(data(j, i));
+
+        input.append(
+            {(float)(j + 1) / (float)steps, (float)i / (float)steps, 0});
+        input.append(data(j + 1, i));
+
+        input.append({(float)(j + 1) / (float)steps,
+                      (float)(i + 1) / (float)steps, 0});
+        input.append(data(j + 1, i + 1));
+
+        input.append(
+            {(float)j / (float)steps, (float)(i + 1) / (float)steps, 0});
+        input.append(data(j, i + 1));
+      }
     }
-  }
+  });
   initContourLines();
 }
 
-auto ContourRendererGLSL::setWindComponent(int ic) -> void { component = ic; }
+auto ContourRendererGLSL::setWindComponent(int ic) -> void {
+  component = ic;
+  updateIso();
+}
+
+auto ContourRendererGLSL::setLevel(int inLevel) -> void {
+  level = (inLevel < 0) ? 0 : inLevel;
+}
@@ -12,6 +12,8 @@ class ContourRendererGLSL : public HorizontalContourLinesRenderer {
   auto setWindComponent(int ic) -> void override;
   auto setMaxSteps() -> void override;
   auto isGLSL() -> bool override;
+  // Pyramid level the slice is uploaded from (see FlowFrame).
+  auto setLevel(int) -> void;
 
  protected:
   auto initOpenGLShaders() -> void override;
@@ -21,6 +23,11 @@ class ContourRendererGLSL : public HorizontalContourLinesRenderer {
  private:
   FlowDataSource* source;
   int component = 0;
+  int level = 0;
   QVector<QVector3D> input;
+  std::uint64_t uploadedGeneration = 0;
+  int uploadedStep = -1;
+  int uploadedLevel = -1;
+  int uploadedComponent = 0;
   FlowDataSource* datasource;
 };
@@ -0,0 +1,54 @@
+//
+// Created by Joshua Lowe on 17.10.26.
+//
+
+#include "CpuFeatures.h"
+
+#if TORNADO_X86 && defined(_MSC_VER) && !defined(__clang__)
+#include <immintrin.h>
+#include <intrin.h>
+#endif
+
+auto detectSimdLevel() -> SimdLevel {
+#if TORNADO_X86 && (defined(__GNUC__) || defined(__clang__))
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f")) return AVX512;
+  if (__builtin_cpu_supports("avx2")) return AVX2;
+  if (__builtin_cpu_supports("sse4.1")) return SSE;
+  return Scalar;
+#elif TORNADO_X86 && defined(_MSC_VER)
+  int info[4];
+  __cpuid(info, 0);
+  int maxLeaf = info[0];
+  __cpuid(info, 1);
+  bool sse41 = (info[2] & (1 << 19)) != 0;
+  bool osxsave = (info[2] & (1 << 27)) != 0;
+  bool avx = (info[2] & (1 << 28)) != 0;
+  if (!sse41) return Scalar;
+  if (!osxsave || !avx || maxLeaf < 7) return SSE;
+
+  // The OS has to save the YMM (and for AVX-512 the opmask and ZMM) state.
+  unsigned long long xcr0 = _xgetbv(0);
+  if ((xcr0 & 0x6) != 0x6) return SSE;
+  __cpuidex(info, 7, 0);
+  bool avx2 = (info[1] & (1 << 5)) != 0;
+  bool avx512f = (info[1] & (1 << 16)) != 0;
+  if (avx512f && (xcr0 & 0xe6) == 0xe6) return AVX512;
+  return avx2 ? AVX2 : SSE;
+#else
+  return Scalar;
+#endif
+}
+
+auto simdLevelName(SimdLevel level) -> const char* {
+  switch (level) {
+    case SSE:
+      return "SSE4.1";
+    case AVX2:
+      return "AVX2";
+    case AVX512:
+      return "AVX-512";
+    default:
+      return "Scalar";
+  }
+}
@@ -0,0 +1,30 @@
+//
+// Created by Joshua Lowe on 17.10.26.
+//
+
+#ifndef CODE_CPUFEATURES_H
+#define CODE_CPUFEATURES_H
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || \
+    defined(_M_IX86)
+#define TORNADO_X86 1
+#else
+#define TORNADO_X86 0
+#endif
+
+// MSVC exposes every intrinsic unconditionally, GCC and Clang need the
+// instruction set enabled per function so the rest of the build keeps its
+// baseline target.
+#if TORNADO_X86 && (defined(__GNUC__) || defined(__clang__))
+#define TORNADO_TARGET(isa) __attribute__((target(isa)))
+#else
+#define TORNADO_TARGET(isa)
+#endif
+
+enum SimdLevel { Scalar, SSE, AVX2, AVX512 };
+
+// Widest instruction set that both the CPU and the operating system support.
+auto detectSimdLevel() -> SimdLevel;
+auto simdLevelName(SimdLevel) -> const char*;
+
+#endif  // CODE_CPUFEATURES_H
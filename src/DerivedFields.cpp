@@ -0,0 +1,198 @@
+//
+// Created by Joshua Lowe on 17.10.26.
+//
+
+#include "DerivedFields.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "FlowFrame.h"
+
+namespace {
+
+// Row iy of z-slice iz of component c.
+template <typename Volume>
+auto loadRow(const Volume& volume, int iy, int iz, int c, float* row)
+    -> void {
+  for (int ix = 0; ix < volume.dimension(); ix++) {
+    row[ix] = volume.value(ix, iy, iz, c);
+  }
+}
+
+auto loadRow(const VolumeStorage& volume, int iy, int iz, int c, float* row)
+    -> void {
+  const float* source =
+      volume.slice(c, iz).data() + (std::size_t)iy * volume.dimension();
+  std::copy(source, source + volume.dimension(), row);
+}
+
+// Voxels per block of deriveBlock. Blocks of a fixed size let the compiler
+// vectorise the arithmetic; only the square root and the trigonometry of
+// lambda2 run per voxel.
+constexpr int kBlock = 16;
+
+// Derived components of the voxels x0 to x0 + kBlock - 1 of a row, from the
+// velocity rows u[c] and the gradient rows g[3 * i + j] = d u_i / d x_j.
+auto deriveBlock(const float* const* u, const float* const* g, int x0,
+                 float (&out)[kDerivedComponents][kBlock]) -> void {
+  float v[3][kBlock], j[9][kBlock];
+  for (int c = 0; c < 3; c++) {
+    for (int i = 0; i < kBlock; i++) v[c][i] = u[c][x0 + i];
+  }
+  for (int c = 0; c < 9; c++) {
+    for (int i = 0; i < kBlock; i++) j[c][i] = g[c][x0 + i];
+  }
+  float q[kBlock], p[kBlock], r[kBlock];
+  for (int i = 0; i < kBlock; i++) {
+    float ux = j[0][i], uy = j[1][i], uz = j[2][i];
+    float vx = j[3][i], vy = j[4][i], vz = j[5][i];
+    float wx = j[6][i], wy = j[7][i], wz = j[8][i];
+    float ox = wy - vz, oy = uz - wx, oz = vx - uy;
+    out[0][i] = ox;
+    out[1][i] = oy;
+    out[2][i] = oz;
+    out[3][i] = ox * ox + oy * oy + oz * oz;
+    out[4][i] = ux + vy + wz;
+    out[5][i] = v[0][i] * ox + v[1][i] * oy + v[2][i] * oz;
+    // Q = (|Omega|^2 - |S|^2) / 2 = -tr(J^2) / 2
+    out[6][i] = -0.5f * (ux * ux + vy * vy + wz * wz) -
+                (uy * vx + uz * wx + vz * wy);
+
+    // lambda2 is the middle eigenvalue of the symmetric matrix
+    // M = S^2 + Omega^2 = (J^2 + J^T^2) / 2, found by the trigonometric
+    // solution of its characteristic polynomial: with q = tr(M) / 3,
+    // p^2 = |M - qI|^2 / 6 and r = det(M - qI) / (2 p^3) it is
+    // q + 2p cos(acos(r) / 3 + 4 pi / 3).
+    float a = ux * ux + uy * vx + uz * wx;
+    float b = vx * uy + vy * vy + vz * wy;
+    float c = wx * uz + wy * vz + wz * wz;
+    float d = 0.5f * (ux * (uy + vx) + uy * vy + vx * vy + uz * wy +
+                      wx * vz);
+    float e = 0.5f * (ux * (uz + wx) + uz * wz + wx * wz + uy * vz +
+                      vx * wy);
+    float f = 0.5f * (vy * (vz + wy) + vz * wz + wy * wz + vx * uz +
+                      uy * wx);
+    float mean = (a + b + c) / 3;
+    a -= mean;
+    b -= mean;
+    c -= mean;
+    float p2 = (a * a + b * b + c * c + 2 * (d * d + e * e + f * f)) / 6;
+    float det = a * (b * c - f * f) - d * (d * c - f * e) +
+                e * (d * f - b * e);
+    q[i] = mean;
+    p[i] = p2;
+    r[i] = det / 2;
+  }
+  for (int i = 0; i < kBlock; i++) {
+    out[3][i] = std::sqrt(out[3][i]);
+    float scale = std::sqrt(p[i]);
+    // p = 0: all three eigenvalues equal q, any angle will do.
+    float ratio = p[i] > 0 ? r[i] / (p[i] * scale) : 0;
+    float phi = std::acos(std::clamp(ratio, -1.0f, 1.0f)) / 3 + 4.1887902f;
+    out[7][i] = q[i] + 2 * scale * std::cos(phi);
+  }
+}
+
+}  // namespace
+
+auto componentName(int c) -> const char* {
+  static const char* const names[] = {
+      "X",           "Y",           "Z",           "Betrag",
+      "Vorticity X", "Vorticity Y", "Vorticity Z", "Vorticity",
+      "Divergence",  "Helicity",    "Q",           "Lambda2"};
+  if (c < 0 || c > Lambda2) return "";
+  return names[c];
+}
+
+auto DerivedVolume::resize(int dimension) -> void {
+  dim = dimension;
+  slices.clear();
+  slices.resize(dim);
+  ranges.assign(dim, {});
+}
+
+auto DerivedVolume::compute(const FlowFrame& frame, int iz) -> void {
+  int d = dim;
+  std::size_t plane = (std::size_t)d * d;
+  auto out = std::make_unique<float[]>(kDerivedComponents * plane);
+  // Velocity rows around the output row: centre, y - 1, y + 1, z - 1 and
+  // z + 1, then the gradient rows J[i][j] = d u_i / d x_j. Rows are padded
+  // to whole blocks by repeating their last voxel, which keeps the padding
+  // out of the slice ranges.
+  int width = (d + kBlock - 1) / kBlock * kBlock;
+  std::vector<float> scratch(24 * (std::size_t)width);
+  auto row = [&](int i) { return scratch.data() + (std::size_t)i * width; };
+  float* centre[3] = {row(0), row(1), row(2)};
+  float* down[3] = {row(3), row(4), row(5)};
+  float* up[3] = {row(6), row(7), row(8)};
+  float* back[3] = {row(9), row(10), row(11)};
+  float* front[3] = {row(12), row(13), row(14)};
+  float* J[9] = {row(15), row(16), row(17), row(18), row(19),
+                 row(20), row(21), row(22), row(23)};
+  auto pad = [&](float* values) {
+    std::fill(values + d, values + width, values[d - 1]);
+  };
+
+  // Differences are divided by their distance in normalised coordinates,
+  // which is two voxels inside the volume and one on its faces.
+  auto spacing = [&](int lo, int hi) { return (float)(d - 1) / (hi - lo); };
+  int zm = std::max(iz - 1, 0), zp = std::min(iz + 1, d - 1);
+  float fz = spacing(zm, zp);
+  float fx = spacing(0, 2), fxEdge = spacing(0, 1);
+
+  // Per-lane minimum and maximum of every component, reduced at the end.
+  float lo[kDerivedComponents][kBlock], hi[kDerivedComponents][kBlock];
+  std::fill(&lo[0][0], &lo[0][0] + kDerivedComponents * kBlock, INFINITY);
+  std::fill(&hi[0][0], &hi[0][0] + kDerivedComponents * kBlock, -INFINITY);
+
+  frame.visit([&](const auto& volume) {
+    for (int iy = 0; iy < d; iy++) {
+      int ym = std::max(iy - 1, 0), yp = std::min(iy + 1, d - 1);
+      float fy = spacing(ym, yp);
+      for (int c = 0; c < 3; c++) {
+        loadRow(volume, iy, iz, c, centre[c]);
+        loadRow(volume, ym, iz, c, down[c]);
+        loadRow(volume, yp, iz, c, up[c]);
+        loadRow(volume, iy, zm, c, back[c]);
+        loadRow(volume, iy, zp, c, front[c]);
+        const float* u = centre[c];
+        float *dx = J[3 * c], *dy = J[3 * c + 1], *dz = J[3 * c + 2];
+        dx[0] = (u[1] - u[0]) * fxEdge;
+        for (int ix = 1; ix < d - 1; ix++) {
+          dx[ix] = (u[ix + 1] - u[ix - 1]) * fx;
+        }
+        dx[d - 1] = (u[d - 1] - u[d - 2]) * fxEdge;
+        for (int ix = 0; ix < d; ix++) {
+          dy[ix] = (up[c][ix] - down[c][ix]) * fy;
+          dz[ix] = (front[c][ix] - back[c][ix]) * fz;
+        }
+        pad(centre[c]);
+        pad(dx);
+        pad(dy);
+        pad(dz);
+      }
+
+      float* o = out.get() + (std::size_t)iy * d;
+      for (int x0 = 0; x0 < d; x0 += kBlock) {
+        float block[kDerivedComponents][kBlock];
+        deriveBlock(centre, J, x0, block);
+        int count = std::min(kBlock, d - x0);
+        for (int k = 0; k < kDerivedComponents; k++) {
+          for (int i = 0; i < kBlock; i++) {
+            lo[k][i] = std::min(lo[k][i], block[k][i]);
+            hi[k][i] = std::max(hi[k][i], block[k][i]);
+          }
+          std::copy(block[k], block[k] + count, o + k * plane + x0);
+        }
+      }
+    }
+  });
+
+  for (int k = 0; k < kDerivedComponents; k++) {
+    ranges[iz][k] = *std::min_element(lo[k], lo[k] + kBlock);
+    ranges[iz][kDerivedComponents + k] =
+        *std::max_element(hi[k], hi[k] + kBlock);
+  }
+  slices[iz] = std::move(out);
+}
@@ -0,0 +1,79 @@
+//
+// Created by Joshua Lowe on 17.10.26.
+//
+
+#ifndef CODE_DERIVEDFIELDS_H
+#define CODE_DERIVEDFIELDS_H
+
+#include <array>
+#include <cstddef>
+#include <memory>
+#include <utility>
+#include <vector>
+
+class FlowFrame;
+
+// Component ids of the fields derived from the velocity gradient, following
+// x, y, z (0 - 2) and the magnitude (3).
+enum DerivedComponent {
+  VorticityX = 4,
+  VorticityY,
+  VorticityZ,
+  VorticityMagnitude,
+  Divergence,
+  Helicity,
+  QCriterion,
+  Lambda2
+};
+
+constexpr int kDerivedComponents = Lambda2 - VorticityX + 1;
+
+inline auto isDerivedComponent(int c) -> bool {
+  return c >= VorticityX && c <= Lambda2;
+}
+// Whether the component takes both signs, e.g. for a diverging colour map.
+inline auto isSignedComponent(int c) -> bool {
+  return c != 3 && c != VorticityMagnitude;
+}
+auto componentName(int) -> const char*;
+
+// Vortex diagnostics of one frame. The velocity gradient is taken by
+// central differences in the normalised [0, 1] coordinates of the
+// generators, one-sided on the faces of the volume. One fused pass per
+// slice derives every component from it, so a slice is either complete or
+// missing. Slices are computed on request (see FlowDataSource::
+// acquireDerived) and never change afterwards.
+class DerivedVolume {
+ public:
+  DerivedVolume() : dim(0) {}
+
+  // Drops every slice.
+  auto resize(int) -> void;
+  auto dimension() const -> int { return dim; }
+  auto isResident(int iz) const -> bool { return slices[iz] != nullptr; }
+  // Computes slice iz from the velocity of the frame, which needs the
+  // slices iz - 1 to iz + 1 resident. Distinct slices may be computed
+  // concurrently.
+  auto compute(const FlowFrame&, int) -> void;
+
+  // Unchecked accessor like VolumeStorage::value() for a derived component
+  // of a resident slice.
+  auto value(int ix, int iy, int iz, int c) const -> float {
+    std::size_t plane = (std::size_t)dim * dim;
+    return slices[iz][(c - VorticityX) * plane + ix + (std::size_t)dim * iy];
+  }
+  // Min and max of a derived component over resident slice iz.
+  auto getSliceRange(int iz, int c) const -> std::pair<float, float> {
+    int i = c - VorticityX;
+    return {ranges[iz][i], ranges[iz][kDerivedComponents + i]};
+  }
+
+ private:
+  int dim;
+  // kDerivedComponents planes of dim * dim voxels per slice.
+  std::vector<std::unique_ptr<float[]>> slices;
+  // Per slice the minima followed by the maxima of the components.
+  std::vector<std::array<float, 2 * kDerivedComponents>> ranges;
+};
+
+#endif  // CODE_DERIVEDFIELDS_H
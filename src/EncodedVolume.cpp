@@ -0,0 +1,157 @@
+//
+// Created by Joshua Lowe on 17.10.26.
+//
+
+#include "EncodedVolume.h"
+
+#include <algorithm>
+#include <limits>
+
+#include "CpuFeatures.h"
+
+#if TORNADO_X86
+#include <immintrin.h>
+#endif
+
+namespace {
+
+constexpr float kHalfMax = 65504.0f;
+
+// Converts 8 floats per iteration with F16C, which every AVX2 CPU has.
+// Returns how many values it converted, the caller finishes the remainder.
+#if TORNADO_X86
+TORNADO_TARGET("avx2,f16c")
+auto encodeHalfF16C(const float* in, std::uint16_t* out, std::size_t count)
+    -> std::size_t {
+  const __m256 high = _mm256_set1_ps(kHalfMax);
+  const __m256 low = _mm256_set1_ps(-kHalfMax);
+  std::size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    __m256 v = _mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(in + i), low), high);
+    __m128i half = _mm256_cvtps_ph(v, _MM_FROUND_TO_NEAREST_INT);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), half);
+  }
+  return i;
+}
+#endif
+
+auto encodeHalf(const float* in, std::uint16_t* out, std::size_t count)
+    -> void {
+  std::size_t i = 0;
+#if TORNADO_X86
+  static const SimdLevel level = detectSimdLevel();
+  if (level >= AVX2) i = encodeHalfF16C(in, out, count);
+#endif
+  for (; i < count; i++) out[i] = floatToHalf(in[i]);
+}
+
+}  // namespace
+
+auto volumeEncodingName(VolumeEncoding encoding) -> const char* {
+  switch (encoding) {
+    case Half:
+      return "half";
+    case Quantized16:
+      return "16-bit quantised";
+    case Quantized8:
+      return "8-bit quantised";
+    default:
+      return "float32";
+  }
+}
+
+auto floatToHalf(float value) -> std::uint16_t {
+  value = std::min(std::max(value, -kHalfMax), kHalfMax);
+  std::uint32_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  std::uint32_t sign = (bits >> 16) & 0x8000;
+  bits &= 0x7fffffff;
+
+  if (bits < (113u << 23)) {
+    // Below the smallest normal half: adding a power of two lines the
+    // mantissa up with the half subnormal grid and rounds it in one step.
+    const std::uint32_t magicBits = (127 - 15 + 23 - 10 + 1) << 23;
+    float magic, magnitude;
+    std::memcpy(&magic, &magicBits, sizeof(magic));
+    std::memcpy(&magnitude, &bits, sizeof(magnitude));
+    magnitude += magic;
+    std::memcpy(&bits, &magnitude, sizeof(bits));
+    return sign | (bits - magicBits);
+  }
+  // Rebias the exponent and round the 13 dropped mantissa bits to even.
+  std::uint32_t odd = (bits >> 13) & 1;
+  bits += ((std::uint32_t)(15 - 127) << 23) + 0xfff + odd;
+  return sign | (bits >> 13);
+}
+
+HalfVolume::HalfVolume(const VolumeStorage& source)
+    : dim(source.dimension()) {
+  for (int c = 0; c < VolumeStorage::kComponents; c++) {
+    FloatSpan plane = source.component(c);
+    planes[c].resize(plane.size());
+    encodeHalf(plane.data(), planes[c].data(), plane.size());
+  }
+}
+
+auto HalfVolume::byteSize() const -> std::size_t {
+  return VolumeStorage::kComponents * planes[0].size() * sizeof(std::uint16_t);
+}
+
+template <typename T>
+QuantizedVolume<T>::QuantizedVolume(const VolumeStorage& source)
+    : dim(source.dimension()), bricks((dim + kBrick - 1) / kBrick) {
+  constexpr float levels = std::numeric_limits<T>::max();
+  std::size_t brickCount = (std::size_t)bricks * bricks * bricks;
+  for (int c = 0; c < VolumeStorage::kComponents; c++) {
+    FloatSpan plane = source.component(c);
+
+    // Brick ranges first, walking the planes linearly.
+    std::vector<float> low(brickCount, std::numeric_limits<float>::max());
+    std::vector<float> high(brickCount, std::numeric_limits<float>::lowest());
+    for (int iz = 0; iz < dim; iz++) {
+      for (int iy = 0; iy < dim; iy++) {
+        for (int ix = 0; ix < dim; ix++) {
+          std::size_t b = brick(ix, iy, iz);
+          float v = plane[index(ix, iy, iz)];
+          low[b] = std::min(low[b], v);
+          high[b] = std::max(high[b], v);
+        }
+      }
+    }
+    ranges[c].resize(brickCount);
+    std::vector<float> inverse(brickCount);
+    for (std::size_t b = 0; b < brickCount; b++) {
+      float scale = (high[b] - low[b]) / levels;
+      ranges[c][b] = {low[b], scale};
+      inverse[b] = scale > 0 ? 1.0f / scale : 0.0f;
+    }
+
+    // Then the values, rounded to the nearest level. Within a row the brick
+    // changes every kBrick voxels, so its parameters are fetched per run.
+    planes[c].resize(plane.size());
+    for (int iz = 0; iz < dim; iz++) {
+      for (int iy = 0; iy < dim; iy++) {
+        for (int x0 = 0; x0 < dim; x0 += kBrick) {
+          std::size_t b = brick(x0, iy, iz);
+          float offset = ranges[c][b].offset;
+          float factor = inverse[b];
+          std::size_t i = index(x0, iy, iz);
+          int run = std::min(kBrick, dim - x0);
+          for (int ix = 0; ix < run; ix++) {
+            float q = (plane[i + ix] - offset) * factor + 0.5f;
+            planes[c][i + ix] = (T)std::min(q, levels);
+          }
+        }
+      }
+    }
+  }
+}
+
+template <typename T>
+auto QuantizedVolume<T>::byteSize() const -> std::size_t {
+  return VolumeStorage::kComponents *
+         (planes[0].size() * sizeof(T) + ranges[0].size() * sizeof(Range));
+}
+
+template class QuantizedVolume<std::uint16_t>;
+template class QuantizedVolume<std::uint8_t>;
@@ -0,0 +1,150 @@
+//
+// Created by Joshua Lowe on 17.10.26.
+//
+
+#ifndef CODE_ENCODEDVOLUME_H
+#define CODE_ENCODEDVOLUME_H
+
+#include <QVector3D>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "VolumeStorage.h"
+
+// Storage encodings a frame can be kept in after it was generated. They
+// trade accuracy for memory: a voxel takes 12 bytes as float32, 6 as half
+// or 16-bit quantised and 3 as 8-bit quantised. Error budgets, with the
+// worst case measured on the tornado at dimensions 32 to 256:
+//
+//   Half         |error| <= max(|v| * 2^-11, 2^-25), 11 significant bits.
+//                Values beyond +-65504 are clamped. Tornado: 1.2e-4.
+//   Quantized16  |error| <= (brick max - brick min) / (2 * 65535) per
+//                component and 8x8x8 brick. Tornado: 4.7e-6.
+//   Quantized8   |error| <= (brick max - brick min) / (2 * 255). Tornado:
+//                1.2e-3; fine for slices and contours, but it visibly
+//                bends long streamlines.
+//
+// Encoded volumes decode on the fly in the same value()/vector()/cell()
+// accessors VolumeStorage has, so mappers reach them through FlowFrame::visit().
+enum VolumeEncoding { Float32, Half, Quantized16, Quantized8 };
+
+auto volumeEncodingName(VolumeEncoding) -> const char*;
+
+// IEEE 754 binary16 conversion. The decoder moves exponent and mantissa
+// into a float and rebiases with one multiply, which also covers half
+// subnormals; the encoder never produces infinities or NaNs.
+inline auto halfToFloat(std::uint16_t half) -> float {
+  std::uint32_t bits = (std::uint32_t)(half & 0x7fff) << 13;
+  float magnitude;
+  std::memcpy(&magnitude, &bits, sizeof(magnitude));
+  magnitude *= 0x1p112f;
+  return (half & 0x8000) ? -magnitude : magnitude;
+}
+
+// Rounds to nearest even, clamping to the largest finite half.
+auto floatToHalf(float) -> std::uint16_t;
+
+class HalfVolume {
+ public:
+  explicit HalfVolume(const VolumeStorage&);
+
+  auto dimension() const -> int { return dim; }
+  auto byteSize() const -> std::size_t;
+  auto index(int ix, int iy, int iz) const -> std::size_t {
+    return ix + (std::size_t)dim * (iy + (std::size_t)dim * iz);
+  }
+
+  auto value(int ix, int iy, int iz, int c) const -> float {
+    std::size_t i = index(ix, iy, iz);
+    if (c < VolumeStorage::kComponents) return halfToFloat(planes[c][i]);
+    float x = halfToFloat(planes[0][i]);
+    float y = halfToFloat(planes[1][i]);
+    float z = halfToFloat(planes[2][i]);
+    return std::sqrt(x * x + y * y + z * z);
+  }
+  auto vector(int ix, int iy, int iz) const -> QVector3D {
+    std::size_t i = index(ix, iy, iz);
+    return {halfToFloat(planes[0][i]), halfToFloat(planes[1][i]),
+            halfToFloat(planes[2][i])};
+  }
+  // Same corner order as VolumeStorage::cell.
+  auto cell(int ix, int iy, int iz, QVector3D* corners) const -> void {
+    for (int k = 0; k < 8; k++) {
+      corners[k] = vector(ix + (k & 1), iy + (k >> 1 & 1), iz + (k >> 2));
+    }
+  }
+
+ private:
+  int dim;
+  std::vector<std::uint16_t> planes[VolumeStorage::kComponents];
+};
+
+// Affine quantisation to unsigned integers with an offset and scale per
+// component and 8x8x8 brick, so the precision follows the local range of
+// the field instead of the range of the whole volume. The quantised values
+// keep the linear layout; only the brick parameters are looked up per
+// brick. Instantiated for std::uint16_t and std::uint8_t.
+template <typename T>
+class QuantizedVolume {
+ public:
+  static constexpr int kBrickShift = 3;
+  static constexpr int kBrick = 1 << kBrickShift;
+
+  explicit QuantizedVolume(const VolumeStorage&);
+
+  auto dimension() const -> int { return dim; }
+  auto byteSize() const -> std::size_t;
+  auto index(int ix, int iy, int iz) const -> std::size_t {
+    return ix + (std::size_t)dim * (iy + (std::size_t)dim * iz);
+  }
+  auto brick(int ix, int iy, int iz) const -> std::size_t {
+    return (ix >> kBrickShift) +
+           (std::size_t)bricks *
+               ((iy >> kBrickShift) +
+                (std::size_t)bricks * (iz >> kBrickShift));
+  }
+
+  auto value(int ix, int iy, int iz, int c) const -> float {
+    std::size_t i = index(ix, iy, iz);
+    std::size_t b = brick(ix, iy, iz);
+    if (c < VolumeStorage::kComponents) return decode(c, b, i);
+    float x = decode(0, b, i), y = decode(1, b, i), z = decode(2, b, i);
+    return std::sqrt(x * x + y * y + z * z);
+  }
+  auto vector(int ix, int iy, int iz) const -> QVector3D {
+    std::size_t i = index(ix, iy, iz);
+    std::size_t b = brick(ix, iy, iz);
+    return {decode(0, b, i), decode(1, b, i), decode(2, b, i)};
+  }
+  // Same corner order as VolumeStorage::cell. The corners may lie in
+  // different bricks, so each one looks its brick up.
+  auto cell(int ix, int iy, int iz, QVector3D* corners) const -> void {
+    for (int k = 0; k < 8; k++) {
+      corners[k] = vector(ix + (k & 1), iy + (k >> 1 & 1), iz + (k >> 2));
+    }
+  }
+
+ private:
+  struct Range {
+    float offset;
+    float scale;
+  };
+
+  auto decode(int c, std::size_t b, std::size_t i) const -> float {
+    const Range& range = ranges[c][b];
+    return range.offset + range.scale * planes[c][i];
+  }
+
+  int dim;
+  int bricks;  // per axis
+  std::vector<T> planes[VolumeStorage::kComponents];
+  std::vector<Range> ranges[VolumeStorage::kComponents];
+};
+
+extern template class QuantizedVolume<std::uint16_t>;
+extern template class QuantizedVolume<std::uint8_t>;
+
+#endif  // CODE_ENCODEDVOLUME_H
@@ -0,0 +1,235 @@
+//
+// Created by Joshua Lowe on 17.10.26.
+//
+
+#include "FieldEvaluator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <type_traits>
+#include <utility>
+
+namespace {
+
+// Positions per block of GridEvaluator::samplePacket().
+constexpr int kLanes = 16;
+
+auto lerp(const QVector3D& a, const QVector3D& b, float f) -> QVector3D {
+  return a + f * (b - a);
+}
+
+// Trilinear blend of the corners of VolumeStorage::cell.
+auto blend(const QVector3D* c, float fx, float fy, float fz) -> QVector3D {
+  QVector3D y0 = lerp(lerp(c[0], c[1], fx), lerp(c[2], c[3], fx), fy);
+  QVector3D y1 = lerp(lerp(c[4], c[5], fx), lerp(c[6], c[7], fx), fy);
+  return lerp(y0, y1, fz);
+}
+
+}  // namespace
+
+auto FieldEvaluator::sampleBatch(const QVector3D* positions, int count,
+                                 InterpolationResult* results) const -> void {
+  for (int i = 0; i < count; i++) results[i] = sample(positions[i]);
+}
+
+auto FieldEvaluator::samplePacket(int count, const float* x, const float* y,
+                                  const float* z, float* vx, float* vy,
+                                  float* vz, bool* valid) const -> void {
+  for (int i = 0; i < count; i++) {
+    InterpolationResult result = sample(QVector3D(x[i], y[i], z[i]));
+    valid[i] = result.success;
+    vx[i] = result.value.x();
+    vy[i] = result.value.y();
+    vz[i] = result.value.z();
+  }
+}
+
+GridEvaluator::GridEvaluator(std::shared_ptr<const FlowFrame> source,
+                             int level)
+    : frame(std::move(source)), planes{} {
+  frame->visitLevel(level, [&](const auto& volume) {
+    using Volume = std::decay_t<decltype(volume)>;
+    if constexpr (std::is_same_v<Volume, VolumeStorage>) {
+      for (int c = 0; c < VolumeStorage::kComponents; c++) {
+        planes[c] = volume.component(c).data();
+      }
+    } else {
+      cell = [&volume](int x, int y, int z, QVector3D* corners) {
+        volume.cell(x, y, z, corners);
+      };
+    }
+  });
+  steps = frame->getLevelDimension(level) - 1;
+  scale = (level == 0) ? 1 : (float)steps / (frame->getDimension() - 1);
+  // Offsets of the corners of VolumeStorage::cell from the base voxel.
+  std::ptrdiff_t row = steps + 1, slice = row * row;
+  for (int k = 0; k < 8; k++) {
+    corner[k] = (k & 1) + (k >> 1 & 1) * row + (k >> 2) * slice;
+  }
+}
+
+auto GridEvaluator::sample(QVector3D position) const -> InterpolationResult {
+  QVector3D local = position * scale;
+  int base[3];
+  float f[3];
+  for (int axis = 0; axis < 3; axis++) {
+    float p = local[axis];
+    // The far face belongs to the last cell; the comparisons also reject
+    // NaN.
+    if (!(p >= 0 && p <= steps)) return {false, {}};
+    base[axis] = std::min((int)p, steps - 1);
+    f[axis] = p - base[axis];
+  }
+  if (!planes[0]) {
+    QVector3D corners[8];
+    cell(base[0], base[1], base[2], corners);
+    return {true, blend(corners, f[0], f[1], f[2])};
+  }
+
+  // Float planes are read in place: one index for the base voxel, the
+  // corners at fixed offsets from it, blended as chains of a + f * (b - a)
+  // that the compiler contracts into fused multiply-adds where the target
+  // has them.
+  std::ptrdiff_t row = steps + 1;
+  std::ptrdiff_t origin = base[0] + row * (base[1] + row * base[2]);
+  float value[3];
+  for (int c = 0; c < VolumeStorage::kComponents; c++) {
+    const float* v = planes[c] + origin;
+    float x0 = v[corner[0]] + f[0] * (v[corner[1]] - v[corner[0]]);
+    float x1 = v[corner[2]] + f[0] * (v[corner[3]] - v[corner[2]]);
+    float x2 = v[corner[4]] + f[0] * (v[corner[5]] - v[corner[4]]);
+    float x3 = v[corner[6]] + f[0] * (v[corner[7]] - v[corner[6]]);
+    float y0 = x0 + f[1] * (x1 - x0);
+    float y1 = x2 + f[1] * (x3 - x2);
+    value[c] = y0 + f[2] * (y1 - y0);
+  }
+  return {true, QVector3D(value[0], value[1], value[2])};
+}
+
+auto GridEvaluator::samplePacket(int count, const float* x, const float* y,
+                                 const float* z, float* vx, float* vy,
+                                 float* vz, bool* valid) const -> void {
+  if (!planes[0]) {
+    FieldEvaluator::samplePacket(count, x, y, z, vx, vy, vz, valid);
+    return;
+  }
+  // sample() for a block of lanes at a time, every step a loop over the
+  // whole block. Only the corner loads are gathers; lanes outside the
+  // volume read voxel 0.
+  const float* position[3] = {x, y, z};
+  float* value[3] = {vx, vy, vz};
+  std::ptrdiff_t row = steps + 1;
+  for (int begin = 0; begin < count; begin += kLanes) {
+    int n = std::min(kLanes, count - begin);
+    float p[3][kLanes] = {}, f[3][kLanes];
+    int base[3][kLanes];
+    bool inside[kLanes];
+    for (int axis = 0; axis < 3; axis++) {
+      std::copy(position[axis] + begin, position[axis] + begin + n, p[axis]);
+    }
+    for (int l = 0; l < kLanes; l++) inside[l] = true;
+    for (int axis = 0; axis < 3; axis++) {
+      for (int l = 0; l < kLanes; l++) {
+        float q = p[axis][l] * scale;
+        bool in = q >= 0 && q <= steps;
+        inside[l] = inside[l] && in;
+        q = in ? q : 0;
+        base[axis][l] = std::min((int)q, steps - 1);
+        f[axis][l] = q - base[axis][l];
+      }
+    }
+    std::ptrdiff_t origin[kLanes];
+    for (int l = 0; l < kLanes; l++) {
+      origin[l] = base[0][l] + row * (base[1][l] + row * base[2][l]);
+      if (!inside[l]) origin[l] = 0;
+    }
+    for (int c = 0; c < VolumeStorage::kComponents; c++) {
+      float v[8][kLanes] = {};
+      for (int l = 0; l < n; l++) {
+        const float* voxel = planes[c] + origin[l];
+        for (int k = 0; k < 8; k++) v[k][l] = voxel[corner[k]];
+      }
+      float out[kLanes];
+      for (int l = 0; l < kLanes; l++) {
+        float x0 = v[0][l] + f[0][l] * (v[1][l] - v[0][l]);
+        float x1 = v[2][l] + f[0][l] * (v[3][l] - v[2][l]);
+        float x2 = v[4][l] + f[0][l] * (v[5][l] - v[4][l]);
+        float x3 = v[6][l] + f[0][l] * (v[7][l] - v[6][l]);
+        float y0 = x0 + f[1][l] * (x1 - x0);
+        float y1 = x2 + f[1][l] * (x3 - x2);
+        out[l] = y0 + f[2][l] * (y1 - y0);
+      }
+      std::copy(out, out + n, value[c] + begin);
+    }
+    std::copy(inside, inside + n, valid + begin);
+  }
+}
+
+AnalyticEvaluator::AnalyticEvaluator(int index, int dimension, int frame,
+                                     bool reverse)
+    : generator(getFieldGenerators()[index]),
+      steps(dimension - 1),
+      time(frame),
+      reversed(reverse),
+      // The spacing the generator uses, so voxel centres map exactly.
+      delta(1.0 / (dimension - 1.0)) {}
+
+auto AnalyticEvaluator::sample(QVector3D position) const
+    -> InterpolationResult {
+  InterpolationResult result;
+  sampleBatch(&position, 1, &result);
+  return result;
+}
+
+auto AnalyticEvaluator::sampleBatch(const QVector3D* positions, int count,
+                                    InterpolationResult* results) const
+    -> void {
+  // Points are gathered into x, y and z arrays for the point kernel.
+  constexpr int kBatch = 64;
+  float x[kBatch], y[kBatch], z[kBatch];
+  float vx[kBatch], vy[kBatch], vz[kBatch];
+  bool valid[kBatch];
+  for (int begin = 0; begin < count; begin += kBatch) {
+    int n = std::min(kBatch, count - begin);
+    for (int i = 0; i < n; i++) {
+      x[i] = positions[begin + i].x();
+      y[i] = positions[begin + i].y();
+      z[i] = positions[begin + i].z();
+    }
+    samplePacket(n, x, y, z, vx, vy, vz, valid);
+    for (int i = 0; i < n; i++) {
+      InterpolationResult& result = results[begin + i];
+      result.success = valid[i];
+      result.value = valid[i] ? QVector3D(vx[i], vy[i], vz[i])
+                              : QVector3D(0, 0, 0);
+    }
+  }
+}
+
+auto AnalyticEvaluator::samplePacket(int count, const float* x,
+                                     const float* y, const float* z,
+                                     float* vx, float* vy, float* vz,
+                                     bool* valid) const -> void {
+  // Points outside the volume are evaluated at the origin.
+  constexpr int kBatch = 64;
+  float px[kBatch], py[kBatch], pz[kBatch];
+  for (int begin = 0; begin < count; begin += kBatch) {
+    int n = std::min(kBatch, count - begin);
+    for (int i = 0; i < n; i++) {
+      QVector3D p(x[begin + i], y[begin + i], z[begin + i]);
+      bool inside = true;
+      for (int axis = 0; axis < 3; axis++) {
+        inside = inside && p[axis] >= 0 && p[axis] <= steps;
+      }
+      valid[begin + i] = inside;
+      if (!inside) p = QVector3D(0, 0, 0);
+      // A reversed frame holds voxel (d-1-x, d-1-y, d-1-z) at (x, y, z).
+      if (reversed) p = QVector3D(steps, steps, steps) - p;
+      px[i] = p.x() * delta;
+      py[i] = p.y() * delta;
+      pz[i] = p.z() * delta;
+    }
+    generator.points(time, n, px, py, pz, vx + begin, vy + begin,
+                     vz + begin);
+  }
+}
@@ -0,0 +1,95 @@
+//
+// Created by Joshua Lowe on 17.10.26.
+//
+
+#ifndef CODE_FIELDEVALUATOR_H
+#define CODE_FIELDEVALUATOR_H
+
+#include <QVector3D>
+#include <cstddef>
+#include <functional>
+#include <memory>
+
+#include "FieldGenerators.h"
+#include "FlowFrame.h"
+
+struct InterpolationResult {
+  bool success;
+  QVector3D value;
+};
+
+// Gathers the 8 corner vectors of the cell with base voxel (x, y, z) from
+// the current frame, in the order of VolumeStorage::cell.
+using CellSampler = std::function<void(int, int, int, QVector3D*)>;
+
+// Velocity field of one frame at arbitrary positions in level 0 voxel
+// coordinates. Sampling fails outside the volume. Evaluators are immutable
+// once constructed, so any number of threads may sample the same one.
+class FieldEvaluator {
+ public:
+  virtual ~FieldEvaluator() = default;
+
+  virtual auto sample(QVector3D) const -> InterpolationResult = 0;
+  // Samples count positions at once; the default loops over sample().
+  virtual auto sampleBatch(const QVector3D*, int, InterpolationResult*) const
+      -> void;
+  // Like sampleBatch() on positions and values split into x, y and z
+  // arrays, as packets of streamlines hold them. Values where valid is
+  // false are unspecified. The default loops over sample().
+  virtual auto samplePacket(int count, const float* x, const float* y,
+                            const float* z, float* vx, float* vy, float* vz,
+                            bool* valid) const -> void;
+};
+
+// Trilinear interpolation of a generated frame, read at a pyramid level.
+// Coarser levels span the same box with fewer cells. Holds the frame.
+// Float planes are read directly; other encodings and layouts gather the
+// cell through the storage.
+class GridEvaluator : public FieldEvaluator {
+ public:
+  // The frame needs the level built.
+  GridEvaluator(std::shared_ptr<const FlowFrame>, int);
+
+  auto sample(QVector3D) const -> InterpolationResult override;
+  auto samplePacket(int, const float*, const float*, const float*, float*,
+                    float*, float*, bool*) const -> void override;
+
+ private:
+  std::shared_ptr<const FlowFrame> frame;
+  // Component planes of the sampled level if it is a VolumeStorage, else
+  // null, and the offsets of the corners of a cell within them.
+  const float* planes[VolumeStorage::kComponents];
+  std::ptrdiff_t corner[8];
+  // Bound to the sampled level of frame for any other storage.
+  CellSampler cell;
+  // Cells per axis of the sampled level, and the factor taking level 0
+  // positions to it.
+  int steps;
+  float scale;
+};
+
+// A generator of FieldGenerators.h evaluated directly at the positions,
+// without generating a grid. Agrees with the generated frame at voxel
+// centres (for the tornado see evalTornadoPoints) and is free of
+// interpolation error in between.
+class AnalyticEvaluator : public FieldEvaluator {
+ public:
+  // Same arguments as the frame it stands in for: the generator index, its
+  // dimension, the frame number and whether the volume is reversed.
+  AnalyticEvaluator(int, int, int, bool);
+
+  auto sample(QVector3D) const -> InterpolationResult override;
+  auto sampleBatch(const QVector3D*, int, InterpolationResult*) const
+      -> void override;
+  auto samplePacket(int, const float*, const float*, const float*, float*,
+                    float*, float*, bool*) const -> void override;
+
+ private:
+  const FieldGenerator& generator;
+  int steps;
+  int time;
+  bool reversed;
+  float delta;
+};
+
+#endif  // CODE_FIELDEVALUATOR_H
@@ -0,0 +1,87 @@
+//
+// Created by Joshua Lowe on 17.10.26.
+//
+
+#include "FieldGenerators.h"
+
+#include <cmath>
+
+namespace {
+
+template <typename Generator>
+auto makeGenerator() -> FieldGenerator {
+  return {Generator::kName, GeneratorKernel<Generator>::slice,
+          GeneratorKernel<Generator>::points};
+}
+
+}  // namespace
+
+auto GeneratorKernel<AbcFlow>::slice(int dimension, int iz, int, float* u,
+                                     float* v, float* w) -> void {
+  constexpr float kTwoPi = AbcFlow::kTwoPi;
+  constexpr float kScale = AbcFlow::kScale;
+  float delta = 1.0 / (dimension - 1.0);
+  float pz = kTwoPi * (iz * delta);
+  float sz = std::sin(pz), cz = std::cos(pz);
+  // v only depends on x, so its row is the same for every y.
+  std::vector<float> cx(dimension), vx(dimension);
+  for (int ix = 0; ix < dimension; ix++) {
+    float px = kTwoPi * (ix * delta);
+    cx[ix] = std::cos(px);
+    vx[ix] = kScale * (AbcFlow::kB * std::sin(px) + AbcFlow::kA * cz);
+  }
+  for (int iy = 0; iy < dimension; iy++) {
+    float py = kTwoPi * (iy * delta);
+    float sy = std::sin(py);
+    float uy = kScale * (AbcFlow::kA * sz + AbcFlow::kC * std::cos(py));
+    std::size_t row = (std::size_t)iy * dimension;
+    for (int ix = 0; ix < dimension; ix++) {
+      u[row + ix] = uy;
+      v[row + ix] = vx[ix];
+      w[row + ix] = kScale * (AbcFlow::kC * sy + AbcFlow::kB * cx[ix]);
+    }
+  }
+}
+
+auto GeneratorKernel<DoubleGyreFlow>::slice(int dimension, int, int time,
+                                            float* u, float* v, float* w)
+    -> void {
+  constexpr float kPi = DoubleGyreFlow::kPi;
+  constexpr float kA = DoubleGyreFlow::kA;
+  DoubleGyreFlow flow(time);
+  float delta = 1.0 / (dimension - 1.0);
+  std::vector<float> sf(dimension), cf(dimension), dfdx(dimension);
+  for (int ix = 0; ix < dimension; ix++) {
+    float gx = 2 * (ix * delta);
+    float f = (flow.a * gx + flow.b) * gx;
+    sf[ix] = -kPi * kA * std::sin(kPi * f);
+    cf[ix] = kPi * kA * std::cos(kPi * f);
+    dfdx[ix] = 2 * flow.a * gx + flow.b;
+  }
+  for (int iy = 0; iy < dimension; iy++) {
+    float y = iy * delta;
+    float sy = std::sin(kPi * y), cy = std::cos(kPi * y);
+    std::size_t row = (std::size_t)iy * dimension;
+    for (int ix = 0; ix < dimension; ix++) {
+      u[row + ix] = sf[ix] * cy;
+      v[row + ix] = cf[ix] * sy * dfdx[ix];
+      w[row + ix] = 0;
+    }
+  }
+}
+
+auto getFieldGenerators() -> const std::vector<FieldGenerator>& {
+  static const std::vector<FieldGenerator> generators{
+      makeGenerator<TornadoFlow>(), makeGenerator<AbcFlow>(),
+      makeGenerator<DoubleGyreFlow>(), makeGenerator<RankineFlow>(),
+      makeGenerator<ShearFlow>()};
+  return generators;
+}
+
+auto findFieldGenerator(const std::string& name) -> int {
+  const std::vector<FieldGenerator>& generators = getFieldGenerators();
+  for (std::size_t i = 0; i < generators.size(); i++) {
+    if (name == generators[i].name) return i;
+  }
+  return -1;
+}
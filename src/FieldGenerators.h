@@ -0,0 +1,195 @@
+//
+// Created by Joshua Lowe on 17.10.26.
+//
+
+#ifndef CODE_FIELDGENERATORS_H
+#define CODE_FIELDGENERATORS_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "TornadoKernel.h"
+
+// Analytic flows FlowDataSource can generate. A generator is a policy class
+// constructed once per time step (the frame number) with
+//
+//   auto evaluate(float x, float y, float z, float* u, float* v, float* w)
+//       const -> void;
+//
+// taking the normalised [0, 1] coordinates of the tornado generator.
+// GeneratorKernel turns a policy into slice and point loops with evaluate()
+// inlined; it is specialised where a cheaper slice kernel exists. The
+// velocities are scaled to peak around the tornado's 0.3.
+
+// The Crawfis tornado of TornadoKernel.h.
+struct TornadoFlow {
+  static constexpr const char* kName = "tornado";
+  explicit TornadoFlow(int time) : time(time) {}
+
+  auto evaluate(float x, float y, float z, float* u, float* v, float* w) const
+      -> void {
+    evalTornadoPoints(time, 1, &x, &y, &z, u, v, w);
+  }
+
+  int time;
+};
+
+// Arnold-Beltrami-Childress flow over one period per axis. Steady, with
+// chaotic streamlines that fill most of the volume.
+struct AbcFlow {
+  static constexpr const char* kName = "abc";
+  static constexpr float kA = 1.7320508f;  // sqrt(3)
+  static constexpr float kB = 1.4142136f;  // sqrt(2)
+  static constexpr float kC = 1.0f;
+  static constexpr float kScale = 0.1f;
+  static constexpr float kTwoPi = 6.2831853f;
+  explicit AbcFlow(int) {}
+
+  auto evaluate(float x, float y, float z, float* u, float* v, float* w) const
+      -> void {
+    float px = kTwoPi * x, py = kTwoPi * y, pz = kTwoPi * z;
+    *u = kScale * (kA * std::sin(pz) + kC * std::cos(py));
+    *v = kScale * (kB * std::sin(px) + kA * std::cos(pz));
+    *w = kScale * (kC * std::sin(py) + kB * std::cos(px));
+  }
+};
+
+// Shadden's periodically forced double gyre on [0, 2] x [0, 1], with x
+// stretched over the volume. Planar and the same in every z-slice; one
+// period takes 100 frames.
+struct DoubleGyreFlow {
+  static constexpr const char* kName = "double-gyre";
+  static constexpr float kA = 0.1f;
+  static constexpr float kEpsilon = 0.25f;
+  static constexpr float kOmega = 6.2831853f / 10;
+  static constexpr float kPi = 3.1415927f;
+  explicit DoubleGyreFlow(int time) {
+    float forcing = kEpsilon * std::sin(kOmega * 0.1f * time);
+    a = forcing;
+    b = 1 - 2 * forcing;
+  }
+
+  auto evaluate(float x, float y, float, float* u, float* v, float* w) const
+      -> void {
+    float gx = 2 * x;
+    float f = (a * gx + b) * gx;
+    float dfdx = 2 * a * gx + b;
+    *u = -kPi * kA * std::sin(kPi * f) * std::cos(kPi * y);
+    *v = kPi * kA * std::cos(kPi * f) * std::sin(kPi * y) * dfdx;
+    *w = 0;
+  }
+
+  float a, b;
+};
+
+// Rankine vortex around the vertical axis through the centre: solid body
+// rotation inside the core radius, potential flow outside. Steady, with
+// closed circular streamlines.
+struct RankineFlow {
+  static constexpr const char* kName = "rankine";
+  static constexpr float kRadius = 0.15f;
+  static constexpr float kSpeed = 0.3f;  // at the core radius
+  explicit RankineFlow(int) {}
+
+  auto evaluate(float x, float y, float, float* u, float* v, float* w) const
+      -> void {
+    float dx = x - 0.5f, dy = y - 0.5f;
+    // Tangential speed divided by r; inside the core that is constant.
+    float r2 = std::max(dx * dx + dy * dy, kRadius * kRadius);
+    float omega = kSpeed * kRadius / r2;
+    *u = -omega * dy;
+    *v = omega * dx;
+    *w = 0;
+  }
+};
+
+// Uniform shear along x that changes sign at half the height in y. Steady,
+// with straight streamlines of every length.
+struct ShearFlow {
+  static constexpr const char* kName = "shear";
+  static constexpr float kSpeed = 0.3f;
+  explicit ShearFlow(int) {}
+
+  auto evaluate(float, float y, float, float* u, float* v, float* w) const
+      -> void {
+    *u = kSpeed * (2 * y - 1);
+    *v = 0;
+    *w = 0;
+  }
+};
+
+// Writes the dimension * dimension voxels of z-slice iz per plane.
+template <typename Generator>
+auto generateSliceWith(int dimension, int iz, int time, float* u, float* v,
+                       float* w) -> void {
+  Generator flow(time);
+  float delta = 1.0 / (dimension - 1.0);
+  float z = iz * delta;
+  for (int iy = 0; iy < dimension; iy++) {
+    float y = iy * delta;
+    std::size_t row = (std::size_t)iy * dimension;
+    for (int ix = 0; ix < dimension; ix++) {
+      flow.evaluate(ix * delta, y, z, u + row + ix, v + row + ix,
+                    w + row + ix);
+    }
+  }
+}
+
+// Evaluates count points given as normalised x, y and z arrays.
+template <typename Generator>
+auto evaluatePointsWith(int time, int count, const float* x, const float* y,
+                        const float* z, float* u, float* v, float* w) -> void {
+  Generator flow(time);
+  for (int i = 0; i < count; i++) {
+    flow.evaluate(x[i], y[i], z[i], u + i, v + i, w + i);
+  }
+}
+
+template <typename Generator>
+struct GeneratorKernel {
+  static constexpr auto slice = &generateSliceWith<Generator>;
+  static constexpr auto points = &evaluatePointsWith<Generator>;
+};
+
+template <>
+struct GeneratorKernel<TornadoFlow> {
+  static auto slice(int dimension, int iz, int time, float* u, float* v,
+                    float* w) -> void {
+    genTornadoSlice(prepareTornadoSlice(dimension, iz, time), u, v, w);
+  }
+  static constexpr auto points = &evalTornadoPoints;
+};
+
+// The sines of these flows separate into per-slice, per-row and per-column
+// terms, so their slices take them from tables. The values are the same as
+// those of evaluate().
+template <>
+struct GeneratorKernel<AbcFlow> {
+  static auto slice(int, int, int, float*, float*, float*) -> void;
+  static constexpr auto points = &evaluatePointsWith<AbcFlow>;
+};
+
+template <>
+struct GeneratorKernel<DoubleGyreFlow> {
+  static auto slice(int, int, int, float*, float*, float*) -> void;
+  static constexpr auto points = &evaluatePointsWith<DoubleGyreFlow>;
+};
+
+// Runtime handle of one generator. The kernels are called once per slice
+// or batch of points, never per voxel.
+struct FieldGenerator {
+  const char* name;
+  void (*slice)(int, int, int, float*, float*, float*);
+  void (*points)(int, int, const float*, const float*, const float*, float*,
+                 float*, float*);
+};
+
+// All generators, the tornado first.
+auto getFieldGenerators() -> const std::vector<FieldGenerator>&;
+// Index of the generator with that name, or -1.
+auto findFieldGenerator(const std::string&) -> int;
+
+#endif  // CODE_FIELDGENERATORS_H
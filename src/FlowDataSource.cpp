@@ -6,49 +6,273 @@
 
 #include <algorithm>
 #include <cmath>
+#include <cstdio>
+#include <iostream>
 #include <limits>
 
-FlowDataSource::FlowDataSource() : dimension(16), frame(0){};
+#include "FieldGenerators.h"
+#include "StreamingVolumeFile.h"
+#include "TaskScheduler.h"
+#include "VolumeFile.h"
 
-FlowDataSource::FlowDataSource(int dimension)
-    : dimension(dimension), frame(0){};
+FlowDataSource::FlowDataSource()
+    : generation(0),
+      dimension(16),
+      frame(0),
+      prefetchDepth(0),
+      prefetchLevel(0),
+      threadCount(TaskScheduler::instance().getConcurrency()),
+      reversed(false),
+      encoding(Float32),
+      layout(LinearLayout),
+      source(0),
+      sourceCount(0),
+      generator(0) {}
 
-auto FlowDataSource::getArray() -> QVector<QVector3D> {
-  return cartesianDataGrid;
+FlowDataSource::FlowDataSource(int dimension) : FlowDataSource() {
+  this->dimension = dimension;
 };
 
-auto FlowDataSource::createData() -> void {
-  cartesianDataGrid.clear();
-  genTornado(frame);
+auto FlowDataSource::getVolume() -> const VolumeStorage& {
+  return prepareSlices(0, dimension).getVolume();
+};
+
+auto FlowDataSource::getStatistics() -> const VolumeStatistics& {
+  return prepareSlices(0, dimension).getStatistics();
+}
+
+auto FlowDataSource::createData() -> void { acquireFrame(); }
+
+auto FlowDataSource::currentKey() -> FrameKey {
+  // Non-linear layouts are float32 whatever the encoding says.
+  VolumeEncoding stored = (layout == LinearLayout) ? encoding : Float32;
+  return {frame, dimension, reversed, source, stored, layout, generator};
+}
+
+auto FlowDataSource::acquireFrame() -> std::shared_ptr<const FlowFrame> {
+  return acquireSlices(0, dimension);
 }
 
-auto FlowDataSource::setFrame(int inFrame) -> void { frame = inFrame; }
+auto FlowDataSource::acquireSlices(int z0, int z1)
+    -> std::shared_ptr<const FlowFrame> {
+  return acquireLevel(0, z0, z1);
+}
+
+auto FlowDataSource::acquireLevel(int level, int z0, int z1)
+    -> std::shared_ptr<const FlowFrame> {
+  prefetchLevel = level;
+  if (level == 0) {
+    prepareSlices(z0, z1);
+  } else {
+    buildLevels(prepareSlices(0, dimension), level);
+  }
+  return currentFrame;
+}
+
+auto FlowDataSource::acquireNextFrame(int level)
+    -> std::shared_ptr<const FlowFrame> {
+  FrameKey key = currentKey();
+  key.frame += 1;
+  if (!nextFrame || nextFrame->getKey() != key) {
+    nextFrame = prefetcher ? prefetcher->take(key) : nullptr;
+    if (!nextFrame) nextFrame = produceFrame(key);
+  }
+  buildLevels(*nextFrame, level);
+  return nextFrame;
+}
+
+auto FlowDataSource::acquireDerived(int z0, int z1)
+    -> std::shared_ptr<const FlowFrame> {
+  FlowFrame& target =
+      prepareSlices(std::max(z0 - 1, 0), std::min(z1 + 1, dimension));
+  computeDerived(target, z0, z1);
+  return currentFrame;
+}
+
+auto FlowDataSource::prepareSlices(int z0, int z1) -> FlowFrame& {
+  FrameKey key = currentKey();
+  if (!currentFrame || currentFrame->getKey() != key) {
+    // Swap in the back buffer when the producer already built this frame,
+    // or the frame a consumer asked for as the next one.
+    std::shared_ptr<FlowFrame> next;
+    if (nextFrame && nextFrame->getKey() == key) {
+      next = std::move(nextFrame);
+    } else if (prefetcher) {
+      next = prefetcher->take(key);
+    }
+    nextFrame.reset();
+    if (next) {
+      next->generation = ++generation;
+    } else {
+      next = createFrame(key, ++generation);
+    }
+    currentFrame = std::move(next);
+
+    if (prefetcher) {
+      std::vector<FrameKey> upcoming;
+      for (int i = 1; i <= prefetchDepth; i++) {
+        FrameKey next = key;
+        next.frame += i;
+        upcoming.push_back(next);
+      }
+      prefetcher->request(upcoming);
+    }
+  }
+  // A reversed frame mirrors the whole volume and a converted one is
+  // converted as a whole, so both are always complete.
+  if (key.reversed || !key.isLinearFloat()) {
+    z0 = 0;
+    z1 = key.dimension;
+  }
+  z0 = std::max(z0, 0);
+  z1 = std::min(z1, key.dimension);
+  if (!currentFrame->isResident(z0, z1)) genField(*currentFrame, z0, z1);
+  return *currentFrame;
+}
+
+auto FlowDataSource::getGeneration() -> std::uint64_t { return generation; }
+
+auto FlowDataSource::setFrame(int inFrame) -> void {
+  frame = inFrame;
+  if (provider) provider->seek(providerIndex(frame));
+}
 
 auto FlowDataSource::getFrame() -> int { return frame; }
 
+auto FlowDataSource::setThreadCount(int count) -> void {
+  threadCount = (count < 1) ? 1 : count;
+}
+
+auto FlowDataSource::getThreadCount() -> int { return threadCount; }
+
+auto FlowDataSource::setPrefetchDepth(int depth) -> void {
+  prefetchDepth = (depth < 0) ? 0 : depth;
+  if (prefetchDepth == 0) {
+    prefetcher.reset();
+  } else if (!prefetcher) {
+    prefetcher = std::make_unique<FramePrefetcher>(
+        [this](const FrameKey& key) { return produceFrame(key); });
+  }
+}
+
+auto FlowDataSource::getPrefetchDepth() -> int { return prefetchDepth; }
+
+auto FlowDataSource::setEncoding(VolumeEncoding next) -> void {
+  encoding = next;
+}
+
+auto FlowDataSource::getEncoding() -> VolumeEncoding { return encoding; }
+
+auto FlowDataSource::setLayout(VolumeLayout next) -> void { layout = next; }
+
+auto FlowDataSource::getLayout() -> VolumeLayout { return layout; }
+
+auto FlowDataSource::produceFrame(const FrameKey& key)
+    -> std::shared_ptr<FlowFrame> {
+  // Runs on the prefetch thread. The frame is private to it until it is
+  // taken, so it can be generated like any other.
+  auto next = createFrame(key, 0);
+  genField(*next, 0, key.dimension);
+  buildLevels(*next, prefetchLevel);
+  return next;
+}
+
+auto FlowDataSource::createFrame(const FrameKey& key,
+                                 std::uint64_t frameGeneration)
+    -> std::shared_ptr<FlowFrame> {
+  if (key.source == 0) return std::make_shared<FlowFrame>(key, frameGeneration);
+  VolumeStorage recorded = provider->loadFrame(providerIndex(key.frame));
+  return std::make_shared<FlowFrame>(key, frameGeneration,
+                                     std::move(recorded));
+}
+
+auto FlowDataSource::providerIndex(int inFrame) -> int {
+  // Recorded sequences loop, in both directions.
+  int count = provider->getFrameCount();
+  return (inFrame % count + count) % count;
+}
+
+auto FlowDataSource::setFrameProvider(std::shared_ptr<FrameProvider> next)
+    -> void {
+  // The prefetch thread reads the provider, so it has to be idle first.
+  int depth = prefetchDepth;
+  setPrefetchDepth(0);
+  provider = std::move(next);
+  source = provider ? ++sourceCount : 0;
+  if (provider) {
+    dimension = provider->getDimension();
+    provider->seek(providerIndex(frame));
+  }
+  setPrefetchDepth(depth);
+}
+
+auto FlowDataSource::setGenerator(int index) -> bool {
+  if (index < 0 || index >= (int)getFieldGenerators().size()) return false;
+  generator = index;
+  return true;
+}
+
+auto FlowDataSource::setGenerator(const std::string& name) -> bool {
+  if (setGenerator(findFieldGenerator(name))) return true;
+  std::cerr << "unknown field generator " << name << std::endl;
+  return false;
+}
+
+auto FlowDataSource::getGenerator() -> int { return generator; }
+
+auto FlowDataSource::getFrameProvider() -> std::shared_ptr<FrameProvider> {
+  return provider;
+}
+
+auto FlowDataSource::openVolumeFile(const std::string& path) -> bool {
+  std::shared_ptr<MappedVolumeFile> file = MappedVolumeFile::open(path);
+  if (!file) return false;
+  setFrameProvider(file);
+  std::cout << "replaying " << file->getFrameCount() << " frames of "
+            << path << std::endl;
+  return true;
+}
+
+auto FlowDataSource::streamVolumeFile(const std::string& path,
+                                      std::size_t budget) -> bool {
+  std::shared_ptr<StreamingVolumeFile> file =
+      StreamingVolumeFile::open(path, budget);
+  if (!file) return false;
+  setFrameProvider(file);
+  std::cout << "streaming " << file->getFrameCount() << " frames of " << path
+            << " through " << file->getCapacity() << " buffers" << std::endl;
+  return true;
+}
+
+auto FlowDataSource::exportFrames(const std::string& path, int first,
+                                  int count) -> bool {
+  VolumeFileWriter writer;
+  if (!writer.open(path, dimension)) return false;
+  // Files always hold linear float32 planes.
+  FrameKey key = currentKey();
+  key.encoding = Float32;
+  key.layout = LinearLayout;
+  for (int i = 0; i < count; i++) {
+    key.frame = first + i;
+    if (!writer.writeFrame(produceFrame(key)->getVolume(), key.frame)) {
+      return false;
+    }
+  }
+  return writer.close();
+}
+
 auto FlowDataSource::setDimension(int resolution) -> void {
+  if (provider) return;
   dimension =
       (dimension + resolution <= 0) ? dimension : dimension + resolution;
 }
 
 auto FlowDataSource::getDataValue(int ix, int iy, int iz, int ic) -> float {
-  int index = ix + (dimension * iy) + (dimension * dimension * iz);
-  switch (ic) {
-    case 0:
-      return cartesianDataGrid.at(index).x();
-      break;
-    case 1:
-      return cartesianDataGrid.at(index).y();
-      break;
-    case 2:
-      return cartesianDataGrid.at(index).z();
-      break;
-    case 3:
-      return getBetrag(ix, iy, iz);
-      break;
-    default:
-      return {};
-  }
+  if (ic < 0 || ic > 3) return {};
+  if (ic == 3) return getBetrag(ix, iy, iz);
+  return prepareSlices(iz, iz + 1).visit([&](const auto& volume) {
+    return volume.value(ix, iy, iz, ic);
+  });
 }
 
 auto FlowDataSource::printValuesOfHorizontalSlice(int iz) -> void {
@@ -65,140 +289,160 @@ auto FlowDataSource::printValuesOfHorizontalSlice(int iz) -> void {
 }
 
 auto FlowDataSource::getMinBetrag() -> float {
-  float minimum = std::numeric_limits<float>::max();
-  for (int i = 0; i < dimension; i++) {
-    for (int j = 0; j < dimension; j++) {
-      for (int u = 0; u < dimension; u++) {
-        float temp = getBetrag(u, j, i);
-        minimum = (temp < minimum) ? temp : minimum;
-      }
-    }
-  }
-  return minimum;
+  return getStatistics().components[3].min;
 }
 
 auto FlowDataSource::getMaxBetrag() -> float {
-  float maximum = 0;
-  for (int i = 0; i < dimension; i++) {
-    for (int j = 0; j < dimension; j++) {
-      for (int u = 0; u < dimension; u++) {
-        float temp = getBetrag(u, j, i);
-        maximum = (temp > maximum) ? temp : maximum;
-      }
-    }
-  }
-  return maximum;
+  return getStatistics().components[3].max;
 }
 
 auto FlowDataSource::getMaxValue(int c) -> float {
-  float maximum = std::numeric_limits<float>::lowest();
-  for (int i = 0; i < dimension; i++) {
-    for (int j = 0; j < dimension; j++) {
-      for (int u = 0; u < dimension; u++) {
-        float temp = getDataValue(j, i, u, 0);
-        maximum = (temp > maximum) ? temp : maximum;
-        temp = getDataValue(j, i, u, 1);
-        maximum = (temp > maximum) ? temp : maximum;
-        temp = getDataValue(j, i, u, 2);
-        maximum = (temp > maximum) ? temp : maximum;
-      }
-    }
-  }
-  return maximum;
+  if (c < 0 || c > 3) return {};
+  return getStatistics().components[c].max;
 }
+
 auto FlowDataSource::getMinValue(int c) -> float {
-  float minimum = std::numeric_limits<float>::max();
-  for (int i = 0; i < dimension; i++) {
-    for (int j = 0; j < dimension; j++) {
-      for (int u = 0; u < dimension; u++) {
-        float temp = getDataValue(j, i, u, 0);
-        minimum = (temp < minimum) ? temp : minimum;
-        temp = getDataValue(j, i, u, 1);
-        minimum = (temp < minimum) ? temp : minimum;
-        temp = getDataValue(j, i, u, 2);
-        minimum = (temp < minimum) ? temp : minimum;
-      }
-    }
-  }
-  return minimum;
+  if (c < 0 || c > 3) return {};
+  return getStatistics().components[c].min;
 }
 
 auto FlowDataSource::getBetrag(int x, int y, int z) -> float {
-  float betrag;
-  float xc2 = std::powf(getDataValue(x, y, z, 0), 2);
-  float yc2 = std::powf(getDataValue(x, y, z, 1), 2);
-  float zc2 = std::powf(getDataValue(x, y, z, 2), 2);
-  betrag = std::sqrtf(xc2 + yc2 + zc2);
-  return betrag;
+  const FlowFrame& slice = prepareSlices(z, z + 1);
+  slice.requireComponent(3, z, z + 1);
+  return slice.visit(
+      [&](const auto& volume) { return volume.value(x, y, z, 3); });
 }
 
 auto FlowDataSource::getDimension() -> int { return dimension; }
 
-auto FlowDataSource::reverseArray() -> void {
-  std::reverse(cartesianDataGrid.begin(), cartesianDataGrid.end());
-}
-
-auto FlowDataSource::genTornado(int time) -> void {
-  /*
-   *  Gen_Tornado creates a vector field of dimension [xs,ys,zs,3] from
-   *  a proceedural function. By passing in different time arguements,
-   *  a slightly different and rotating field is created.
-   *
-   *  The magnitude of the vector field is highest at some funnel shape
-   *  and values range from 0.0 to around 0.4 (I think).
-   *
-   *  I just wrote these comments, 8 years after I wrote the function.
-   *
-   * Developed by Roger A. Crawfis, The Ohio State University
-   *
-   */
-  int xs = dimension, ys = dimension, zs = dimension;
-  float x, y, z;
-  int ix, iy, iz;
-  float r, xc, yc, scale, temp, z0;
-  float r2 = 8;
-  float SMALL = 0.00000000001;
-  float xdelta = 1.0 / (xs - 1.0);
-  float ydelta = 1.0 / (ys - 1.0);
-  float zdelta = 1.0 / (zs - 1.0);
-
-  for (iz = 0; iz < zs; iz++) {
-    z = iz * zdelta;  // map z to 0->1
-    xc = 0.5 +
-         0.1 * sin(0.04 * time +
-                   10.0 * z);  // For each z-slice, determine the spiral circle.
-    yc = 0.5 +
-         0.1 * cos(0.03 * time +
-                   3.0 * z);  //    (xc,yc) determine the center of the circle.
-    r = 0.1 + 0.4 * z * z +
-        0.1 * z * sin(8.0 * z);  //  The radius also changes at each z-slice.
-    r2 = 0.2 + 0.1 * z;          //    r is the center radius, r2 is for damping
-    for (iy = 0; iy < ys; iy++) {
-      y = iy * ydelta;
-      for (ix = 0; ix < xs; ix++) {
-        x = ix * xdelta;
-        temp = sqrt((y - yc) * (y - yc) + (x - xc) * (x - xc));
-        scale = fabs(r - temp);
-        /*
-         *  I do not like this next line. It produces a discontinuity
-         *  in the magnitude. Fix it later.
-         *
-         */
-        if (scale > r2)
-          scale = 0.8 - scale;
-        else
-          scale = 1.0;
-        z0 = 0.1 * (0.1 - temp * z);
-        if (z0 < 0.0) z0 = 0.0;
-        temp = sqrt(temp * temp + z0 * z0);
-        scale = (r + r2 - temp) * scale / (temp + SMALL);
-        scale = scale / (1 + z);
-        float xResult, yResult, zResult;
-        xResult = scale * (y - yc) + 0.1 * (x - xc);
-        yResult = scale * -(x - xc) + 0.1 * (y - yc);
-        zResult = scale * z0;
-        cartesianDataGrid.append({xResult, yResult, zResult});
+auto FlowDataSource::reverseArray() -> void { reversed = !reversed; }
+
+auto FlowDataSource::isReversed() -> bool { return reversed; }
+
+auto FlowDataSource::forEachSlab(
+    int count, int workers, const std::function<void(int, int, int)>& work)
+    -> void {
+  // Splits [0, count) into min(workers, count) contiguous slabs and runs
+  // them on the shared scheduler; the calling thread takes the first slab.
+  // Work is called as work(slab, begin, end).
+  if (count <= 0) return;
+  workers = std::clamp(workers, 1, count);
+  TaskGroup slabs;
+  for (int i = 1; i < workers; i++) {
+    int begin = count * i / workers, end = count * (i + 1) / workers;
+    slabs.run([&work, i, begin, end] { work(i, begin, end); });
+  }
+  work(0, 0, count / workers);
+  slabs.wait();
+}
+
+auto FlowDataSource::genField(FlowFrame& target, int z0, int z1) -> void {
+  // Every z-slice only depends on its own per-slice terms, so the missing
+  // slices of [z0, z1) are split into contiguous slabs that the workers
+  // write into the presized planes. Each voxel is computed exactly as in
+  // the serial loop, which keeps the output independent of the thread
+  // count and of the order in which regions were requested.
+  std::vector<int> missing;
+  for (int iz = z0; iz < z1; iz++) {
+    if (!target.isResident(iz, iz + 1)) missing.push_back(iz);
+  }
+  forEachSlab(missing.size(), threadCount, [&](int, int begin, int end) {
+    for (int i = begin; i < end; i++) generateSlice(target, missing[i]);
+  });
+
+  if (target.key.reversed) {
+    target.volume.reverse();
+    std::reverse(target.sliceMoments.begin(), target.sliceMoments.end());
+    // Reversing mirrors x and y as well, so the tiles are only indexed now.
+    forEachSlab(target.volume.dimension(), threadCount,
+                [&](int, int begin, int end) {
+                  for (int iz = begin; iz < end; iz++) {
+                    target.tileRanges.build(target.volume, iz);
+                  }
+                });
+  }
+  if (target.markResident(z0, z1)) {
+    computeStatistics(target);
+    target.convert();
+  }
+}
+
+auto FlowDataSource::generateSlice(FlowFrame& target, int iz) -> void {
+  // See FieldGenerators.h for the analytic flows, e.g. the Crawfis tornado
+  // of TornadoKernel.cpp. The generator writes the voxels of the slice
+  // straight into the component planes. The slice moments and tile ranges
+  // are taken while the slice is still in cache; for a recorded frame
+  // taking them is all there is to do.
+  VolumeStorage& volume = target.volume;
+  if (!target.recorded) {
+    const FieldGenerator& field = getFieldGenerators()[target.key.generator];
+    field.slice(volume.dimension(), iz, target.key.frame,
+                volume.mutableSlice(0, iz).data(),
+                volume.mutableSlice(1, iz).data(),
+                volume.mutableSlice(2, iz).data());
+  }
+  target.sliceMoments[iz] = StatisticsAccumulator();
+  target.sliceMoments[iz].addSlices(volume, iz, iz + 1);
+  // Reversed frames are indexed once they are mirrored.
+  if (!target.key.reversed) target.tileRanges.build(volume, iz);
+}
+
+auto FlowDataSource::computeStatistics(FlowFrame& target) -> void {
+  // Merging the slice moments in z order gives the same result no matter
+  // how the slices were generated.
+  int dim = target.volume.dimension();
+  target.statistics = target.getSliceStatistics(0, dim);
+
+  // The histogram bins depend on the final ranges, so they need a second,
+  // equally parallel sweep. The thread count is read once, as
+  // setThreadCount() may change it while the sweep sizes its histograms.
+  int workers = std::min(threadCount.load(), dim);
+  std::vector<VolumeStatistics> histograms(workers, target.statistics);
+  forEachSlab(dim, workers, [&](int slab, int z0, int z1) {
+    accumulateHistograms(target.volume, z0, z1, target.statistics,
+                         histograms[slab]);
+  });
+  for (const VolumeStatistics& partial : histograms) {
+    for (int c = 0; c < 4; c++) {
+      for (int b = 0; b < ComponentStatistics::kBins; b++) {
+        target.statistics.components[c].histogram[b] +=
+            partial.components[c].histogram[b];
       }
     }
   }
 }
+
+auto FlowDataSource::buildLevels(FlowFrame& target, int level) -> void {
+  // Each level is filtered from the one above it, its slices split into
+  // slabs like the generation of level 0.
+  int built = target.getLevelCount();
+  while (built <= level) {
+    int dim = target.getLevelDimension(built);
+    if (dim < FlowFrame::kMinLevelDimension) return;
+    auto next = std::make_unique<VolumeStorage>(dim);
+    target.visitLevel(built - 1, [&](const auto& fine) {
+      forEachSlab(dim, threadCount, [&](int, int z0, int z1) {
+        downsampleSlices(fine, *next, z0, z1);
+      });
+    });
+    target.addLevel(std::move(next));
+    built++;
+  }
+}
+
+auto FlowDataSource::computeDerived(FlowFrame& target, int z0, int z1)
+    -> void {
+  // The frame is already shared, so the missing slices are computed under
+  // its lock; the workers only read the velocity and write their own
+  // slices.
+  std::lock_guard<std::mutex> guard(target.lock);
+  DerivedVolume& derived = target.derived;
+  if (derived.dimension() == 0) derived.resize(target.getDimension());
+  std::vector<int> missing;
+  for (int iz = z0; iz < z1; iz++) {
+    if (!derived.isResident(iz)) missing.push_back(iz);
+  }
+  forEachSlab(missing.size(), threadCount, [&](int, int begin, int end) {
+    for (int i = begin; i < end; i++) derived.compute(target, missing[i]);
+  });
+}
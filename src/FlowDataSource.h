@@ -9,9 +9,19 @@
 
 #include <QVector3D>
 #include <QVector>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
 #include <tuple>
 #include <vector>
 
+#include "FlowFrame.h"
+#include "FramePrefetcher.h"
+#include "FrameProvider.h"
+#include "VolumeStorage.h"
+
 class FlowDataSource {
  public:
   FlowDataSource();
@@ -19,26 +29,116 @@ class FlowDataSource {
 
   auto printValuesOfHorizontalSlice(int) -> void;
   auto createData() -> void;
+  auto acquireFrame() -> std::shared_ptr<const FlowFrame>;
+  // Like acquireFrame(), but only guarantees that the z-slices [z0, z1) of
+  // the returned frame are resident.
+  auto acquireSlices(int, int) -> std::shared_ptr<const FlowFrame>;
+  // Like acquireSlices() for level 0. A coarser level of the mip pyramid
+  // needs the whole frame, so it is generated completely and its pyramid
+  // built down to the level, or to the coarsest level worth building;
+  // consumers clamp to getLevelCount() - 1. Playback prefetches upcoming
+  // frames down to the level asked for last.
+  auto acquireLevel(int, int, int) -> std::shared_ptr<const FlowFrame>;
+  auto acquireLevel(int level) -> std::shared_ptr<const FlowFrame> {
+    return acquireLevel(level, 0, dimension);
+  }
+  // The frame after the current one, complete and with its pyramid built
+  // down to the level, for consumers that interpolate in time. It becomes
+  // the current frame when the frame counter reaches it, so no more than
+  // two frames are held for this.
+  auto acquireNextFrame(int) -> std::shared_ptr<const FlowFrame>;
+  // Like acquireSlices(), and also computes the derived fields (see
+  // DerivedFields.h) of the slices [z0, z1) that do not have them yet.
+  // Central differences read one slice further on both sides, so those are
+  // generated too.
+  auto acquireDerived(int, int) -> std::shared_ptr<const FlowFrame>;
   auto setDimension(int) -> void;
 
   auto getDataValue(int, int, int, int) -> float;
-  auto getArray() -> QVector<QVector3D>;
+  // Float planes of the current frame; empty while an encoding or a
+  // non-linear layout is set.
+  auto getVolume() -> const VolumeStorage&;
+  auto getStatistics() -> const VolumeStatistics&;
   auto getBetrag(int, int, int) -> float;
   auto getMaxValue(int) -> float;
   auto getMinValue(int) -> float;
   auto getMinBetrag() -> float;
   auto getMaxBetrag() -> float;
   auto getDimension() -> int;
+  auto getGeneration() -> std::uint64_t;
   auto reverseArray() -> void;
+  auto isReversed() -> bool;
   auto setFrame(int) -> void;
   auto getFrame() -> int;
+  auto setThreadCount(int) -> void;
+  auto getThreadCount() -> int;
+  // Number of upcoming frames a background thread generates ahead of the
+  // current one during playback. Zero disables prefetching.
+  auto setPrefetchDepth(int) -> void;
+  auto getPrefetchDepth() -> int;
+  // Storage encoding of the frames produced from now on (see
+  // EncodedVolume.h). Encoded frames are always generated completely.
+  auto setEncoding(VolumeEncoding) -> void;
+  auto getEncoding() -> VolumeEncoding;
+  // Memory layout of the frames produced from now on. Non-linear layouts
+  // store float32 and ignore the encoding.
+  auto setLayout(VolumeLayout) -> void;
+  auto getLayout() -> VolumeLayout;
+
+  // Analytic flow generated while no provider is set, by index or name
+  // into getFieldGenerators(). Unknown generators are rejected.
+  auto setGenerator(int) -> bool;
+  auto setGenerator(const std::string&) -> bool;
+  auto getGenerator() -> int;
+
+  // Replays the frames of a provider instead of the generator; nullptr goes
+  // back to the generator. The dimension follows the provider while it is
+  // set and setDimension() is ignored.
+  auto setFrameProvider(std::shared_ptr<FrameProvider>) -> void;
+  auto getFrameProvider() -> std::shared_ptr<FrameProvider>;
+  // Maps a volume file (see VolumeFile.h) and replays it.
+  auto openVolumeFile(const std::string&) -> bool;
+  // Streams a volume file through a ring of at most budget bytes instead of
+  // mapping it, for sequences that do not fit into memory.
+  auto streamVolumeFile(const std::string&, std::size_t) -> bool;
+  // Writes count frames starting at first, as the current source produces
+  // them, to a volume file.
+  auto exportFrames(const std::string&, int, int) -> bool;
 
  private:
-  auto genTornado(int) -> void;
-  QVector<QVector3D> cartesianDataGrid;
+  auto currentKey() -> FrameKey;
+  auto prepareSlices(int, int) -> FlowFrame&;
+  auto providerIndex(int) -> int;
+  auto createFrame(const FrameKey&, std::uint64_t)
+      -> std::shared_ptr<FlowFrame>;
+  auto produceFrame(const FrameKey&) -> std::shared_ptr<FlowFrame>;
+  auto forEachSlab(int, int, const std::function<void(int, int, int)>&)
+      -> void;
+  auto genField(FlowFrame&, int, int) -> void;
+  auto generateSlice(FlowFrame&, int) -> void;
+  auto computeStatistics(FlowFrame&) -> void;
+  auto buildLevels(FlowFrame&, int) -> void;
+  auto computeDerived(FlowFrame&, int, int) -> void;
+
+  std::shared_ptr<FlowFrame> currentFrame;
+  std::shared_ptr<FlowFrame> nextFrame;
+  std::uint64_t generation;
 
   int dimension;
   int frame;
+  int prefetchDepth;
+  // Read by the prefetch thread.
+  std::atomic<int> prefetchLevel;
+  std::atomic<int> threadCount;
+  bool reversed;
+  VolumeEncoding encoding;
+  VolumeLayout layout;
+  std::shared_ptr<FrameProvider> provider;
+  int source;
+  int sourceCount;
+  int generator;
+  // Declared last so the producer thread stops before anything it uses.
+  std::unique_ptr<FramePrefetcher> prefetcher;
 };
 
 #endif  // CODE_FLOWDATASOURCE_H
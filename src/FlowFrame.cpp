@@ -0,0 +1,157 @@
+//
+// Created by Joshua Lowe on 17.10.26.
+//
+
+#include "FlowFrame.h"
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+FlowFrame::FlowFrame(FrameKey frameKey, std::uint64_t frameGeneration)
+    : key(frameKey),
+      generation(frameGeneration),
+      recorded(false),
+      volume(frameKey.dimension),
+      statistics(StatisticsAccumulator().finish()),
+      sliceMoments(frameKey.dimension),
+      tileRanges(frameKey.dimension),
+      resident(frameKey.dimension, false),
+      residentCount(0),
+      magnitudeResident(frameKey.dimension, false) {}
+
+FlowFrame::FlowFrame(FrameKey frameKey, std::uint64_t frameGeneration,
+                     VolumeStorage data)
+    : key(frameKey),
+      generation(frameGeneration),
+      recorded(true),
+      volume(std::move(data)),
+      statistics(StatisticsAccumulator().finish()),
+      sliceMoments(frameKey.dimension),
+      tileRanges(frameKey.dimension),
+      resident(frameKey.dimension, false),
+      residentCount(0),
+      magnitudeResident(frameKey.dimension, false) {}
+
+auto FlowFrame::isResident(int z0, int z1) const -> bool {
+  std::lock_guard<std::mutex> guard(lock);
+  for (int iz = z0; iz < z1; iz++) {
+    if (!resident[iz]) return false;
+  }
+  return true;
+}
+
+auto FlowFrame::isComplete() const -> bool {
+  std::lock_guard<std::mutex> guard(lock);
+  return residentCount == key.dimension;
+}
+
+auto FlowFrame::markResident(int z0, int z1) -> bool {
+  std::lock_guard<std::mutex> guard(lock);
+  for (int iz = z0; iz < z1; iz++) {
+    if (!resident[iz]) residentCount++;
+    resident[iz] = true;
+  }
+  return residentCount == key.dimension;
+}
+
+auto FlowFrame::getSliceStatistics(int z0, int z1) const -> VolumeStatistics {
+  StatisticsAccumulator moments;
+  for (int iz = z0; iz < z1; iz++) moments.merge(sliceMoments[iz]);
+  return moments.finish();
+}
+
+auto FlowFrame::getLevelSliceStatistics(int level, int iz) const
+    -> VolumeStatistics {
+  // Follows the taps of the slice with a nonzero weight back through the
+  // finer levels to the level 0 slices [z0, z1] it was filtered from.
+  int z0 = iz, z1 = iz;
+  for (int l = level; l > 0; l--) {
+    std::vector<PyramidTaps> taps =
+        pyramidTaps(getLevelDimension(l - 1), getLevelDimension(l));
+    int low = z0, high = z1;
+    z0 = taps[low].index[taps[low].weight[0] == 0 ? 1 : 0];
+    z1 = taps[high].index[taps[high].weight[3] == 0 ? 2 : 3];
+  }
+  return getSliceStatistics(z0, z1 + 1);
+}
+
+auto FlowFrame::getLevelCount() const -> int {
+  std::lock_guard<std::mutex> guard(lock);
+  return 1 + (int)levels.size();
+}
+
+auto FlowFrame::getLevel(int level) const -> const VolumeStorage& {
+  std::lock_guard<std::mutex> guard(lock);
+  return *levels[level - 1];
+}
+
+auto FlowFrame::addLevel(std::unique_ptr<VolumeStorage> level) -> void {
+  std::lock_guard<std::mutex> guard(lock);
+  levels.push_back(std::move(level));
+}
+
+auto FlowFrame::getLevelIndex(int i, int level) const -> int {
+  int last = getLevelDimension(level) - 1;
+  if (level == 0 || key.dimension < 2) return i;
+  return std::min(
+      (int)std::lround((double)i * last / (key.dimension - 1)), last);
+}
+
+auto volumeLayoutName(VolumeLayout layout) -> const char* {
+  switch (layout) {
+    case BrickedLayout:
+      return "bricked";
+    case MortonLayout:
+      return "Z-order";
+    default:
+      return "linear";
+  }
+}
+
+auto FlowFrame::convert() -> void {
+  if (key.layout != LinearLayout) {
+    if (key.layout == BrickedLayout) {
+      encoded.emplace<BrickedVolume>(volume);
+    } else {
+      encoded.emplace<MortonVolume>(volume);
+    }
+    volume = VolumeStorage();
+    return;
+  }
+  switch (key.encoding) {
+    case Half:
+      encoded.emplace<HalfVolume>(volume);
+      break;
+    case Quantized16:
+      encoded.emplace<QuantizedVolume<std::uint16_t>>(volume);
+      break;
+    case Quantized8:
+      encoded.emplace<QuantizedVolume<std::uint8_t>>(volume);
+      break;
+    default:
+      return;
+  }
+  volume = VolumeStorage();
+}
+
+auto FlowFrame::requireComponent(int c, int z0, int z1) const -> void {
+  // Encoded storage derives the magnitude while decoding.
+  if (c != 3 || isEncoded()) return;
+  std::lock_guard<std::mutex> guard(lock);
+  // The magnitude plane is the only part of the volume that is written
+  // after publishing; the lock orders it for every reader.
+  auto& storage = const_cast<VolumeStorage&>(volume);
+  storage.allocateMagnitude();
+  int begin = z0;
+  while (begin < z1) {
+    if (magnitudeResident[begin]) {
+      begin++;
+      continue;
+    }
+    int end = begin;
+    while (end < z1 && !magnitudeResident[end]) magnitudeResident[end++] = true;
+    storage.computeMagnitude(begin, end);
+    begin = end;
+  }
+}
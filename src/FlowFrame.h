@@ -0,0 +1,203 @@
+//
+// Created by Joshua Lowe on 17.10.26.
+//
+
+#ifndef CODE_FLOWFRAME_H
+#define CODE_FLOWFRAME_H
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include "BrickedVolume.h"
+#include "DerivedFields.h"
+#include "EncodedVolume.h"
+#include "MinMaxIndex.h"
+#include "MortonVolume.h"
+#include "VolumePyramid.h"
+#include "VolumeStatistics.h"
+#include "VolumeStorage.h"
+
+// Arrangement of the voxels in memory. Linear frames may hold any
+// VolumeEncoding, the other layouts store float32.
+enum VolumeLayout { LinearLayout, BrickedLayout, MortonLayout };
+
+auto volumeLayoutName(VolumeLayout) -> const char*;
+
+// Everything that determines the contents of a generated frame. Two frames
+// with equal keys hold identical data. Source 0 is the procedural field
+// of the generator (see FieldGenerators.h), every FrameProvider attached to
+// a FlowDataSource gets its own id.
+struct FrameKey {
+  int frame;
+  int dimension;
+  bool reversed;
+  int source;
+  VolumeEncoding encoding;
+  VolumeLayout layout;
+  int generator;
+
+  auto operator==(const FrameKey& other) const -> bool {
+    return frame == other.frame && dimension == other.dimension &&
+           reversed == other.reversed && source == other.source &&
+           encoding == other.encoding && layout == other.layout &&
+           generator == other.generator;
+  }
+  // Whether consumers read the generated float planes directly. Other
+  // frames are converted once they are complete.
+  auto isLinearFloat() const -> bool {
+    return encoding == Float32 && layout == LinearLayout;
+  }
+  auto operator!=(const FrameKey& other) const -> bool {
+    return !(*this == other);
+  }
+};
+
+// Snapshot of one generated frame. FlowDataSource shares it read-only
+// through std::shared_ptr<const FlowFrame>, so every mapper of a tick reads
+// the same data and a snapshot stays valid while a consumer still holds it.
+//
+// A frame may be only partially resident: FlowDataSource generates the
+// z-slices a consumer asks for and fills in further slices on later
+// requests. Slices never change once they are resident, so a consumer may
+// read every slice it requested without further synchronisation.
+//
+// Frames whose key asks for another encoding or layout are generated
+// completely, converted and then drop their float planes. Consumers read
+// the voxels through visit(), which hands the frame's storage to a generic
+// callable; every storage type offers dimension(), value(), vector() and
+// cell().
+//
+// A complete frame may also carry a mip pyramid for consumers that trade
+// detail for speed, e.g. during playback. Level l halves the dimension l
+// times (see VolumePyramid.h) and is stored as linear float32 whatever the
+// frame itself uses; level 0 is the frame. Levels are built coarser and
+// coarser by FlowDataSource::acquireLevel() and never change afterwards.
+class FlowFrame {
+ public:
+  // Coarser levels than this are not worth building.
+  static constexpr int kMinLevelDimension = 8;
+
+  FlowFrame(FrameKey, std::uint64_t);
+  // Frame around recorded data. Its slices still become resident one by one
+  // as consumers ask for them, which is when their moments are taken.
+  FlowFrame(FrameKey, std::uint64_t, VolumeStorage);
+
+  auto getKey() const -> const FrameKey& { return key; }
+  // Monotonic counter assigned by the producing FlowDataSource. Consumers
+  // remember it to tell whether their derived data is stale.
+  auto getGeneration() const -> std::uint64_t { return generation; }
+  auto getDimension() const -> int { return key.dimension; }
+  // The float planes. Empty once the frame is converted, use visit().
+  auto getVolume() const -> const VolumeStorage& { return volume; }
+  auto isEncoded() const -> bool { return encoded.index() != 0; }
+
+  template <typename F>
+  auto visit(F&& f) const -> decltype(auto) {
+    return std::visit(
+        [&](const auto& storage) -> decltype(auto) {
+          using Storage = std::decay_t<decltype(storage)>;
+          if constexpr (std::is_same_v<Storage, std::monostate>) {
+            return std::forward<F>(f)(volume);
+          } else {
+            return std::forward<F>(f)(storage);
+          }
+        },
+        encoded);
+  }
+  // Like visit(), for level 0 or a level below getLevelCount().
+  template <typename F>
+  auto visitLevel(int level, F&& f) const -> decltype(auto) {
+    if (level == 0) return visit(std::forward<F>(f));
+    return std::forward<F>(f)(getLevel(level));
+  }
+  // Number of levels built so far, counting level 0.
+  auto getLevelCount() const -> int;
+  auto getLevel(int) const -> const VolumeStorage&;
+  auto getLevelDimension(int level) const -> int {
+    return pyramidDimension(key.dimension, level);
+  }
+  // Index along an axis of the given level closest to index i of level 0.
+  // Levels span the same box as the frame, so positions scale by
+  // (level dimension - 1) / (dimension - 1).
+  auto getLevelIndex(int, int) const -> int;
+  auto isResident(int, int) const -> bool;
+  auto isComplete() const -> bool;
+  auto isRecorded() const -> bool { return recorded; }
+
+  // Statistics of the whole frame. They are computed when the last slice
+  // becomes resident and are empty before that.
+  auto getStatistics() const -> const VolumeStatistics& { return statistics; }
+  // Min, max, mean and variance of the resident slices [z0, z1), merged
+  // from the per-slice moments taken during generation.
+  auto getSliceStatistics(int, int) const -> VolumeStatistics;
+  // Statistics of slice iz of a pyramid level, merged from the moments of
+  // the level 0 slices under its filter footprint. The filtered components
+  // stay inside the ranges; the magnitude may drop below its minimum.
+  auto getLevelSliceStatistics(int, int) const -> VolumeStatistics;
+
+  // Tile ranges of the resident slices, taken during generation like the
+  // slice moments. They describe level 0 only.
+  auto getTileRanges() const -> const MinMaxIndex& { return tileRanges; }
+  // Whether level 0 reads exactly the values the tile ranges were taken
+  // from, i.e. the frame is not stored in a lossy encoding.
+  auto hasExactTileRanges() const -> bool {
+    return key.encoding == Float32 || key.layout != LinearLayout;
+  }
+
+  // Materialises the magnitude of the slices [z0, z1) the first time
+  // component 3 is asked for. Call it before reading a component in a loop;
+  // it is thread-safe and free once the slices are done.
+  auto requireComponent(int, int, int) const -> void;
+  auto requireComponent(int c) const -> void {
+    requireComponent(c, 0, key.dimension);
+  }
+
+  // Vortex diagnostics of the slices FlowDataSource::acquireDerived() was
+  // asked for. They are derived from level 0 only.
+  auto getDerived() const -> const DerivedVolume& { return derived; }
+  // Like visitLevel() for component c: derived components hand over
+  // getDerived() instead, which only offers dimension() and value().
+  template <typename F>
+  auto visitComponent(int level, int c, F&& f) const -> decltype(auto) {
+    if (isDerivedComponent(c)) return std::forward<F>(f)(derived);
+    return visitLevel(level, std::forward<F>(f));
+  }
+
+ private:
+  friend class FlowDataSource;
+
+  auto markResident(int, int) -> bool;
+  // Replaces the float planes by the encoding and layout of the key.
+  auto convert() -> void;
+  auto addLevel(std::unique_ptr<VolumeStorage>) -> void;
+
+  FrameKey key;
+  // Assigned by FlowDataSource when the frame becomes current, which for a
+  // prefetched frame is later than its construction.
+  std::uint64_t generation;
+  bool recorded;
+  VolumeStorage volume;
+  std::variant<std::monostate, HalfVolume, QuantizedVolume<std::uint16_t>,
+               QuantizedVolume<std::uint8_t>, BrickedVolume, MortonVolume>
+      encoded;
+  VolumeStatistics statistics;
+  std::vector<StatisticsAccumulator> sliceMoments;
+  MinMaxIndex tileRanges;
+  std::vector<char> resident;
+  int residentCount;
+  // Level l is levels[l - 1].
+  std::vector<std::unique_ptr<VolumeStorage>> levels;
+  DerivedVolume derived;
+
+  // Guards the residency, magnitude, pyramid and derived field bookkeeping,
+  // the only state that changes after the frame was handed out.
+  mutable std::mutex lock;
+  mutable std::vector<char> magnitudeResident;
+};
+
+#endif  // CODE_FLOWFRAME_H
@@ -0,0 +1,83 @@
+//
+// Created by Joshua Lowe on 17.10.26.
+//
+
+#include "FramePrefetcher.h"
+
+#include <algorithm>
+
+FramePrefetcher::FramePrefetcher(Producer produce)
+    : producer(std::move(produce)),
+      inProgress{},
+      busy(false),
+      stopping(false),
+      worker(&FramePrefetcher::run, this) {}
+
+FramePrefetcher::~FramePrefetcher() {
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    stopping = true;
+    pending.clear();
+  }
+  wake.notify_all();
+  worker.join();
+}
+
+auto FramePrefetcher::isWanted(const FrameKey& key) -> bool {
+  return std::find(wanted.begin(), wanted.end(), key) != wanted.end();
+}
+
+auto FramePrefetcher::request(const std::vector<FrameKey>& keys) -> void {
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    wanted = keys;
+    ready.erase(std::remove_if(ready.begin(), ready.end(),
+                               [&](const std::shared_ptr<FlowFrame>& frame) {
+                                 return !isWanted(frame->getKey());
+                               }),
+                ready.end());
+    pending.clear();
+    for (const FrameKey& key : keys) {
+      bool done = std::any_of(ready.begin(), ready.end(),
+                              [&](const std::shared_ptr<FlowFrame>& frame) {
+                                return frame->getKey() == key;
+                              });
+      if (!done && !(busy && inProgress == key)) pending.push_back(key);
+    }
+  }
+  wake.notify_one();
+}
+
+auto FramePrefetcher::take(const FrameKey& key)
+    -> std::shared_ptr<FlowFrame> {
+  std::unique_lock<std::mutex> guard(lock);
+  // Waiting for a frame that is half done beats generating it twice.
+  finished.wait(guard, [&] { return !(busy && inProgress == key); });
+  auto it = std::find_if(ready.begin(), ready.end(),
+                         [&](const std::shared_ptr<FlowFrame>& frame) {
+                           return frame->getKey() == key;
+                         });
+  if (it == ready.end()) return nullptr;
+  std::shared_ptr<FlowFrame> frame = std::move(*it);
+  ready.erase(it);
+  return frame;
+}
+
+auto FramePrefetcher::run() -> void {
+  std::unique_lock<std::mutex> guard(lock);
+  while (true) {
+    wake.wait(guard, [&] { return stopping || !pending.empty(); });
+    if (stopping) return;
+    inProgress = pending.front();
+    pending.pop_front();
+    busy = true;
+
+    guard.unlock();
+    std::shared_ptr<FlowFrame> frame = producer(inProgress);
+    guard.lock();
+
+    busy = false;
+    if (isWanted(frame->getKey())) ready.push_back(std::move(frame));
+    finished.notify_all();
+  }
+}
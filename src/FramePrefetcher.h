@@ -0,0 +1,54 @@
+//
+// Created by Joshua Lowe on 17.10.26.
+//
+
+#ifndef CODE_FRAMEPREFETCHER_H
+#define CODE_FRAMEPREFETCHER_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "FlowFrame.h"
+
+// Producer thread that builds upcoming frames into back buffers while the
+// current frame is mapped and rendered. The owner announces which keys it
+// will need next and takes a finished frame out when its tick comes.
+class FramePrefetcher {
+ public:
+  using Producer = std::function<std::shared_ptr<FlowFrame>(const FrameKey&)>;
+
+  explicit FramePrefetcher(Producer);
+  ~FramePrefetcher();
+  FramePrefetcher(const FramePrefetcher&) = delete;
+  auto operator=(const FramePrefetcher&) -> FramePrefetcher& = delete;
+
+  // Replaces the wanted keys, in the order they should be produced. Back
+  // buffers holding other keys are dropped.
+  auto request(const std::vector<FrameKey>&) -> void;
+  // Hands out the frame for the key if it is finished. If the producer is
+  // working on it right now this waits for it, otherwise returns nullptr.
+  auto take(const FrameKey&) -> std::shared_ptr<FlowFrame>;
+
+ private:
+  auto run() -> void;
+  auto isWanted(const FrameKey&) -> bool;
+
+  Producer producer;
+  std::mutex lock;
+  std::condition_variable wake;
+  std::condition_variable finished;
+  std::deque<FrameKey> pending;
+  std::vector<FrameKey> wanted;
+  std::vector<std::shared_ptr<FlowFrame>> ready;
+  FrameKey inProgress;
+  bool busy;
+  bool stopping;
+  std::thread worker;
+};
+
+#endif  // CODE_FRAMEPREFETCHER_H
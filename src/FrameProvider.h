@@ -0,0 +1,28 @@
+//
+// Created by Joshua Lowe on 17.10.26.
+//
+
+#ifndef CODE_FRAMEPROVIDER_H
+#define CODE_FRAMEPROVIDER_H
+
+#include "VolumeStorage.h"
+
+// Source of recorded frames that FlowDataSource replays instead of
+// generating the tornado. Frames are addressed by their index in the
+// recording; FlowDataSource wraps its frame counter around getFrameCount().
+// loadFrame() may be called from the prefetch thread while the main thread
+// uses the provider, so implementations have to be thread-safe.
+class FrameProvider {
+ public:
+  virtual ~FrameProvider() = default;
+
+  virtual auto getDimension() const -> int = 0;
+  virtual auto getFrameCount() const -> int = 0;
+  // Returns the volume of the given frame, preferably wrapping the
+  // provider's memory instead of copying it (see VolumeStorage::wrap).
+  virtual auto loadFrame(int) -> VolumeStorage = 0;
+  // Tells the provider which frame playback is at, so it can read ahead.
+  virtual auto seek(int) -> void {}
+};
+
+#endif  // CODE_FRAMEPROVIDER_H
@@ -4,14 +4,23 @@
 
 #include "HorizontalSliceToContourLineMapper.h"
 
+#include <algorithm>
 #include <cmath>
-#include <thread>
 #include <utility>
 
 #include "FlowDataSource.h"
+#include "TaskScheduler.h"
+
+namespace {
+
+// Building a span index costs about as much as a dozen sweeps of the
+// slice, so it is only built once a slice was swept this often.
+constexpr int kSweepsBeforeIndex = 8;
+
+}  // namespace
 
 HorizontalSliceToContourLineMapper::HorizontalSliceToContourLineMapper()
-    : component(0), maxSteps(31), maxThreads(5) {}
+    : component(0), level(0), maxSteps(31) {}
 
 HorizontalSliceToContourLineMapper::HorizontalSliceToContourLineMapper(
     FlowDataSource* source)
@@ -78,7 +87,11 @@ auto HorizontalSliceToContourLineMapper::power2(unsigned int in) -> int {
   return result;
 }
 
-auto HorizontalSliceToContourLineMapper::helperFunction(int iz, float c, int ID)
+template <typename Volume>
+auto HorizontalSliceToContourLineMapper::traceCell(const Volume& volume,
+                                                   int iz, int j, int i,
+                                                   float c,
+                                                   QVector<QVector3D>& out)
     -> void {
   Point p1, p2, p3, p4;
   p1 = Point();
@@ -102,112 +115,176 @@ auto HorizontalSliceToContourLineMapper::helperFunction(int iz, float c, int ID)
     }
   };
 
-  for (int i = 0; i < maxSteps; i++) {
-    if (i % (maxThreads - 1) != ID) continue;
+  p1.setLocation(j, i);
+  p2.setLocation(j + 1, i);
+  p3.setLocation(j + 1, i + 1);
+  p4.setLocation(j, i + 1);
+
+  p1.value = volume.value(p1.x, p1.y, iz, component);
+  p2.value = volume.value(p2.x, p2.y, iz, component);
+  p3.value = volume.value(p3.x, p3.y, iz, component);
+  p4.value = volume.value(p4.x, p4.y, iz, component);
+
+  bitMap = 0x0;
+  bitMap = (p1.value > c) ? bitMap | 0x01 : bitMap;
+  bitMap = (p2.value > c) ? bitMap | 0x02 : bitMap;
+  bitMap = (p3.value > c) ? bitMap | 0x04 : bitMap;
+  bitMap = (p4.value > c) ? bitMap | 0x08 : bitMap;
+
+  std::tuple<float, float> iso1, iso2;
+
+  if (bitMap == 0x5 || bitMap == 0xA) {
+    std::tuple<float, float> iso3, iso4;
+
+    iso1 = interpolation(getPoint(rotationLeft(bitMap & 0x3)),
+                         getPoint(bitMap & 0x3), c);
+    iso2 = interpolation(getPoint(rotationRight(bitMap & 0x3)),
+                         getPoint(bitMap & 0x3), c);
+    iso3 = interpolation(getPoint(rotationLeft(bitMap & 0xC)),
+                         getPoint(bitMap & 0xC), c);
+    iso4 = interpolation(getPoint(rotationRight(bitMap & 0xC)),
+                         getPoint(bitMap & 0xC), c);
+    float asymptote = ((p4.value * p2.value) - (p3.value * p1.value)) /
+                      (p1.value - p3.value - p4.value + p2.value);
+    if (asymptote < c) {
+      out.push_back(QVector3D(std::get<0>(iso1), std::get<1>(iso1), 0));
+      out.push_back(QVector3D(std::get<0>(iso2), std::get<1>(iso2), 0));
+      out.push_back(QVector3D(std::get<0>(iso3), std::get<1>(iso3), 0));
+      out.push_back(QVector3D(std::get<0>(iso4), std::get<1>(iso4), 0));
+    } else {
+      out.push_back(QVector3D(std::get<0>(iso2), std::get<1>(iso2), 0));
+      out.push_back(QVector3D(std::get<0>(iso3), std::get<1>(iso3), 0));
+      out.push_back(QVector3D(std::get<0>(iso1), std::get<1>(iso1), 0));
+      out.push_back(QVector3D(std::get<0>(iso4), std::get<1>(iso4), 0));
+    }
+    return;
+  }
+
+  switch (countSetBits(bitMap)) {
+    case 1:
+      iso1 = interpolation(getPoint(rotationLeft(bitMap)), getPoint(bitMap),
+                           c);
+      iso2 = interpolation(getPoint(rotationRight(bitMap)), getPoint(bitMap),
+                           c);
+      break;
+    case 2:
+      iso1 = interpolation(getPoint(rotationLeft(bitMap) & ~bitMap),
+                           getPoint(rotationLeft(bitMap) & bitMap), c);
+      iso2 = interpolation(getPoint(rotationRight(bitMap) & ~bitMap),
+                           getPoint(rotationRight(bitMap) & bitMap), c);
+      break;
+    case 3:
+      iso1 = interpolation(getPoint(bitMap ^ 0xF),
+                           getPoint(rotationLeft(bitMap ^ 0xF)), c);
+      iso2 = interpolation(getPoint(bitMap ^ 0xF),
+                           getPoint(rotationRight(bitMap ^ 0xF)), c);
+      break;
+    default:
+      return;
+  }
+  out.push_back(QVector3D(std::get<0>(iso1), std::get<1>(iso1), 0));
+  out.push_back(QVector3D(std::get<0>(iso2), std::get<1>(iso2), 0));
+}
+
+template <typename Volume>
+auto HorizontalSliceToContourLineMapper::helperFunction(
+    const Volume& volume, int iz, float c, const MinMaxIndex* index, int i0,
+    int i1) -> void {
+  constexpr int kTile = MinMaxIndex::kTile;
+  QVector<QVector3D> segments;
+  for (int i = i0; i < i1; i++) {
     for (int j = 0; j < maxSteps; j++) {
-      p1.setLocation(j, i);
-      p2.setLocation(j + 1, i);
-      p3.setLocation(j + 1, i + 1);
-      p4.setLocation(j, i + 1);
-
-      p1.value = dataSource->getDataValue(p1.x, p1.y, iz, component);
-      p2.value = dataSource->getDataValue(p2.x, p2.y, iz, component);
-      p3.value = dataSource->getDataValue(p3.x, p3.y, iz, component);
-      p4.value = dataSource->getDataValue(p4.x, p4.y, iz, component);
-
-      bitMap = 0x0;
-      bitMap = (p1.value > c) ? bitMap | 0x01 : bitMap;
-      bitMap = (p2.value > c) ? bitMap | 0x02 : bitMap;
-      bitMap = (p3.value > c) ? bitMap | 0x04 : bitMap;
-      bitMap = (p4.value > c) ? bitMap | 0x08 : bitMap;
-
-      std::tuple<float, float> iso1, iso2;
-
-      if (bitMap == 0x5 || bitMap == 0xA) {
-        std::tuple<float, float> iso3, iso4;
-
-        iso1 = interpolation(getPoint(rotationLeft(bitMap & 0x3)),
-                             getPoint(bitMap & 0x3), c);
-        iso2 = interpolation(getPoint(rotationRight(bitMap & 0x3)),
-                             getPoint(bitMap & 0x3), c);
-        iso3 = interpolation(getPoint(rotationLeft(bitMap & 0xC)),
-                             getPoint(bitMap & 0xC), c);
-        iso4 = interpolation(getPoint(rotationRight(bitMap & 0xC)),
-                             getPoint(bitMap & 0xC), c);
-        float asymptote = ((p4.value * p2.value) - (p3.value * p1.value)) /
-                          (p1.value - p3.value - p4.value + p2.value);
-        {
-          std::lock_guard<std::mutex> lock(pointslock);
-          if (asymptote < c) {
-            points.push_back(
-                QVector3D(std::get<0>(iso1), std::get<1>(iso1), 0));
-            points.push_back(
-                QVector3D(std::get<0>(iso2), std::get<1>(iso2), 0));
-            points.push_back(
-                QVector3D(std::get<0>(iso3), std::get<1>(iso3), 0));
-            points.push_back(
-                QVector3D(std::get<0>(iso4), std::get<1>(iso4), 0));
-          } else {
-            points.push_back(
-                QVector3D(std::get<0>(iso2), std::get<1>(iso2), 0));
-            points.push_back(
-                QVector3D(std::get<0>(iso3), std::get<1>(iso3), 0));
-            points.push_back(
-                QVector3D(std::get<0>(iso1), std::get<1>(iso1), 0));
-            points.push_back(
-                QVector3D(std::get<0>(iso4), std::get<1>(iso4), 0));
-          }
-        }
+      // Skip whole tiles the isoline cannot cross.
+      if (index && j % kTile == 0 &&
+          !index->mayCross(iz, component, j / kTile, i / kTile, c)) {
+        j += kTile - 1;
         continue;
       }
+      traceCell(volume, iz, j, i, c, segments);
+    }
+  }
+  std::lock_guard<std::mutex> lock(pointslock);
+  points.append(segments);
+}
 
-      switch (countSetBits(bitMap)) {
-        case 1:
-          iso1 = interpolation(getPoint(rotationLeft(bitMap)), getPoint(bitMap),
-                               c);
-          iso2 = interpolation(getPoint(rotationRight(bitMap)),
-                               getPoint(bitMap), c);
-          break;
-        case 2:
-          iso1 = interpolation(getPoint(rotationLeft(bitMap) & ~bitMap),
-                               getPoint(rotationLeft(bitMap) & bitMap), c);
-          iso2 = interpolation(getPoint(rotationRight(bitMap) & ~bitMap),
-                               getPoint(rotationRight(bitMap) & bitMap), c);
-          break;
-        case 3:
-          iso1 = interpolation(getPoint(bitMap ^ 0xF),
-                               getPoint(rotationLeft(bitMap ^ 0xF)), c);
-          iso2 = interpolation(getPoint(bitMap ^ 0xF),
-                               getPoint(rotationRight(bitMap ^ 0xF)), c);
-          break;
-        default:
-          continue;
-      }
-      {
-        std::lock_guard<std::mutex> lock(pointslock);
-        points.push_back(QVector3D(std::get<0>(iso1), std::get<1>(iso1), 0));
-        points.push_back(QVector3D(std::get<0>(iso2), std::get<1>(iso2), 0));
-      }
+template <typename Volume>
+auto HorizontalSliceToContourLineMapper::buildSpans(const Volume& volume,
+                                                    int iz) -> void {
+  int n = maxSteps + 1;
+  std::vector<float> values((std::size_t)n * n);
+  for (int i = 0; i < n; i++) {
+    for (int j = 0; j < n; j++) {
+      values[(std::size_t)i * n + j] = volume.value(j, i, iz, component);
+    }
+  }
+  std::size_t cells = (std::size_t)maxSteps * maxSteps;
+  std::vector<float> lo(cells), hi(cells);
+  for (int i = 0; i < maxSteps; i++) {
+    for (int j = 0; j < maxSteps; j++) {
+      const float* corner = values.data() + (std::size_t)i * n + j;
+      auto [min, max] =
+          std::minmax({corner[0], corner[1], corner[n], corner[n + 1]});
+      lo[(std::size_t)i * maxSteps + j] = min;
+      hi[(std::size_t)i * maxSteps + j] = max;
     }
   }
+  spans = std::make_unique<SpanSpaceIndex>(lo.data(), hi.data(), cells);
 }
 
 auto HorizontalSliceToContourLineMapper::mapSliceToContourLineSegments(int z,
                                                                        float c)
     -> QVector<QVector3D> {
   points.clear();
-  dataSource->createData();
-  std::vector<std::thread> threads;
-  for (int i = 0; i < (maxThreads - 1); i++) {
-    threads.emplace_back(&HorizontalSliceToContourLineMapper::helperFunction,
-                         this, z, c, i);
+  bool derived = isDerivedComponent(component);
+  frame = derived ? dataSource->acquireDerived(z, z + 1)
+                  : dataSource->acquireLevel(level, z, z + 1);
+  // Derived fields only exist at full resolution.
+  int l = derived ? 0 : std::min(level, frame->getLevelCount() - 1);
+  if (l == 0) frame->requireComponent(component, z, z + 1);
+  // The segments are normalised to the slice, so coarser levels span the
+  // same square with fewer cells.
+  maxSteps = frame->getLevelDimension(l) - 1;
+  int iz = frame->getLevelIndex(z, l);
+  // The tile ranges describe the float data of level 0.
+  const MinMaxIndex* index = nullptr;
+  if (l == 0 && !derived && frame->hasExactTileRanges()) {
+    index = &frame->getTileRanges();
   }
-  for (std::thread& thread : threads) {
-    thread.join();
+  // A slice contoured again and again, e.g. while an isovalue is dragged,
+  // gets a span index, after which every isovalue only costs the cells it
+  // crosses. Slices stepped through keep the sweep.
+  std::tuple<std::uint64_t, int, int, int> key = {frame->getGeneration(), iz,
+                                                  l, component};
+  if (key != spanKey) {
+    spanKey = key;
+    spans.reset();
+    spanUses = 0;
   }
+  spanUses++;
+  frame->visitComponent(l, component, [&](const auto& volume) {
+    if (spanUses > kSweepsBeforeIndex) {
+      if (!spans) buildSpans(volume, iz);
+      activeCells.clear();
+      spans->query(c, activeCells);
+      for (int cell : activeCells) {
+        traceCell(volume, iz, cell % maxSteps, cell / maxSteps, c, points);
+      }
+      return;
+    }
+    // One band of tiles per task, so a task skips or traces whole tiles.
+    parallelFor(maxSteps, MinMaxIndex::kTile, [&](int i0, int i1) {
+      helperFunction(volume, iz, c, index, i0, i1);
+    });
+  });
   return points;
 }
 
 auto HorizontalSliceToContourLineMapper::setWindComponent(int ic) -> void {
   component = ic;
 }
+
+auto HorizontalSliceToContourLineMapper::setLevel(int inLevel) -> void {
+  level = (inLevel < 0) ? 0 : inLevel;
+}
+
+auto HorizontalSliceToContourLineMapper::getLevel() -> int { return level; }
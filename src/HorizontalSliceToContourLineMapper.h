@@ -7,10 +7,14 @@
 
 #include <QVector3D>
 #include <QVector>
+#include <cstdint>
+#include <memory>
 #include <mutex>
 #include <tuple>
+#include <vector>
 
 #include "FlowDataSource.h"
+#include "SpanSpaceIndex.h"
 
 struct Point {
   void setLocation(int j, int i) {
@@ -29,24 +33,49 @@ class HorizontalSliceToContourLineMapper {
   virtual ~HorizontalSliceToContourLineMapper() = default;
 
   auto setMaxSteps() -> void;
+  // 0 - 3 for x, y, z and the magnitude, or a DerivedComponent.
   auto setWindComponent(int) -> void;
   auto getDimension() -> int;
   auto setDataSource(FlowDataSource*) -> void;
   auto mapSliceToContourLineSegments(int, float) -> QVector<QVector3D>;
+  // Pyramid level the contours are traced on (see FlowFrame).
+  auto setLevel(int) -> void;
+  auto getLevel() -> int;
 
  private:
-  auto helperFunction(int, float, int) -> void;
+  // Traces the cells of rows [i0, i1), reading the voxels through whatever
+  // storage the frame uses (see FlowFrame::visit). Tiles the index rules
+  // out are skipped; without an index every cell is read.
+  template <typename Volume>
+  auto helperFunction(const Volume&, int, float, const MinMaxIndex*, int i0,
+                      int i1) -> void;
+  // Appends the segments of the isoline through cell (j, i).
+  template <typename Volume>
+  auto traceCell(const Volume&, int, int, int, float, QVector<QVector3D>&)
+      -> void;
+  // Indexes the cell spans of the slice for the current component.
+  template <typename Volume>
+  auto buildSpans(const Volume&, int) -> void;
   auto interpolation(Point, Point, float) -> std::tuple<float, float>;
   auto countSetBits(unsigned int) -> int;
   static auto power2(unsigned int) -> int;
   static auto rotationLeft(int) -> int;
   static auto rotationRight(int) -> int;
 
-  unsigned int maxThreads;
   QVector<QVector3D> points;
   std::mutex pointslock;
   int component;
+  int level;
+  // Cells per row of the slice being traced.
   int maxSteps;
+  std::shared_ptr<const FlowFrame> frame;
+  // Span index of the slice last contoured, identified by frame
+  // generation, slice, level and component, and how often that slice was
+  // asked for.
+  std::unique_ptr<SpanSpaceIndex> spans;
+  std::tuple<std::uint64_t, int, int, int> spanKey;
+  int spanUses = 0;
+  std::vector<int> activeCells;
   FlowDataSource* dataSource;
 };
 
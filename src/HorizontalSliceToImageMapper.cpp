@@ -4,13 +4,16 @@
 
 #include "HorizontalSliceToImageMapper.h"
 
+#include <algorithm>
+#include <cmath>
 #include <fstream>
 #include <iostream>
+#include <tuple>
 
 #include "FlowDataSource.h"
 
 HorizontalSliceToImageMapper::HorizontalSliceToImageMapper()
-    : component(0), mode(Default), isActive(true) {}
+    : isActive(true), mode(Default), component(0), level(0) {}
 
 HorizontalSliceToImageMapper::HorizontalSliceToImageMapper(
     FlowDataSource* source)
@@ -43,22 +46,36 @@ auto HorizontalSliceToImageMapper::getDimension() -> int {
   return dataSource->getDimension();
 }
 
+auto HorizontalSliceToImageMapper::setLevel(int inLevel) -> void {
+  level = (inLevel < 0) ? 0 : inLevel;
+}
+
+auto HorizontalSliceToImageMapper::getLevel() -> int { return level; }
+
 auto HorizontalSliceToImageMapper::mapSliceToImage(int iz) -> QImage {
-  dataSource->createData();
-  int dimension = dataSource->getDimension();
-  float xc;
+  bool derived = isDerivedComponent(component);
+  auto frame = derived ? dataSource->acquireDerived(iz, iz + 1)
+                       : dataSource->acquireLevel(level, iz, iz + 1);
+  // Derived fields only exist at full resolution.
+  int l = derived ? 0 : std::min(level, frame->getLevelCount() - 1);
+  if (l == 0) frame->requireComponent(component, iz, iz + 1);
+  int z = frame->getLevelIndex(iz, l);
+  int dimension = frame->getLevelDimension(l);
   QImage image = QImage(dimension, dimension, QImage::Format_RGBA64);
-  for (int i = 0; i < dimension; i++) {
-    for (int j = 0; j < dimension; j++) {
-      xc = dataSource->getDataValue(j, i, iz, component);
-      if (xc >= 0) {
-        image.setPixelColor(j, i, QColor((int)(xc * 3 * 255), 0, 0));
-      } else {
-        xc *= -1;
-        image.setPixelColor(j, i, QColor(0, 0, (int)(xc * 3 * 255)));
+  frame->visitComponent(l, component, [&](const auto& volume) {
+    float xc;
+    for (int i = 0; i < dimension; i++) {
+      for (int j = 0; j < dimension; j++) {
+        xc = volume.value(j, i, z, component);
+        if (xc >= 0) {
+          image.setPixelColor(j, i, QColor((int)(xc * 3 * 255), 0, 0));
+        } else {
+          xc *= -1;
+          image.setPixelColor(j, i, QColor(0, 0, (int)(xc * 3 * 255)));
+        }
       }
     }
-  }
+  });
   return image;
 }
 
@@ -90,24 +107,46 @@ auto HorizontalSliceToImageMapper::mapSliceToImageHCL(int iz) -> QImage {
     count = (count + 1) % 3;
   }
   input.close();
-  dataSource->createData();
-  int dimension = dataSource->getDimension();
-  float x, xc, max, min;
-  // max =
-  //     std::max(dataSource->getMaxValue(component),
-  //     dataSource->getMaxBetrag());
-  // min = dataSource->getMinValue(component);
-  max = 0.4;
-  min = -0.4;
+  bool derived = isDerivedComponent(component);
+  auto frame = derived ? dataSource->acquireDerived(iz, iz + 1)
+                       : dataSource->acquireLevel(level, iz, iz + 1);
+  int l = derived ? 0 : std::min(level, frame->getLevelCount() - 1);
+  if (l == 0) frame->requireComponent(component, iz, iz + 1);
+  int z = frame->getLevelIndex(iz, l);
+  int dimension = frame->getLevelDimension(l);
+  float max, min;
+  // Only this slice is generated, so the colormap spans the range of the
+  // slice, taken from the moments recorded during generation. Signed
+  // components keep zero in the middle of the diverging map.
+  if (derived) {
+    std::tie(min, max) = frame->getDerived().getSliceRange(z, component);
+  } else {
+    ComponentStatistics range =
+        frame->getLevelSliceStatistics(l, z).components[component];
+    min = range.min;
+    max = range.max;
+  }
+  if (isSignedComponent(component)) {
+    max = std::max(std::fabs(min), std::fabs(max));
+    min = -max;
+  }
+  if (max <= min) max = min + 1;
   QImage image = QImage(dimension, dimension, QImage::Format_RGBA64);
-  for (int i = 0; i < dimension; i++) {
-    for (int j = 0; j < dimension; j++) {
-      x = dataSource->getDataValue(j, i, iz, component);
-      xc = mapToRange(x, min, max, 0, colormap.size() - 1);
-
-      image.setPixelColor(j, i, colormap.at((int)round(xc)));
+  // Encoded frames may decode a rounding step outside the range taken from
+  // the float data, hence the clamp.
+  int last = colormap.size() - 1;
+  frame->visitComponent(l, component, [&](const auto& volume) {
+    float x, xc;
+    for (int i = 0; i < dimension; i++) {
+      for (int j = 0; j < dimension; j++) {
+        x = volume.value(j, i, z, component);
+        xc = mapToRange(x, min, max, 0, last);
+
+        image.setPixelColor(j, i,
+                            colormap.at(std::clamp((int)round(xc), 0, last)));
+      }
     }
-  }
+  });
   return image;
 }
 
@@ -142,18 +181,7 @@ auto HorizontalSliceToImageMapper::createImage(int iz) -> QImage {
 }
 
 auto HorizontalSliceToImageMapper::getWindComponent() -> QString {
-  switch (component) {
-    case 0:
-      return "X";
-    case 1:
-      return "Y";
-    case 2:
-      return "Z";
-    case 3:
-      return "Betrag";
-    default:
-      return {};
-  }
+  return componentName(component);
 }
 
 auto HorizontalSliceToImageMapper::getMode() -> Mode { return mode; }
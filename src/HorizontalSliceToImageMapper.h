@@ -21,6 +21,7 @@ class HorizontalSliceToImageMapper {
 
   auto getMode() -> Mode;
   auto getWindComponent() -> QString;
+  // 0 - 3 for x, y, z and the magnitude, or a DerivedComponent.
   auto setWindComponent(int) -> void;
   auto setDataSource(FlowDataSource*) -> void;
   auto getDimension() -> int;
@@ -32,12 +33,17 @@ class HorizontalSliceToImageMapper {
   auto setMode(Mode) -> void;
   auto toggleHCL(bool) -> void;
   auto isHCL() -> bool;
+  // Pyramid level the slices are mapped from (see FlowFrame); images of
+  // coarser levels have fewer pixels.
+  auto setLevel(int) -> void;
+  auto getLevel() -> int;
 
  private:
   auto mapToRange(float, float, float, int, int) -> float;
   bool isActive;
   Mode mode;
   int component;
+  int level;
   QString pathToSource;
   FlowDataSource* dataSource;
 };
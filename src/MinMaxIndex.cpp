@@ -0,0 +1,135 @@
+//
+// Created by Joshua Lowe on 17.10.26.
+//
+
+#include "MinMaxIndex.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace {
+
+// Columns per block of the row sweep.
+constexpr int kLanes = 16;
+
+// Relative widening of the magnitude ranges. Evaluations of
+// sqrt(x * x + y * y + z * z) with and without contracted multiply-adds
+// differ by a few ULP, well within 8.
+constexpr float kMagnitudeSlack = 4 * std::numeric_limits<float>::epsilon();
+
+}  // namespace
+
+MinMaxIndex::MinMaxIndex(int dimension)
+    : dim(dimension),
+      tiles((std::max(dimension - 1, 0) + kTile - 1) / kTile),
+      bounds(2 * (std::size_t)dimension * kComponents * tiles * tiles) {}
+
+auto MinMaxIndex::build(const VolumeStorage& volume, int iz) -> void {
+  if (tiles == 0) return;
+  std::size_t plane = (std::size_t)tiles * tiles;
+  float* out = bounds.data() + 2 * (std::size_t)iz * kComponents * plane;
+
+  // The ranges of every column over the voxel rows of the current tile row
+  // come first; they are folded into the tiles once that row of tiles is
+  // complete. The magnitude is ranged by its square. The contours read it
+  // from the magnitude plane or derive it in the storage of the frame, each
+  // compiled with its own contraction of the multiply-adds, so the roots of
+  // the bounds are widened to cover every rounding of it.
+  std::size_t stride = dim;
+  std::vector<float> columns(2 * kComponents * stride);
+  float* lo = columns.data();
+  float* hi = lo + kComponents * stride;
+  auto fold = [&](int ty) {
+    for (int c = 0; c < kComponents; c++) {
+      for (int tx = 0; tx < tiles; tx++) {
+        int x0 = tx * kTile, x1 = std::min(x0 + kTile, dim - 1);
+        const float* columnLo = lo + c * stride;
+        const float* columnHi = hi + c * stride;
+        float* range = out + 2 * (c * plane + (std::size_t)ty * tiles + tx);
+        range[0] = *std::min_element(columnLo + x0, columnLo + x1 + 1);
+        range[1] = *std::max_element(columnHi + x0, columnHi + x1 + 1);
+      }
+    }
+  };
+
+  // Widens the column ranges by voxel row iy, or restarts them from it.
+  auto addRow = [&](int iy, bool restart) {
+    const float* row[VolumeStorage::kComponents];
+    for (int c = 0; c < VolumeStorage::kComponents; c++) {
+      row[c] = volume.slice(c, iz).data() + (std::size_t)iy * dim;
+    }
+    int ix = 0;
+    for (; ix + kLanes <= dim; ix += kLanes) {
+      // Blocks of local copies keep the compiler from worrying about
+      // aliasing, so the loops below vectorise.
+      float value[kComponents][kLanes];
+      for (int c = 0; c < VolumeStorage::kComponents; c++) {
+        std::copy(row[c] + ix, row[c] + ix + kLanes, value[c]);
+      }
+      for (int l = 0; l < kLanes; l++) {
+        value[3][l] = value[0][l] * value[0][l] + value[1][l] * value[1][l] +
+                      value[2][l] * value[2][l];
+      }
+      for (int c = 0; c < kComponents; c++) {
+        float* columnLo = lo + c * stride + ix;
+        float* columnHi = hi + c * stride + ix;
+        if (restart) {
+          std::copy(value[c], value[c] + kLanes, columnLo);
+          std::copy(value[c], value[c] + kLanes, columnHi);
+          continue;
+        }
+        float low[kLanes], high[kLanes];
+        std::copy(columnLo, columnLo + kLanes, low);
+        std::copy(columnHi, columnHi + kLanes, high);
+        for (int l = 0; l < kLanes; l++) {
+          low[l] = std::min(low[l], value[c][l]);
+          high[l] = std::max(high[l], value[c][l]);
+        }
+        std::copy(low, low + kLanes, columnLo);
+        std::copy(high, high + kLanes, columnHi);
+      }
+    }
+    for (; ix < dim; ix++) {
+      float value[kComponents] = {row[0][ix], row[1][ix], row[2][ix], 0};
+      value[3] = value[0] * value[0] + value[1] * value[1] +
+                 value[2] * value[2];
+      for (int c = 0; c < kComponents; c++) {
+        float& low = lo[c * stride + ix];
+        float& high = hi[c * stride + ix];
+        low = restart ? value[c] : std::min(low, value[c]);
+        high = restart ? value[c] : std::max(high, value[c]);
+      }
+    }
+  };
+
+  // A voxel row on a tile border closes one row of tiles and opens the
+  // next.
+  for (int iy = 0; iy < dim; iy++) {
+    addRow(iy, iy == 0);
+    if (iy > 0 && (iy % kTile == 0 || iy == dim - 1)) {
+      fold((iy - 1) / kTile);
+      if (iy < dim - 1) addRow(iy, true);
+    }
+  }
+
+  float* magnitude = out + 2 * 3 * plane;
+  for (std::size_t i = 0; i < plane; i++) {
+    magnitude[2 * i] = std::sqrt(magnitude[2 * i]) * (1 - kMagnitudeSlack);
+    magnitude[2 * i + 1] =
+        std::sqrt(magnitude[2 * i + 1]) * (1 + kMagnitudeSlack);
+  }
+}
+
+auto MinMaxIndex::getBrickRange(int c, int tx, int ty, int bz) const
+    -> std::pair<float, float> {
+  int z0 = bz * kTile, z1 = std::min(z0 + kTile, dim - 1);
+  float lo = std::numeric_limits<float>::max();
+  float hi = std::numeric_limits<float>::lowest();
+  for (int iz = z0; iz <= z1; iz++) {
+    const float* range = tile(iz, c, tx, ty);
+    lo = std::min(lo, range[0]);
+    hi = std::max(hi, range[1]);
+  }
+  return {lo, hi};
+}
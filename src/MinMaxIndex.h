@@ -0,0 +1,66 @@
+//
+// Created by Joshua Lowe on 17.10.26.
+//
+
+#ifndef CODE_MINMAXINDEX_H
+#define CODE_MINMAXINDEX_H
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+#include "VolumeStorage.h"
+
+// Value ranges of x, y, z and the magnitude over square tiles of kTile x
+// kTile cells of every z-slice. A tile includes the voxels on its far edges,
+// which it shares with its neighbours, so its range covers every corner of
+// its cells: an isoline of value c can only pass through a tile with
+// min <= c < max. Tiles of kTile consecutive slices merge into bricks, and
+// the per-slice moments of FlowFrame complete the hierarchy above them.
+//
+// Slices are indexed by FlowDataSource while it generates them, like the
+// slice moments, and never change afterwards. The ranges are taken from the
+// float planes, so they describe level 0 of float32 frames only; decoding a
+// lossy encoding may step across them. The magnitude ranges are a few ULP
+// wider than the magnitudes, as the storages may round them differently.
+class MinMaxIndex {
+ public:
+  static constexpr int kTile = 16;
+  static constexpr int kComponents = VolumeStorage::kComponents + 1;
+
+  explicit MinMaxIndex(int);
+
+  // Tiles along x and y, enough to cover the dimension - 1 cells of a row.
+  auto getTileCount() const -> int { return tiles; }
+  // Records the ranges of slice iz of the volume.
+  auto build(const VolumeStorage&, int) -> void;
+
+  // Whether an isoline of the value may cross tile (tx, ty) of slice iz.
+  auto mayCross(int iz, int c, int tx, int ty, float value) const -> bool {
+    const float* range = tile(iz, c, tx, ty);
+    return range[0] <= value && value < range[1];
+  }
+  auto getTileRange(int iz, int c, int tx, int ty) const
+      -> std::pair<float, float> {
+    const float* range = tile(iz, c, tx, ty);
+    return {range[0], range[1]};
+  }
+  // Range of the kTile^3 cells above tile (tx, ty) of slice bz * kTile,
+  // merged from the tiles of the slices they touch, which must be indexed.
+  auto getBrickRange(int c, int tx, int ty, int bz) const
+      -> std::pair<float, float>;
+
+ private:
+  auto tile(int iz, int c, int tx, int ty) const -> const float* {
+    std::size_t i = ((std::size_t)iz * kComponents + c) * tiles * tiles +
+                    (std::size_t)ty * tiles + tx;
+    return bounds.data() + 2 * i;
+  }
+
+  int dim;
+  int tiles;
+  // Min and max per tile, row by row, per component and slice.
+  std::vector<float> bounds;
+};
+
+#endif  // CODE_MINMAXINDEX_H
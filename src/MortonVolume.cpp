@@ -0,0 +1,32 @@
+//
+// Created by Joshua Lowe on 17.10.26.
+//
+
+#include "MortonVolume.h"
+
+#include <algorithm>
+
+MortonVolume::MortonVolume(const VolumeStorage& source)
+    : dim(source.dimension()), tileShift(3) {
+  while (tileShift < kMaxTileShift && dim % (2 << tileShift) == 0) {
+    tileShift++;
+  }
+  int edge = 1 << tileShift;
+  tiles = (dim + edge - 1) / edge;
+  std::size_t tileCount = (std::size_t)tiles * tiles * tiles;
+  data.assign(tileCount * edge * edge * edge * VolumeStorage::kComponents,
+              0.0f);
+  // Walking the source linearly keeps its reads sequential; the scattered
+  // writes stay within one tile row at a time.
+  for (int iz = 0; iz < dim; iz++) {
+    for (int iy = 0; iy < dim; iy++) {
+      for (int ix = 0; ix < dim; ix++) {
+        std::size_t i = source.index(ix, iy, iz);
+        float* v = data.data() + locate(ix, iy, iz);
+        for (int c = 0; c < VolumeStorage::kComponents; c++) {
+          v[c] = source.component(c)[i];
+        }
+      }
+    }
+  }
+}
@@ -0,0 +1,159 @@
+//
+// Created by Joshua Lowe on 17.10.26.
+//
+
+#ifndef CODE_MORTONVOLUME_H
+#define CODE_MORTONVOLUME_H
+
+#include <QVector3D>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "VolumeStorage.h"
+
+#if defined(__BMI2__)
+#include <immintrin.h>
+#endif
+
+// Z-order (Morton) codes for coordinates below 32: bit i of x, y and z goes
+// to bit 3i, 3i + 1 and 3i + 2 of the 15-bit code. Builds that target BMI2
+// (-mbmi2, -march=native) use pdep/pext, all others two small tables.
+constexpr std::uint32_t kMortonX = 0x1249;
+constexpr std::uint32_t kMortonY = kMortonX << 1;
+constexpr std::uint32_t kMortonZ = kMortonX << 2;
+
+// kMortonSpread[v] spreads the 5 bits of v to every third bit.
+inline constexpr auto kMortonSpread = [] {
+  std::array<std::uint16_t, 32> table{};
+  for (int v = 0; v < 32; v++) {
+    for (int bit = 0; bit < 5; bit++) {
+      table[v] |= ((v >> bit) & 1) << (3 * bit);
+    }
+  }
+  return table;
+}();
+
+// kMortonCompact[c] packs the x, y and z bits of a 9-bit code into
+// x | y << 3 | z << 6.
+inline constexpr auto kMortonCompact = [] {
+  std::array<std::uint16_t, 512> table{};
+  for (int code = 0; code < 512; code++) {
+    for (int bit = 0; bit < 9; bit++) {
+      int axis = bit % 3;
+      table[code] |= ((code >> bit) & 1) << (3 * axis + bit / 3);
+    }
+  }
+  return table;
+}();
+
+inline auto mortonEncode(int x, int y, int z) -> std::uint32_t {
+#if defined(__BMI2__)
+  return _pdep_u32(x, kMortonX) | _pdep_u32(y, kMortonY) |
+         _pdep_u32(z, kMortonZ);
+#else
+  return kMortonSpread[x] | kMortonSpread[y] << 1 | kMortonSpread[z] << 2;
+#endif
+}
+
+inline auto mortonDecode(std::uint32_t code, int& x, int& y, int& z) -> void {
+#if defined(__BMI2__)
+  x = _pext_u32(code, kMortonX);
+  y = _pext_u32(code, kMortonY);
+  z = _pext_u32(code, kMortonZ);
+#else
+  int low = kMortonCompact[code & 511];
+  int high = kMortonCompact[code >> 9];
+  x = (low & 7) | (high & 7) << 3;
+  y = (low >> 3 & 7) | (high >> 3 & 7) << 3;
+  z = (low >> 6 & 7) | (high >> 6 & 7) << 3;
+#endif
+}
+
+// Code of the neighbour one step up along the axis selected by mask
+// (kMortonX, kMortonY or kMortonZ). Setting the other bits lets the carry
+// ripple straight through them. Only valid while the coordinate stays
+// below the tile edge.
+inline auto mortonIncrement(std::uint32_t code, std::uint32_t mask)
+    -> std::uint32_t {
+  return (((code | ~mask) + 1) & mask) | (code & ~mask);
+}
+
+// Float volume in Z-order, so voxels close in space are close in memory
+// whichever direction a streamline takes. The curve runs inside cubic tiles
+// whose edge is the largest power of two from 8 to 32 dividing the
+// dimension, with the tiles in linear order. Only dimensions that are not
+// a multiple of 8 need padding, unlike a single power-of-two cube that may
+// take up to 8 times the voxels. Components are interleaved per voxel.
+class MortonVolume {
+ public:
+  static constexpr int kMaxTileShift = 5;
+
+  explicit MortonVolume(const VolumeStorage&);
+
+  auto dimension() const -> int { return dim; }
+  auto byteSize() const -> std::size_t { return data.size() * sizeof(float); }
+
+  // Offset of the first component of voxel (ix, iy, iz) in data.
+  auto locate(int ix, int iy, int iz) const -> std::size_t {
+    int last = (1 << tileShift) - 1;
+    return slot(tile(ix, iy, iz),
+                mortonEncode(ix & last, iy & last, iz & last));
+  }
+
+  auto value(int ix, int iy, int iz, int c) const -> float {
+    const float* v = data.data() + locate(ix, iy, iz);
+    if (c < VolumeStorage::kComponents) return v[c];
+    return std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+  }
+  auto vector(int ix, int iy, int iz) const -> QVector3D {
+    const float* v = data.data() + locate(ix, iy, iz);
+    return {v[0], v[1], v[2]};
+  }
+  // Same corner order as VolumeStorage::cell. Inside a tile the corners
+  // are reached from the base code with masked increments.
+  auto cell(int ix, int iy, int iz, QVector3D* corners) const -> void {
+    int last = (1 << tileShift) - 1;
+    int lx = ix & last, ly = iy & last, lz = iz & last;
+    if (lx == last || ly == last || lz == last) {
+      // The cell straddles a tile boundary.
+      for (int k = 0; k < 8; k++) {
+        corners[k] = vector(ix + (k & 1), iy + (k >> 1 & 1), iz + (k >> 2));
+      }
+      return;
+    }
+    std::size_t base = tile(ix, iy, iz);
+    std::uint32_t codes[8];
+    codes[0] = mortonEncode(lx, ly, lz);
+    codes[1] = mortonIncrement(codes[0], kMortonX);
+    codes[2] = mortonIncrement(codes[0], kMortonY);
+    codes[3] = mortonIncrement(codes[1], kMortonY);
+    for (int k = 0; k < 4; k++) {
+      codes[k + 4] = mortonIncrement(codes[k], kMortonZ);
+    }
+    for (int k = 0; k < 8; k++) {
+      const float* v = data.data() + slot(base, codes[k]);
+      corners[k] = {v[0], v[1], v[2]};
+    }
+  }
+
+ private:
+  auto tile(int ix, int iy, int iz) const -> std::size_t {
+    return (ix >> tileShift) +
+           (std::size_t)tiles *
+               ((iy >> tileShift) + (std::size_t)tiles * (iz >> tileShift));
+  }
+  auto slot(std::size_t tileIndex, std::uint32_t code) const -> std::size_t {
+    return ((tileIndex << (3 * tileShift)) + code) *
+           VolumeStorage::kComponents;
+  }
+
+  int dim;
+  int tileShift;
+  int tiles;  // per axis
+  std::vector<float> data;
+};
+
+#endif  // CODE_MORTONVOLUME_H
@@ -0,0 +1,29 @@
+//
+// Created by Joshua Lowe on 17.10.26.
+//
+
+#include "SpaceTimeSampler.h"
+
+#include <utility>
+
+auto SpaceTimeSampler::bind(std::unique_ptr<FieldEvaluator> field,
+                            std::unique_ptr<FieldEvaluator> next) -> void {
+  first = std::move(field);
+  second = std::move(next);
+}
+
+auto SpaceTimeSampler::release() -> void {
+  first.reset();
+  second.reset();
+}
+
+auto SpaceTimeSampler::sample(QVector3D position, float tau) const
+    -> InterpolationResult {
+  if (tau <= 0) return first->sample(position);
+  if (tau >= 1) return second->sample(position);
+  auto [success1, now] = first->sample(position);
+  if (!success1) return {false, {}};
+  auto [success2, later] = second->sample(position);
+  if (!success2) return {false, {}};
+  return {true, now + tau * (later - now)};
+}
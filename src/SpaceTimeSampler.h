@@ -0,0 +1,33 @@
+//
+// Created by Joshua Lowe on 17.10.26.
+//
+
+#ifndef CODE_SPACETIMESAMPLER_H
+#define CODE_SPACETIMESAMPLER_H
+
+#include <QVector3D>
+#include <memory>
+
+#include "FieldEvaluator.h"
+
+// Continuous velocity field between two consecutive frames: each frame is
+// sampled by its own FieldEvaluator and the two are interpolated linearly
+// in time, so path lines can take several steps per frame without
+// nearest-frame jumps. Positions are level 0 voxel coordinates.
+class SpaceTimeSampler {
+ public:
+  // Binds the fields of frame N and frame N + 1.
+  auto bind(std::unique_ptr<FieldEvaluator>, std::unique_ptr<FieldEvaluator>)
+      -> void;
+  auto release() -> void;
+
+  // Velocity at the position at time tau in [0, 1] from frame N to N + 1.
+  // Fails outside the volume.
+  auto sample(QVector3D, float) const -> InterpolationResult;
+
+ private:
+  std::unique_ptr<FieldEvaluator> first;
+  std::unique_ptr<FieldEvaluator> second;
+};
+
+#endif  // CODE_SPACETIMESAMPLER_H
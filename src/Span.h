@@ -0,0 +1,37 @@
+//
+// Created by Joshua Lowe on 17.10.26.
+//
+
+#ifndef CODE_SPAN_H
+#define CODE_SPAN_H
+
+#include <cstddef>
+
+// Non-owning view over a contiguous range, a small stand-in for C++20's
+// std::span. Views are only valid as long as the storage they point into.
+template <typename T>
+class Span {
+ public:
+  constexpr Span() : ptr(nullptr), count(0) {}
+  constexpr Span(T* data, std::size_t size) : ptr(data), count(size) {}
+
+  constexpr auto data() const -> T* { return ptr; }
+  constexpr auto size() const -> std::size_t { return count; }
+  constexpr auto empty() const -> bool { return count == 0; }
+  constexpr auto begin() const -> T* { return ptr; }
+  constexpr auto end() const -> T* { return ptr + count; }
+  constexpr auto operator[](std::size_t i) const -> T& { return ptr[i]; }
+
+  constexpr auto subspan(std::size_t offset, std::size_t size) const
+      -> Span<T> {
+    return {ptr + offset, size};
+  }
+
+ private:
+  T* ptr;
+  std::size_t count;
+};
+
+using FloatSpan = Span<const float>;
+
+#endif  // CODE_SPAN_H
@@ -0,0 +1,98 @@
+//
+// Created by Joshua Lowe on 17.10.26.
+//
+
+#include "SpanSpaceIndex.h"
+
+#include <algorithm>
+
+SpanSpaceIndex::SpanSpaceIndex(const float* lo, const float* hi, int count) {
+  std::vector<int> cells;
+  for (int i = 0; i < count; i++) {
+    if (lo[i] < hi[i]) cells.push_back(i);
+  }
+  int n = (int)cells.size();
+  int samples = n / kLeafSize;
+  for (int k = 0; k < samples; k++) {
+    int cell = cells[(std::size_t)k * n / samples];
+    splits.push_back(lo[cell] / 2 + hi[cell] / 2);
+  }
+  std::sort(splits.begin(), splits.end());
+  splits.erase(std::unique(splits.begin(), splits.end()), splits.end());
+
+  // Descends the implicit tree, node m of the split range [a, b) being
+  // (a + b) / 2, to the first split inside the span or to the gap between
+  // the two splits around it.
+  int nodes = (int)splits.size();
+  auto slot = [&](int cell) {
+    int a = 0, b = nodes;
+    while (a < b) {
+      int m = (a + b) / 2;
+      if (hi[cell] <= splits[m]) {
+        b = m;
+      } else if (lo[cell] > splits[m]) {
+        a = m + 1;
+      } else {
+        return m;
+      }
+    }
+    return nodes + a;
+  };
+
+  // Counting sort by slot, then each slot on its own.
+  std::vector<int> slots(n);
+  offsets.assign(2 * nodes + 2, 0);
+  for (int i = 0; i < n; i++) {
+    slots[i] = slot(cells[i]);
+    offsets[slots[i] + 1]++;
+  }
+  for (int s = 0; s < 2 * nodes + 1; s++) offsets[s + 1] += offsets[s];
+  byMin.resize(n);
+  std::vector<int> next(offsets.begin(), offsets.end() - 1);
+  for (int i = 0; i < n; i++) {
+    int cell = cells[i];
+    byMin[next[slots[i]]++] = {lo[cell], hi[cell], cell};
+  }
+  // The gaps are only ever scanned by min.
+  byMax.assign(byMin.begin(), byMin.begin() + offsets[nodes]);
+  for (int s = 0; s < 2 * nodes + 1; s++) {
+    auto begin = offsets[s], end = offsets[s + 1];
+    std::sort(byMin.begin() + begin, byMin.begin() + end,
+              [](const Span& a, const Span& b) { return a.min < b.min; });
+    if (s >= nodes) continue;
+    std::sort(byMax.begin() + begin, byMax.begin() + end,
+              [](const Span& a, const Span& b) { return a.max > b.max; });
+  }
+}
+
+auto SpanSpaceIndex::query(float value, std::vector<int>& cells) const
+    -> void {
+  // Below the split only the spans of the node starting at or below the
+  // value and those of the left subtree can contain it, above it only the
+  // spans of the node ending past the value and the right subtree.
+  int nodes = (int)splits.size();
+  int a = 0, b = nodes;
+  while (a < b) {
+    int m = (a + b) / 2;
+    if (value < splits[m]) {
+      for (int i = offsets[m]; i < offsets[m + 1] && byMin[i].min <= value;
+           i++) {
+        cells.push_back(byMin[i].cell);
+      }
+      b = m;
+    } else {
+      for (int i = offsets[m]; i < offsets[m + 1] && byMax[i].max > value;
+           i++) {
+        cells.push_back(byMax[i].cell);
+      }
+      a = m + 1;
+    }
+  }
+  // The gap the value falls into; its spans contain no split, so they
+  // have to be checked at both ends.
+  int gap = nodes + a;
+  for (int i = offsets[gap]; i < offsets[gap + 1] && byMin[i].min <= value;
+       i++) {
+    if (byMin[i].max > value) cells.push_back(byMin[i].cell);
+  }
+}
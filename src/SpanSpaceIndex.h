@@ -0,0 +1,51 @@
+//
+// Created by Joshua Lowe on 17.10.26.
+//
+
+#ifndef CODE_SPANSPACEINDEX_H
+#define CODE_SPANSPACEINDEX_H
+
+#include <vector>
+
+// Interval tree over the value spans [min, max) of the cells of a slice,
+// which answers which cells an isoline of a given value crosses in
+// O(log n + k) for k such cells: an isoline of value c crosses exactly the
+// cells with min <= c < max. Cells whose corners all share one value are
+// never crossed and are left out.
+//
+// The split values are the sorted midpoints of a regular sample of about
+// one cell in kLeafSize, arranged as an implicit balanced tree. A span is
+// stored at the topmost node whose split it contains, twice, sorted by
+// ascending min and by descending max, so a query only reads the spans it
+// reports plus one per visited node. Spans containing no split at all fall
+// into the gaps between neighbouring splits, which hold about kLeafSize
+// spans each and are filtered at the end of a query. Building takes a
+// single pass plus small sorts instead of sorting all spans.
+class SpanSpaceIndex {
+ public:
+  static constexpr int kLeafSize = 32;
+
+  // Indexes the spans [lo[i], hi[i]) of cells 0 to count - 1.
+  SpanSpaceIndex(const float* lo, const float* hi, int count);
+
+  // Appends the cells an isoline of the value crosses, in no particular
+  // order.
+  auto query(float, std::vector<int>&) const -> void;
+  // Number of indexed, i.e. non-constant, cells.
+  auto size() const -> int { return (int)byMin.size(); }
+
+ private:
+  struct Span {
+    float min, max;
+    int cell;
+  };
+
+  // Slot of node m is m, slot of the gap below split g is splits.size() + g;
+  // its spans are byMin and byMax [offsets[slot], offsets[slot + 1]). Only
+  // the nodes need byMax.
+  std::vector<float> splits;
+  std::vector<int> offsets;
+  std::vector<Span> byMin, byMax;
+};
+
+#endif  // CODE_SPANSPACEINDEX_H
@@ -6,16 +6,68 @@
 
 #include <QVector>
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
 #include <iostream>
-#include <thread>
+#include <numeric>
+
+#include "TaskScheduler.h"
+
+namespace {
+
+// Closed or stagnating streamlines, e.g. of a Rankine vortex, never leave
+// the volume, so a line ends after this many volume lengths worth of
+// steps of size t.
+constexpr int kMaxLineLengths = 32;
+
+// Tasks computeStreamLines() cuts the seeds into per thread, enough for
+// idle threads to steal from one that drew long lines.
+constexpr int kTasksPerThread = 16;
+
+// Streamlines traced in lockstep by helperFunctionPackets().
+constexpr int kPacketLanes = 16;
+
+// Dormand-Prince 5(4): the stage coefficients, whose last row gives the
+// fifth-order solution, and the difference of the two solutions' weights,
+// which estimates the error of a step.
+constexpr float kDormandPrince[7][6] = {
+    {},
+    {1 / 5.f},
+    {3 / 40.f, 9 / 40.f},
+    {44 / 45.f, -56 / 15.f, 32 / 9.f},
+    {19372 / 6561.f, -25360 / 2187.f, 64448 / 6561.f, -212 / 729.f},
+    {9017 / 3168.f, -355 / 33.f, 46732 / 5247.f, 49 / 176.f,
+     -5103 / 18656.f},
+    {35 / 384.f, 0, 500 / 1113.f, 125 / 192.f, -2187 / 6784.f, 11 / 84.f}};
+constexpr float kDormandPrinceError[7] = {
+    71 / 57600.f,      0,           -71 / 16695.f, 71 / 1920.f,
+    -17253 / 339200.f, 22 / 525.f, -1 / 40.f};
+
+// Step size control: the fifth root of the error ratio, damped by the
+// safety factor and limited to these factors per step.
+constexpr float kSafety = 0.9f;
+constexpr float kMinScale = 0.2f;
+constexpr float kMaxScale = 5;
+
+}  // namespace
 
 StreamLinesMapper::StreamLinesMapper()
-    : maxSteps(31),
+    : pathLinesInterval(5),
+      pathLineSubsteps(4),
+      costOrdered(true),
+      packetTracing(true),
+      isStreamLines(true),
       integrationState(Euler),
       t(1),
-      maxThreads(std::thread::hardware_concurrency()),
-      isStreamLines(true),
-      pathLinesInterval(5) {}
+      absoluteTolerance(1e-3f),
+      relativeTolerance(1e-3f),
+      minStep(0.05f),
+      maxStep(4),
+      maxSteps(31),
+      level(0),
+      analytic(false) {}
 
 StreamLinesMapper::StreamLinesMapper(FlowDataSource* source)
     : StreamLinesMapper() {
@@ -40,33 +92,29 @@ auto StreamLinesMapper::setPathLinesInterval(int step) -> void {
       (pathLinesInterval + step < 1) ? 1 : pathLinesInterval + step;
 }
 
-auto StreamLinesMapper::getFrame() -> int { return dataSource->getFrame(); }
+auto StreamLinesMapper::setPathLineSubsteps(int step) -> void {
+  pathLineSubsteps =
+      (pathLineSubsteps + step < 1) ? 1 : pathLineSubsteps + step;
+}
 
-auto StreamLinesMapper::helperFunctionPathLines(int ID) -> void {
-  std::vector<QVector3D> temp;
-  for (int i = 0; i < pathLinesSeeds.size(); i++) {
-    if (i % (maxThreads - 1) != ID) continue;
-    QVector3D currentLocation = pathLinesSeeds.at(i);
-    QVector3D prevLocation;
+auto StreamLinesMapper::getPathLineSubsteps() -> int {
+  return pathLineSubsteps;
+}
 
-    auto [success1, seedValue] = trilinearInterpolation(currentLocation);
-    if (!success1) exit(1);
+auto StreamLinesMapper::getFrame() -> int { return dataSource->getFrame(); }
 
-    prevLocation = currentLocation;
+auto StreamLinesMapper::helperFunctionPathLines(int begin, int end) -> void {
+  for (int k = begin; k < end; k++) {
+    int i = seedOrder[k];
+    std::vector<QVector3D>& temp = lines[i];
+    temp.clear();
+    QVector3D currentLocation = pathLinesSeeds.at(i);
+    QVector3D prevLocation = currentLocation;
 
-    InterpolationResult location =
-        currentIntegration(currentLocation, seedValue);
+    InterpolationResult location = advancePathLine(currentLocation);
     if (!location.success) continue;
-
     currentLocation = location.value;
-    InterpolationResult seed = trilinearInterpolation(currentLocation);
-    if (!seed.success) continue;
-    
-    seedValue = seed.value;
-    {
-      std::lock_guard<std::mutex> lock(templock);
-      tempSeeds.push_back(currentLocation);
-    }
+    advancedSeeds[i] = location;
 
     QVector3D direction = currentLocation - prevLocation;
     QVector3D tempValue = (currentLocation + QVector3D(1, 0, 0)) - prevLocation;
@@ -102,32 +150,33 @@ auto StreamLinesMapper::helperFunctionPathLines(int ID) -> void {
     temp.push_back(base5 / maxSteps);
     temp.push_back(currentLocation / maxSteps);
   }
-  {
-    std::lock_guard<std::mutex> lock(pathlock);
-    pathLinesResult.insert(std::end(pathLinesResult), std::begin(temp),
-                           std::end(temp));
-  }
 }
 
 auto StreamLinesMapper::helperFunctionStreamLines(
-    const std::vector<QVector3D>& seeds, int ID) -> void {
-  std::vector<QVector3D> temp;
-  for (int i = 0; i < seeds.size(); i++) {
-    if (i % (maxThreads - 1) != ID) continue;
+    const std::vector<QVector3D>& seeds, int begin, int end) -> void {
+  int maxSegments = kMaxLineLengths * maxSteps / t;
+  for (int k = begin; k < end; k++) {
+    int i = seedOrder[k];
+    std::vector<QVector3D>& temp = lines[i];
+    temp.clear();
     QVector3D currentLocation = seeds.at(i);
     QVector3D prevLocation;
 
-    auto [success, seedValue] = trilinearInterpolation(currentLocation);
+    auto [success, seedValue] = sampleField(currentLocation);
     if (!success) exit(1);
+    if (integrationState == DormandPrince) {
+      traceDormandPrince(currentLocation, seedValue, temp);
+      continue;
+    }
 
-    while (true) {
+    for (int segment = 0; segment < maxSegments; segment++) {
       prevLocation = currentLocation;
 
       InterpolationResult location =
           currentIntegration(currentLocation, seedValue);
       if (!location.success) break;
       currentLocation = location.value;
-      InterpolationResult seed = trilinearInterpolation(currentLocation);
+      InterpolationResult seed = sampleField(currentLocation);
       if (!seed.success) break;
       seedValue = seed.value;
 
@@ -135,19 +184,119 @@ auto StreamLinesMapper::helperFunctionStreamLines(
       temp.push_back(currentLocation / maxSteps);
     }
   }
-  {
-    std::lock_guard<std::mutex> lock(streamlock);
-    streamLines.insert(std::end(streamLines), std::begin(temp), std::end(temp));
+}
+
+auto StreamLinesMapper::helperFunctionPackets(
+    const std::vector<QVector3D>& seeds, int begin, int end) -> void {
+  // The streamlines of helperFunctionStreamLines(), kPacketLanes at a time
+  // in lockstep: every stage of the integrator is one loop over the lanes
+  // and one samplePacket() call. A lane whose line ends is closed up by the
+  // lanes behind it, and the free lanes at the back take the next seeds.
+  constexpr int kLanes = kPacketLanes;
+  int maxSegments = kMaxLineLengths * maxSteps / t;
+  float x[3][kLanes] = {}, v[3][kLanes] = {};
+  float k[4][3][kLanes] = {}, stage[3][kLanes] = {}, next[3][kLanes] = {};
+  bool valid[kLanes], alive[kLanes];
+  int line[kLanes], segments[kLanes];
+  auto sample = [&](int first, int count, float(&p)[3][kLanes],
+                    float(&out)[3][kLanes], bool* ok) {
+    field->samplePacket(count, p[0] + first, p[1] + first, p[2] + first,
+                        out[0] + first, out[1] + first, out[2] + first, ok);
+  };
+  // Samples the field at x + k[from] / divisor into k[to], scaled by t.
+  auto evaluate = [&](int count, int from, float divisor, int to) {
+    for (int c = 0; c < 3; c++) {
+      for (int l = 0; l < kLanes; l++) {
+        stage[c][l] = x[c][l] + k[from][c][l] / divisor;
+      }
+    }
+    bool ok[kLanes];
+    sample(0, count, stage, k[to], ok);
+    for (int l = 0; l < count; l++) alive[l] = alive[l] && ok[l];
+    for (int c = 0; c < 3; c++) {
+      for (int l = 0; l < kLanes; l++) k[to][c][l] = t * k[to][c][l];
+    }
+  };
+
+  int active = 0, following = begin;
+  while (true) {
+    int first = active;
+    for (; active < kLanes && following < end; active++) {
+      line[active] = seedOrder[following++];
+      lines[line[active]].clear();
+      segments[active] = 0;
+      QVector3D seed = seeds.at(line[active]);
+      for (int c = 0; c < 3; c++) x[c][active] = seed[c];
+    }
+    if (active == 0) return;
+    sample(first, active - first, x, v, valid + first);
+    for (int l = first; l < active; l++) {
+      if (!valid[l]) exit(1);
+    }
+    if (maxSegments <= 0) {
+      active = 0;
+      continue;
+    }
+
+    for (int l = 0; l < kLanes; l++) alive[l] = l < active;
+    for (int c = 0; c < 3; c++) {
+      for (int l = 0; l < kLanes; l++) k[0][c][l] = t * v[c][l];
+    }
+    switch (integrationState) {
+      case Kutta2:
+        evaluate(active, 0, 2, 1);
+        for (int c = 0; c < 3; c++) {
+          for (int l = 0; l < kLanes; l++) next[c][l] = x[c][l] + k[1][c][l];
+        }
+        break;
+      case Kutta4:
+        evaluate(active, 0, 2, 1);
+        evaluate(active, 1, 2, 2);
+        evaluate(active, 2, 1, 3);
+        for (int c = 0; c < 3; c++) {
+          for (int l = 0; l < kLanes; l++) {
+            next[c][l] = x[c][l] + k[0][c][l] / 6 + k[1][c][l] / 3 +
+                         k[2][c][l] / 3 + k[3][c][l] / 6;
+          }
+        }
+        break;
+      default:
+        for (int c = 0; c < 3; c++) {
+          for (int l = 0; l < kLanes; l++) next[c][l] = x[c][l] + k[0][c][l];
+        }
+    }
+    sample(0, active, next, v, valid);
+
+    int kept = 0;
+    for (int l = 0; l < active; l++) {
+      if (!alive[l] || !valid[l]) continue;
+      std::vector<QVector3D>& temp = lines[line[l]];
+      temp.push_back(QVector3D(x[0][l], x[1][l], x[2][l]) / maxSteps);
+      temp.push_back(QVector3D(next[0][l], next[1][l], next[2][l]) /
+                     maxSteps);
+      if (++segments[l] == maxSegments) continue;
+      line[kept] = line[l];
+      segments[kept] = segments[l];
+      for (int c = 0; c < 3; c++) {
+        x[c][kept] = next[c][l];
+        v[c][kept] = v[c][l];
+      }
+      kept++;
+    }
+    active = kept;
   }
 }
 
 auto StreamLinesMapper::shiftSeeds(std::vector<QVector3D> seeds)
     -> std::vector<QVector3D> {
   std::vector<QVector3D> temp;
+  // The analytic field evaluates all seeds in one vectorised pass.
+  std::vector<InterpolationResult> values(seeds.size());
+  field->sampleBatch(seeds.data(), seeds.size(), values.data());
   for (int i = 0; i < seeds.size(); i++) {
     QVector3D currentLocation = seeds.at(i);
 
-    auto [success1, seedValue] = trilinearInterpolation(currentLocation);
+    auto [success1, seedValue] = values[i];
     if (!success1) exit(1);
 
     auto location =
@@ -155,7 +304,7 @@ auto StreamLinesMapper::shiftSeeds(std::vector<QVector3D> seeds)
     if (!location.success) continue;
     currentLocation = location.value;
 
-    auto seed = trilinearInterpolation(currentLocation);
+    auto seed = sampleField(currentLocation);
     if (!seed.success) continue;
     seedValue = seed.value;
 
@@ -170,28 +319,75 @@ auto StreamLinesMapper::clearPathLinesSeeds() -> void {
 
 auto StreamLinesMapper::computeStreamLines(const std::vector<QVector3D>& seeds)
     -> std::vector<QVector3D> {
-  streamLines.clear();
-  pathLinesResult.clear();
-  dataSource->createData();
+  bindFields();
   if (!isStreamLines) attachPathLines(seeds);
-  std::vector<std::thread> threads;
-  for (int i = 0; i < (maxThreads - 1); i++) {
-    if (isStreamLines) {
-      threads.emplace_back(&StreamLinesMapper::helperFunctionStreamLines, this,
-                           seeds, i);
+  const std::vector<QVector3D>& traced = isStreamLines ? seeds : pathLinesSeeds;
+  int count = traced.size();
+  lines.resize(count);
+  advancedSeeds.assign(isStreamLines ? 0 : count, {false, QVector3D()});
+
+  // Lines near a vortex core run far longer than those near the border.
+  // Seeds are shifted only slightly from frame to frame, so the lengths of
+  // the last lines predict the next ones, and the longest go first, when
+  // every thread is still busy; the short ones fill the gaps at the end.
+  seedOrder.resize(count);
+  std::iota(seedOrder.begin(), seedOrder.end(), 0);
+  if (isStreamLines && costOrdered && (int)lineCosts.size() == count) {
+    std::stable_sort(seedOrder.begin(), seedOrder.end(),
+                     [&](int a, int b) { return lineCosts[a] > lineCosts[b]; });
+  }
+
+  TaskScheduler& scheduler = TaskScheduler::instance();
+  int threads = scheduler.getConcurrency();
+  std::vector<std::atomic<std::int64_t>> busy(threads);
+  for (auto& time : busy) time = 0;
+  int grain = std::max(1, count / (threads * kTasksPerThread));
+  // A packet needs enough seeds to refill its lanes from.
+  // The adaptive integrator steps every line on its own.
+  bool packets = isStreamLines && packetTracing &&
+                 integrationState != DormandPrince;
+  if (packets) grain = std::max(grain, 4 * kPacketLanes);
+  auto start = std::chrono::steady_clock::now();
+  parallelFor(count, grain, [&](int begin, int end) {
+    auto taskStart = std::chrono::steady_clock::now();
+    if (packets) {
+      helperFunctionPackets(traced, begin, end);
+    } else if (isStreamLines) {
+      helperFunctionStreamLines(traced, begin, end);
     } else {
-      threads.emplace_back(&StreamLinesMapper::helperFunctionPathLines, this,
-                           i);
+      helperFunctionPathLines(begin, end);
     }
+    busy[scheduler.getThreadIndex()] +=
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - taskStart)
+            .count();
+  });
+  double wall = std::chrono::duration<double, std::nano>(
+                    std::chrono::steady_clock::now() - start)
+                    .count();
+  utilisation.assign(threads, 0);
+  for (int i = 0; i < threads; i++) {
+    if (wall > 0) utilisation[i] = std::min(1.0, busy[i] / wall);
   }
-  for (std::thread& thread : threads) {
-    thread.join();
-  }
-  threads.clear();
 
-  if (isStreamLines) return streamLines;
-  pathLinesSeeds = std::move(tempSeeds);
-  return pathLinesResult;
+  // The lines are gathered in seed order, so the result does not depend on
+  // which thread traced what.
+  std::vector<QVector3D> result;
+  for (const std::vector<QVector3D>& line : lines) {
+    result.insert(result.end(), line.begin(), line.end());
+  }
+  if (isStreamLines) {
+    lineCosts.resize(count);
+    for (int i = 0; i < count; i++) lineCosts[i] = lines[i].size();
+    return result;
+  }
+  spaceTime.release();
+  std::vector<QVector3D> advanced;
+  for (const InterpolationResult& seed : advancedSeeds) {
+    if (seed.success) advanced.push_back(seed.value);
+  }
+  pathLinesSeeds = std::move(advanced);
+  return result;
 }
 
 auto StreamLinesMapper::attachPathLines(const std::vector<QVector3D>& seeds)
@@ -208,48 +404,64 @@ auto StreamLinesMapper::getPathLinesInterval() -> int {
   return pathLinesInterval;
 }
 
-auto StreamLinesMapper::trilinearInterpolation(QVector3D seed)
-    -> InterpolationResult {
-  QVector3D gridPoint = calculateGridPoint(seed);
-  if (std::max({gridPoint.x(), gridPoint.y(), gridPoint.z()}) > maxSteps - 1 ||
-      std::min({gridPoint.x(), gridPoint.y(), gridPoint.z()}) < 0)
-    return {false, QVector3D(0, 0, 0)};
+auto StreamLinesMapper::bindFields() -> void {
+  // Path lines move through time, so they also need the next frame.
+  int time = dataSource->getFrame();
+  if (analytic && dataSource->getFrameProvider() == nullptr) {
+    int id = dataSource->getGenerator();
+    int dim = dataSource->getDimension();
+    bool rev = dataSource->isReversed();
+    field = std::make_unique<AnalyticEvaluator>(id, dim, time, rev);
+    if (isStreamLines) return;
+    spaceTime.bind(std::make_unique<AnalyticEvaluator>(id, dim, time, rev),
+                   std::make_unique<AnalyticEvaluator>(id, dim, time + 1, rev));
+    return;
+  }
+  std::shared_ptr<const FlowFrame> frame = dataSource->acquireLevel(level);
+  int l = std::min(level, frame->getLevelCount() - 1);
+  field = std::make_unique<GridEvaluator>(frame, l);
+  if (isStreamLines) return;
+  spaceTime.bind(std::make_unique<GridEvaluator>(frame, l),
+                 std::make_unique<GridEvaluator>(
+                     dataSource->acquireNextFrame(l), l));
+}
 
-  Cube cube = Cube(gridPoint, dataSource, maxSteps);
+auto StreamLinesMapper::sampleField(QVector3D position)
+    -> InterpolationResult {
+  return field->sample(position);
+}
 
-  QVector3D firstInterpolation =
-      1 / (cube.x2 - cube.x1) * (cube.y2 - cube.y1) *
-      (cube.p1.value * (cube.x2 - seed.x()) * (cube.y2 - seed.y()) +
-       cube.p2.value * (seed.x() - cube.x1) * (cube.y2 - seed.y()) +
-       cube.p4.value * (cube.x2 - seed.x()) * (seed.y() - cube.y1) +
-       cube.p3.value * (seed.x() - cube.x1) * (seed.y() - cube.y1));
+auto StreamLinesMapper::getDimension() -> int {
+  return dataSource->getDimension();
+}
 
-  QVector3D secondInterpolation =
-      1 / (cube.x2 - cube.x1) * (cube.y2 - cube.y1) *
-      (cube.p5.value * (cube.x2 - seed.x()) * (cube.y2 - seed.y()) +
-       cube.p6.value * (seed.x() - cube.x1) * (cube.y2 - seed.y()) +
-       cube.p8.value * (cube.x2 - seed.x()) * (seed.y() - cube.y1) +
-       cube.p7.value * (seed.x() - cube.x1) * (seed.y() - cube.y1));
+auto StreamLinesMapper::getPathState() -> bool { return !isStreamLines; }
 
-  QVector3D thirdInterpolation =
-      (cube.z2 - seed.z()) / (cube.z2 - cube.z1) * firstInterpolation +
-      (seed.z() - cube.z1) / (cube.z2 - cube.z1) * secondInterpolation;
-  return {true, thirdInterpolation};
+auto StreamLinesMapper::setLevel(int inLevel) -> void {
+  level = (inLevel < 0) ? 0 : inLevel;
 }
 
-auto StreamLinesMapper::calculateGridPoint(QVector3D seed) -> QVector3D {
-  float x, y, z;
-  x = (seed.x() == maxSteps) ? seed.x() - 0.1 / (float)maxSteps : seed.x();
-  y = (seed.y() == maxSteps) ? seed.y() - 0.1 / (float)maxSteps : seed.y();
-  z = (seed.z() == maxSteps) ? seed.z() - 0.1 / (float)maxSteps : seed.z();
-  return {floor(x), floor(y), floor(z)};
+auto StreamLinesMapper::getLevel() -> int { return level; }
+
+auto StreamLinesMapper::setAnalytic(bool state) -> void { analytic = state; }
+
+auto StreamLinesMapper::isAnalytic() -> bool { return analytic; }
+
+auto StreamLinesMapper::setCostOrdered(bool state) -> void {
+  costOrdered = state;
 }
 
-auto StreamLinesMapper::getDimension() -> int {
-  return dataSource->getDimension();
+auto StreamLinesMapper::isCostOrdered() -> bool { return costOrdered; }
+
+auto StreamLinesMapper::setPacketTracing(bool state) -> void {
+  packetTracing = state;
 }
 
-auto StreamLinesMapper::getPathState() -> bool { return !isStreamLines; }
+auto StreamLinesMapper::isPacketTracing() -> bool { return packetTracing; }
+
+auto StreamLinesMapper::getUtilisation() -> std::vector<float> {
+  return utilisation;
+}
 
 auto StreamLinesMapper::eulerIntegration(QVector3D xt, QVector3D value)
     -> InterpolationResult {
@@ -260,7 +472,7 @@ auto StreamLinesMapper::rungeKutta2Integration(QVector3D xt, QVector3D value)
     -> InterpolationResult {
   QVector3D deltaX = t * (value);
   QVector3D vMidLoc = xt + (deltaX / 2);
-  auto [success, vMidVal] = trilinearInterpolation(vMidLoc);
+  auto [success, vMidVal] = sampleField(vMidLoc);
   return {success, xt + (t * vMidVal)};
 }
 
@@ -272,20 +484,20 @@ auto StreamLinesMapper::rungeKutta4Integration(QVector3D xt, QVector3D value)
 
   k2Loc = xt + (k1 / 2);
 
-  auto [success1, k2Val] = trilinearInterpolation(k2Loc);
+  auto [success1, k2Val] = sampleField(k2Loc);
   if (!success1) return {false, QVector3D(0, 0, 0)};
 
   k2 = t * k2Val;
 
   k3Loc = xt + (k2 / 2);
-  auto [success2, k3Val] = trilinearInterpolation(k3Loc);
+  auto [success2, k3Val] = sampleField(k3Loc);
   if (!success2) return {false, QVector3D(0, 0, 0)};
 
   k3 = t * k3Val;
 
   k4Loc = xt + k3;
 
-  auto [success3, k4Val] = trilinearInterpolation(k4Loc);
+  auto [success3, k4Val] = sampleField(k4Loc);
   if (!success3) return {false, QVector3D(0, 0, 0)};
 
   k4 = t * k4Val;
@@ -293,6 +505,102 @@ auto StreamLinesMapper::rungeKutta4Integration(QVector3D xt, QVector3D value)
   return {true, xt + (k1 / 6) + (k2 / 3) + (k3 / 3) + (k4 / 6)};
 }
 
+auto StreamLinesMapper::dormandPrinceStep(QVector3D xt, float h,
+                                          QVector3D* k)
+    -> InterpolationResult {
+  QVector3D position;
+  for (int s = 1; s < 7; s++) {
+    QVector3D increment;
+    for (int j = 0; j < s; j++) increment += kDormandPrince[s][j] * k[j];
+    position = xt + h * increment;
+    auto [success, value] = sampleField(position);
+    if (!success) return {false, {}};
+    k[s] = value;
+  }
+  return {true, position};
+}
+
+auto StreamLinesMapper::traceDormandPrince(QVector3D seed, QVector3D value,
+                                           std::vector<QVector3D>& line)
+    -> void {
+  // A line runs for the same integration time as a fixed-step one, so
+  // switching integrators does not change how far closed lines wind.
+  float duration = kMaxLineLengths * maxSteps;
+  float h = std::clamp(t, minStep, maxStep);
+  QVector3D x = seed, k[7];
+  k[0] = value;
+  for (float time = 0; time < duration;) {
+    InterpolationResult next = dormandPrinceStep(x, h, k);
+    if (!next.success) {
+      // A stage left the volume: approach the border with shorter steps.
+      if (h <= minStep) break;
+      h = std::max(h / 2, minStep);
+      continue;
+    }
+    // Largest error of the step relative to its tolerance.
+    QVector3D estimate;
+    for (int s = 0; s < 7; s++) estimate += kDormandPrinceError[s] * k[s];
+    float error = 0;
+    for (int axis = 0; axis < 3; axis++) {
+      float scale = absoluteTolerance +
+                    relativeTolerance *
+                        std::max(std::abs(x[axis]), std::abs(next.value[axis]));
+      error = std::max(error, std::abs(h * estimate[axis]) / scale);
+    }
+    float factor = (error > 0) ? kSafety * std::pow(error, -0.2f) : kMaxScale;
+    factor = std::clamp(factor, kMinScale, kMaxScale);
+    // Steps at the smallest size are taken whatever their error.
+    if (error > 1 && h > minStep) {
+      h = std::max(h * factor, minStep);
+      continue;
+    }
+
+    line.push_back(x / maxSteps);
+    line.push_back(next.value / maxSteps);
+    time += h;
+    x = next.value;
+    // First same as last: the final stage was sampled at the new position.
+    k[0] = k[6];
+    h = std::clamp(h * factor, minStep, maxStep);
+  }
+}
+
+auto StreamLinesMapper::advancePathLine(QVector3D start)
+    -> InterpolationResult {
+  // One frame interval advances time by t, split into equal substeps while
+  // the field moves from the current frame to the next.
+  float h = t / pathLineSubsteps;
+  float dtau = 1.0f / pathLineSubsteps;
+  QVector3D location = start;
+  for (int k = 0; k < pathLineSubsteps; k++) {
+    InterpolationResult step = spaceTimeStep(location, k * dtau, h, dtau);
+    if (!step.success) return step;
+    location = step.value;
+  }
+  if (!spaceTime.sample(location, 1).success) return {false, {}};
+  return {true, location};
+}
+
+auto StreamLinesMapper::spaceTimeStep(QVector3D xt, float tau, float h,
+                                      float dtau) -> InterpolationResult {
+  // The integrators of currentIntegration(), with every stage sampled at
+  // its own time. The substeps are fixed by the frame interval, so
+  // Dormand-Prince path lines take the RK4 step.
+  auto [success1, k1] = spaceTime.sample(xt, tau);
+  if (!success1) return {false, {}};
+  if (integrationState == Euler) return {true, xt + h * k1};
+
+  auto [success2, k2] = spaceTime.sample(xt + h / 2 * k1, tau + dtau / 2);
+  if (!success2) return {false, {}};
+  if (integrationState == Kutta2) return {true, xt + h * k2};
+
+  auto [success3, k3] = spaceTime.sample(xt + h / 2 * k2, tau + dtau / 2);
+  if (!success3) return {false, {}};
+  auto [success4, k4] = spaceTime.sample(xt + h * k3, tau + dtau);
+  if (!success4) return {false, {}};
+  return {true, xt + h / 6 * (k1 + 2 * k2 + 2 * k3 + k4)};
+}
+
 auto StreamLinesMapper::currentIntegration(QVector3D start, QVector3D value)
     -> InterpolationResult {
   switch (integrationState) {
@@ -302,6 +610,12 @@ auto StreamLinesMapper::currentIntegration(QVector3D start, QVector3D value)
       return rungeKutta2Integration(start, value);
     case Kutta4:
       return rungeKutta4Integration(start, value);
+    case DormandPrince: {
+      // A single step of size t, e.g. to shift seeds.
+      QVector3D k[7];
+      k[0] = value;
+      return dormandPrinceStep(start, t, k);
+    }
     default:
       return eulerIntegration(start, value);
   }
@@ -310,16 +624,19 @@ auto StreamLinesMapper::currentIntegration(QVector3D start, QVector3D value)
 auto StreamLinesMapper::setCurrentIntegration(int direction) -> void {
   switch (integrationState) {
     case Euler:
-      integrationState = (direction < 0) ? Kutta4 : Kutta2;
+      integrationState = (direction < 0) ? DormandPrince : Kutta2;
       break;
     case Kutta2:
       integrationState = (direction < 0) ? Euler : Kutta4;
       break;
     case Kutta4:
-      integrationState = (direction < 0) ? Kutta2 : Euler;
+      integrationState = (direction < 0) ? Kutta2 : DormandPrince;
+      break;
+    case DormandPrince:
+      integrationState = (direction < 0) ? Kutta4 : Euler;
       break;
     default:
-      integrationState = (direction < 0) ? Kutta4 : Kutta2;
+      integrationState = (direction < 0) ? DormandPrince : Kutta2;
       break;
   }
 }
@@ -333,61 +650,21 @@ auto StreamLinesMapper::setTValue(float T) -> bool {
   if (prevT == t) return false;
   return true;
 }
-
-Point3D::Point3D(float x, float y, float z) : position{x, y, z} {}
-
-auto Point3D::setLocation(float x, float y, float z) -> void {
-  position = QVector3D(x, y, z);
+auto StreamLinesMapper::setTolerance(float absolute, float relative) -> void {
+  if (absolute <= 0 || relative <= 0) return;
+  absoluteTolerance = absolute;
+  relativeTolerance = relative;
 }
-
-auto Point3D::setValue(const std::function<float(int, int, int, int)>& func)
-    -> void {
-  float x, y, z;
-  x = func(position.x(), position.y(), position.z(), 0);
-  y = func(position.x(), position.y(), position.z(), 1);
-  z = func(position.x(), position.y(), position.z(), 2);
-  value = QVector3D(x, y, z);
-}
-
-Cube::Cube(QVector3D initialPoint, FlowDataSource* source, int steps)
-    : p1{initialPoint.x(), initialPoint.y(), initialPoint.z()},
-      p2{initialPoint.x() + 1, initialPoint.y(), initialPoint.z()},
-      p3{initialPoint.x() + 1, initialPoint.y() + 1, initialPoint.z()},
-      p4{initialPoint.x(), initialPoint.y() + 1, initialPoint.z()},
-      p5{initialPoint.x(), initialPoint.y(), initialPoint.z() + 1},
-      p6{initialPoint.x() + 1, initialPoint.y(), initialPoint.z() + 1},
-      p7{initialPoint.x() + 1, initialPoint.y() + 1, initialPoint.z() + 1},
-      p8{initialPoint.x(), initialPoint.y() + 1, initialPoint.z() + 1},
-      dataSource(source),
-      maxSteps(steps) {
-  p1.setValue([&](int x, int y, int z, int c) -> float {
-    return dataSource->getDataValue(x, y, z, c);
-  });
-  p2.setValue([&](int x, int y, int z, int c) -> float {
-    return dataSource->getDataValue(x, y, z, c);
-  });
-  p3.setValue([&](int x, int y, int z, int c) -> float {
-    return dataSource->getDataValue(x, y, z, c);
-  });
-  p4.setValue([&](int x, int y, int z, int c) -> float {
-    return dataSource->getDataValue(x, y, z, c);
-  });
-  p5.setValue([&](int x, int y, int z, int c) -> float {
-    return dataSource->getDataValue(x, y, z, c);
-  });
-  p6.setValue([&](int x, int y, int z, int c) -> float {
-    return dataSource->getDataValue(x, y, z, c);
-  });
-  p7.setValue([&](int x, int y, int z, int c) -> float {
-    return dataSource->getDataValue(x, y, z, c);
-  });
-  p8.setValue([&](int x, int y, int z, int c) -> float {
-    return dataSource->getDataValue(x, y, z, c);
-  });
-  this->x1 = p1.position.x();
-  this->x2 = p2.position.x();
-  this->y1 = p1.position.y();
-  this->y2 = p3.position.y();
-  this->z1 = p1.position.z();
-  this->z2 = p5.position.z();
+auto StreamLinesMapper::getAbsoluteTolerance() -> float {
+  return absoluteTolerance;
+}
+auto StreamLinesMapper::getRelativeTolerance() -> float {
+  return relativeTolerance;
+}
+auto StreamLinesMapper::setStepLimits(float min, float max) -> void {
+  if (min <= 0 || max < min) return;
+  minStep = min;
+  maxStep = max;
 }
+auto StreamLinesMapper::getMinStep() -> float { return minStep; }
+auto StreamLinesMapper::getMaxStep() -> float { return maxStep; }
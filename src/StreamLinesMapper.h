@@ -6,34 +6,16 @@
 #define CODE5_STREAMLINESMAPPER_H
 
 #include <QVector3D>
-#include <mutex>
+#include <memory>
+#include <vector>
 
+#include "FieldEvaluator.h"
 #include "FlowDataSource.h"
+#include "SpaceTimeSampler.h"
 
-struct InterpolationResult {
-  bool success;
-  QVector3D value;
-};
-
-struct Point3D {
-  Point3D(float x, float y, float z);
-
-  auto setLocation(float x, float y, float z) -> void;
-  auto setValue(const std::function<float(int, int, int, int)>& func) -> void;
-  QVector3D position;
-  QVector3D value;
-};
-
-struct Cube {
-  Cube(QVector3D initialPoint, FlowDataSource* source, int);
-  FlowDataSource* dataSource;
-
-  Point3D p1, p2, p3, p4, p5, p6, p7, p8;
-  float x1, x2, y1, y2, z1, z2;
-  int maxSteps;
-};
-
-enum Integration { Euler, Kutta2, Kutta4 };
+// DormandPrince is the embedded Runge-Kutta 5(4) pair with a step size
+// adapted per streamline; t is its first step.
+enum Integration { Euler, Kutta2, Kutta4, DormandPrince };
 
 class StreamLinesMapper {
  public:
@@ -45,9 +27,25 @@ class StreamLinesMapper {
   auto clearPathLinesSeeds() -> void;
   auto togglePathLines(bool) -> void;
   auto setPathLinesInterval(int) -> void;
+  // Integration steps a path line takes per frame, with the field
+  // interpolated in time between the current and the next frame.
+  auto setPathLineSubsteps(int) -> void;
+  auto getPathLineSubsteps() -> int;
   auto getTValue() -> float;
   auto getPathState() -> bool;
   auto setTValue(float) -> bool;
+  // Error the Dormand-Prince integrator allows per step, in voxels and
+  // relative to the position; 1e-3 each by default. Ignored unless both
+  // are positive.
+  auto setTolerance(float absolute, float relative) -> void;
+  auto getAbsoluteTolerance() -> float;
+  auto getRelativeTolerance() -> float;
+  // Step sizes the Dormand-Prince integrator keeps to, 0.05 to 4 by
+  // default. A step shorter than the smallest t gains nothing; a longer one
+  // than a few cells would jump over the structure of the grid.
+  auto setStepLimits(float min, float max) -> void;
+  auto getMinStep() -> float;
+  auto getMaxStep() -> float;
   auto getFrame() -> int;
   auto getIntegration() -> Integration;
   auto setMaxSteps() -> void;
@@ -57,33 +55,83 @@ class StreamLinesMapper {
       -> std::vector<QVector3D>;
   auto setCurrentIntegration(int direction) -> void;
   auto shiftSeeds(std::vector<QVector3D>) -> std::vector<QVector3D>;
+  // Pyramid level the field is sampled from (see FlowFrame). Seeds and
+  // lines stay in level 0 coordinates.
+  auto setLevel(int) -> void;
+  auto getLevel() -> int;
+  // Evaluates the generator of the data source at the integration points
+  // instead of interpolating a generated frame, which skips generating the
+  // volume.
+  // Ignored while the data source replays a provider.
+  auto setAnalytic(bool) -> void;
+  auto isAnalytic() -> bool;
+  // Traces the seeds whose streamlines ran longest in the last call first.
+  auto setCostOrdered(bool) -> void;
+  auto isCostOrdered() -> bool;
+  // Traces streamlines in packets of seeds advanced in lockstep through
+  // FieldEvaluator::samplePacket() rather than one seed at a time. Both
+  // give the same lines up to the rounding of contracted multiply-adds.
+  auto setPacketTracing(bool) -> void;
+  auto isPacketTracing() -> bool;
+  // Share of the last computeStreamLines() call each scheduler thread spent
+  // tracing, the threads outside the pool counted last.
+  auto getUtilisation() -> std::vector<float>;
 
  private:
-  auto helperFunctionStreamLines(const std::vector<QVector3D>&, int) -> void;
-  auto helperFunctionPathLines(int) -> void;
+  // Trace the lines of the seeds seedOrder[begin, end) into their lines.
+  auto helperFunctionStreamLines(const std::vector<QVector3D>&, int begin,
+                                 int end) -> void;
+  auto helperFunctionPackets(const std::vector<QVector3D>&, int begin,
+                             int end) -> void;
+  auto helperFunctionPathLines(int begin, int end) -> void;
   auto attachPathLines(const std::vector<QVector3D>&) -> void;
   auto currentIntegration(QVector3D, QVector3D) -> InterpolationResult;
-  auto trilinearInterpolation(QVector3D) -> InterpolationResult;
-  auto calculateGridPoint(QVector3D) -> QVector3D;
+  auto sampleField(QVector3D) -> InterpolationResult;
+  auto bindFields() -> void;
   auto eulerIntegration(QVector3D, QVector3D) -> InterpolationResult;
   auto rungeKutta2Integration(QVector3D, QVector3D) -> InterpolationResult;
   auto rungeKutta4Integration(QVector3D, QVector3D) -> InterpolationResult;
+  // One Dormand-Prince step of size h from xt, k[0] holding the velocity
+  // at xt. Fills the stages k[1] to k[6]; k[6] is sampled at the returned
+  // fifth-order position and so is the first stage of the next step.
+  auto dormandPrinceStep(QVector3D xt, float h, QVector3D* k)
+      -> InterpolationResult;
+  // Traces the streamline from a seed with the given velocity into line,
+  // adapting the step to the error estimate of the embedded pair.
+  auto traceDormandPrince(QVector3D, QVector3D, std::vector<QVector3D>& line)
+      -> void;
+  auto advancePathLine(QVector3D) -> InterpolationResult;
+  auto spaceTimeStep(QVector3D, float, float, float) -> InterpolationResult;
 
   int pathLinesInterval;
+  int pathLineSubsteps;
+  SpaceTimeSampler spaceTime;
 
   std::vector<QVector3D> pathLinesSeeds;
-  std::vector<QVector3D> tempSeeds;
-  std::vector<QVector3D> pathLinesResult;
-  std::mutex pathlock;
-  std::mutex templock;
+  // Where the path line seeds got to this frame.
+  std::vector<InterpolationResult> advancedSeeds;
+
+  // Vertices of the line of every seed, the order the seeds are traced in,
+  // and the vertex counts of the last streamlines.
+  std::vector<std::vector<QVector3D>> lines;
+  std::vector<int> seedOrder;
+  std::vector<int> lineCosts;
+  bool costOrdered;
+  bool packetTracing;
+  std::vector<float> utilisation;
 
-  std::vector<QVector3D> streamLines;
   bool isStreamLines;
-  unsigned int maxThreads;
   Integration integrationState;
-  std::mutex streamlock;
   float t;
+  float absoluteTolerance;
+  float relativeTolerance;
+  float minStep;
+  float maxStep;
   int maxSteps;
+  int level;
+  bool analytic;
+  // Field of the current frame, kept for shiftSeeds().
+  std::unique_ptr<FieldEvaluator> field;
   FlowDataSource* dataSource;
 };
 
@@ -46,6 +46,14 @@ auto StreamLinesRenderer::setPathLinesInterval(int step) -> void {
   streamLinesMapper->setPathLinesInterval(step);
 }
 
+auto StreamLinesRenderer::setPathLineSubsteps(int step) -> void {
+  streamLinesMapper->setPathLineSubsteps(step);
+}
+
+auto StreamLinesRenderer::getPathLineSubsteps() -> int {
+  return streamLinesMapper->getPathLineSubsteps();
+}
+
 auto StreamLinesRenderer::createSeeds() -> void {
   seeds.clear();
   float value;
@@ -106,6 +114,13 @@ auto StreamLinesRenderer::updateStreamLines() -> void {
   initStreamLines();
 }
 
+auto StreamLinesRenderer::refreshStreamLines() -> void {
+  // Path lines step on every computation, so they are left alone.
+  if (streamLinesMapper->getPathState()) return;
+  streamLines = streamLinesMapper->computeStreamLines(seeds);
+  initStreamLines();
+}
+
 auto StreamLinesRenderer::initOpenGLShaders() -> void {
   QString shaderDir = QString::fromUtf8(std::getenv("SHADER_DIR"));
   QString vertexShaderPath =
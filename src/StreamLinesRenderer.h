@@ -23,6 +23,9 @@ class StreamLinesRenderer {
   auto setMaxSteps() -> void;
   auto setMapper(StreamLinesMapper*) -> void;
   auto updateStreamLines() -> void;
+  // Recomputes the lines of the current frame, e.g. after the mapper
+  // changed its level, without advancing seeds or path lines.
+  auto refreshStreamLines() -> void;
   auto setCurrentIntegration(int) -> void;
   auto toggleStreamEdit(bool state) -> void;
   auto getStreamState() -> bool;
@@ -37,6 +40,8 @@ class StreamLinesRenderer {
   auto setShiftingSeedsInterval(int) -> void;
   auto togglePathLines(bool) -> void;
   auto setPathLinesInterval(int) -> void;
+  auto setPathLineSubsteps(int) -> void;
+  auto getPathLineSubsteps() -> int;
   auto restartPathLines() -> void;
 
  protected:
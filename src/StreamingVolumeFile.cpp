@@ -0,0 +1,327 @@
+//
+// Created by Joshua Lowe on 17.10.26.
+//
+
+#include "StreamingVolumeFile.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <iostream>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+StreamingVolumeFile::StreamingVolumeFile()
+    : header(),
+#ifdef _WIN32
+      fileHandle(INVALID_HANDLE_VALUE),
+#else
+      fd(-1),
+#endif
+      position(0),
+      direction(1),
+      stalls(0),
+      bytesRead(0),
+      readSeconds(0),
+      stopping(false) {
+}
+
+StreamingVolumeFile::~StreamingVolumeFile() {
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    stopping = true;
+  }
+  wake.notify_all();
+  if (worker.joinable()) worker.join();
+#ifdef _WIN32
+  if (fileHandle != INVALID_HANDLE_VALUE) CloseHandle(fileHandle);
+#else
+  if (fd >= 0) ::close(fd);
+#endif
+}
+
+auto StreamingVolumeFile::open(const std::string& path, std::size_t budget)
+    -> std::shared_ptr<StreamingVolumeFile> {
+  std::shared_ptr<StreamingVolumeFile> file(new StreamingVolumeFile());
+  if (!file->openFile(path)) return nullptr;
+
+  std::size_t frameBytes = VolumeStorage::kComponents * file->planeBytes();
+  int capacity = std::max<std::size_t>(2, budget / frameBytes);
+  capacity = std::min<int>(capacity, file->header.frameCount);
+  file->slots.assign(capacity, Slot{-1, false, nullptr});
+  file->worker = std::thread(&StreamingVolumeFile::run, file.get());
+  return file;
+}
+
+auto StreamingVolumeFile::openFile(const std::string& path) -> bool {
+  std::uint64_t size;
+#ifdef _WIN32
+  fileHandle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ,
+                           nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL,
+                           nullptr);
+  LARGE_INTEGER fileSize;
+  if (fileHandle == INVALID_HANDLE_VALUE ||
+      !GetFileSizeEx(fileHandle, &fileSize)) {
+    std::cerr << "cannot open volume file " << path << std::endl;
+    return false;
+  }
+  size = fileSize.QuadPart;
+#else
+  fd = ::open(path.c_str(), O_RDONLY);
+  struct stat info;
+  if (fd < 0 || fstat(fd, &info) != 0) {
+    std::cerr << "cannot open volume file " << path << std::endl;
+    return false;
+  }
+  size = info.st_size;
+#endif
+  if (size < sizeof(VolumeFileHeader) ||
+      !readAt(&header, sizeof(header), 0)) {
+    std::cerr << path << " is too small for a volume file" << std::endl;
+    return false;
+  }
+  if (!checkVolumeHeader(header, size, path)) return false;
+  table.resize(header.frameCount);
+  if (!readAt(table.data(), table.size() * sizeof(VolumeFileFrame),
+              header.frameTable)) {
+    std::cerr << "cannot read the frame table of " << path << std::endl;
+    return false;
+  }
+  return checkVolumeFrames(header, table.data(), size, path);
+}
+
+auto StreamingVolumeFile::readAt(void* target, std::size_t bytes,
+                                 std::uint64_t offset) -> bool {
+  auto* out = static_cast<char*>(target);
+  while (bytes > 0) {
+#ifdef _WIN32
+    DWORD chunk = (DWORD)std::min<std::size_t>(bytes, 1u << 30);
+    OVERLAPPED at = {};
+    at.Offset = (DWORD)offset;
+    at.OffsetHigh = (DWORD)(offset >> 32);
+    DWORD done = 0;
+    if (!ReadFile(fileHandle, out, chunk, &done, &at) || done == 0) {
+      return false;
+    }
+#else
+    ssize_t done = pread(fd, out, bytes, offset);
+    if (done < 0 && errno == EINTR) continue;
+    if (done <= 0) return false;
+#endif
+    out += done;
+    bytes -= done;
+    offset += done;
+  }
+  return true;
+}
+
+auto StreamingVolumeFile::readFrame(int index, VolumeStorage& target)
+    -> bool {
+  for (int c = 0; c < VolumeStorage::kComponents; c++) {
+    Span<float> plane = target.mutableComponent(c);
+    if (!readAt(plane.data(), plane.size() * sizeof(float),
+                table[index].planes[c])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+auto StreamingVolumeFile::clear(VolumeStorage& target) -> void {
+  for (int c = 0; c < VolumeStorage::kComponents; c++) {
+    Span<float> plane = target.mutableComponent(c);
+    std::fill(plane.begin(), plane.end(), 0.0f);
+  }
+}
+
+auto StreamingVolumeFile::adviseWillNeed(int index) -> void {
+  // Lets the kernel pull the frame after the one being read into the page
+  // cache in parallel, without spending ring memory on it.
+#if !defined(_WIN32) && defined(POSIX_FADV_WILLNEED)
+  for (std::uint64_t planeOffset : table[index].planes) {
+    posix_fadvise(fd, planeOffset, planeBytes(), POSIX_FADV_WILLNEED);
+  }
+#else
+  (void)index;
+#endif
+}
+
+auto StreamingVolumeFile::planeBytes() const -> std::size_t {
+  std::size_t dim = header.dims[0];
+  return dim * dim * dim * sizeof(float);
+}
+
+auto StreamingVolumeFile::getDimension() const -> int {
+  return header.dims[0];
+}
+
+auto StreamingVolumeFile::getFrameCount() const -> int {
+  return header.frameCount;
+}
+
+auto StreamingVolumeFile::getStalls() -> int {
+  std::lock_guard<std::mutex> guard(lock);
+  return stalls;
+}
+
+auto StreamingVolumeFile::seek(int index) -> void {
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    int count = header.frameCount;
+    int step = ((index - position) % count + count) % count;
+    if (step == 0) return;
+    // The shorter way round decides the direction, so wrapping from the
+    // last to the first frame still counts as forward.
+    direction = (step <= count / 2) ? 1 : -1;
+    position = index;
+  }
+  wake.notify_all();
+}
+
+auto StreamingVolumeFile::rank(int index) const -> int {
+  // Frames ahead rank by their distance, frames behind count double, so
+  // the ring keeps mostly upcoming frames and a few for scrubbing back.
+  int count = header.frameCount;
+  int ahead = ((index - position) * direction % count + count) % count;
+  return std::min(ahead, 2 * (count - ahead));
+}
+
+auto StreamingVolumeFile::findSlot(int index) -> Slot* {
+  for (Slot& slot : slots) {
+    if (slot.index == index) return &slot;
+  }
+  return nullptr;
+}
+
+auto StreamingVolumeFile::evictionCandidate(int limit) -> Slot* {
+  // The slot with the least useful frame, provided it ranks above limit.
+  Slot* candidate = nullptr;
+  int worst = limit;
+  for (Slot& slot : slots) {
+    if (slot.loading) continue;
+    int slotRank = slot.index < 0 ? header.frameCount * 2 : rank(slot.index);
+    if (slotRank > worst) {
+      worst = slotRank;
+      candidate = &slot;
+    }
+  }
+  return candidate;
+}
+
+auto StreamingVolumeFile::fill(Slot& slot, int index,
+                               std::unique_lock<std::mutex>& guard) -> bool {
+  slot.index = index;
+  slot.loading = true;
+  if (!slot.data || slot.data.use_count() > 1) {
+    slot.data = std::make_shared<VolumeStorage>(header.dims[0]);
+  }
+  std::shared_ptr<VolumeStorage> target = slot.data;
+  guard.unlock();
+
+  auto start = std::chrono::steady_clock::now();
+  bool ok = readFrame(index, *target);
+  if (!ok) clear(*target);
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+
+  guard.lock();
+  // Slots never move, the vector is sized once in open().
+  slot.loading = false;
+  if (ok) {
+    bytesRead += VolumeStorage::kComponents * planeBytes();
+    readSeconds += elapsed.count();
+  } else {
+    slot.index = -1;
+    std::cerr << "reading frame " << index << " of the volume file failed"
+              << std::endl;
+  }
+  loaded.notify_all();
+  return ok;
+}
+
+auto StreamingVolumeFile::run() -> void {
+  std::unique_lock<std::mutex> guard(lock);
+  int capacity = slots.size();
+  while (!stopping) {
+    // The most useful frame that is neither resident nor being read, in
+    // rank order: current, ahead, one behind, further ahead, ...
+    int next = -1;
+    int nextRank = capacity;
+    int count = header.frameCount;
+    for (int k = 0; k < capacity && next < 0; k++) {
+      int ahead = ((position + direction * k) % count + count) % count;
+      int behind = ((position - direction * k) % count + count) % count;
+      if (!findSlot(ahead)) {
+        next = ahead;
+      } else if (k > 0 && 2 * k < capacity && !findSlot(behind)) {
+        next = behind;
+      }
+    }
+    if (next >= 0) nextRank = rank(next);
+    Slot* slot = next >= 0 ? evictionCandidate(nextRank) : nullptr;
+    if (!slot) {
+      wake.wait(guard);
+      continue;
+    }
+    int following = ((next + direction) % count + count) % count;
+    guard.unlock();
+    adviseWillNeed(following);
+    guard.lock();
+    // Playback may have moved on meanwhile, so next and the victim are
+    // both judged again: a seek can make the chosen slot hold a frame that
+    // now ranks better than next, such as the new current one.
+    if (findSlot(next) || rank(next) >= capacity) continue;
+    slot = evictionCandidate(rank(next));
+    if (!slot) continue;
+    // Retrying a broken file right away would spin, wait for a seek.
+    if (!fill(*slot, next, guard)) wake.wait(guard);
+  }
+}
+
+auto StreamingVolumeFile::loadFrame(int index) -> VolumeStorage {
+  std::unique_lock<std::mutex> guard(lock);
+  Slot* slot = findSlot(index);
+  if (!slot || slot->loading) {
+    // The reader did not get here in time, so playback waits for the disk.
+    stalls++;
+    double bandwidth = readSeconds > 0 ? bytesRead / readSeconds / 1e6 : 0;
+    std::cerr << "streaming fell behind at frame " << index << " (" << stalls
+              << " stalls, reading at " << bandwidth << " MB/s)" << std::endl;
+  }
+  loaded.wait(guard, [&] {
+    slot = findSlot(index);
+    return !slot || !slot->loading;
+  });
+  if (!slot) {
+    slot = evictionCandidate(-1);
+    if (!slot) {
+      // Every slot is being read, read this one past the ring.
+      VolumeStorage storage(header.dims[0]);
+      guard.unlock();
+      if (!readFrame(index, storage)) {
+        std::cerr << "reading frame " << index << " of the volume file failed"
+                  << std::endl;
+        clear(storage);
+      }
+      return storage;
+    }
+    if (!fill(*slot, index, guard)) {
+      VolumeStorage storage(header.dims[0]);
+      clear(storage);
+      return storage;
+    }
+  }
+  wake.notify_all();
+  const VolumeStorage& data = *slot->data;
+  return VolumeStorage::wrap(header.dims[0], data.component(0).data(),
+                             data.component(1).data(),
+                             data.component(2).data(), slot->data);
+}
@@ -0,0 +1,96 @@
+//
+// Created by Joshua Lowe on 17.10.26.
+//
+
+#ifndef CODE_STREAMINGVOLUMEFILE_H
+#define CODE_STREAMINGVOLUMEFILE_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "FrameProvider.h"
+#include "VolumeFile.h"
+
+// Frame provider for volume files too long to keep in memory. A reader
+// thread fills a bounded ring of frame buffers with the frames playback
+// moves towards, using positional reads, so the working set is capped by
+// the byte budget instead of by the length of the sequence. The ring holds
+// the frames ahead of the position in the playback direction plus the one
+// behind it, which keeps backward scrubbing and reversing cheap.
+//
+// loadFrame() only blocks when the reader has not got to the frame yet;
+// every such stall is counted and reported together with the read
+// bandwidth, which is what has to keep up with the playback rate.
+class StreamingVolumeFile : public FrameProvider {
+ public:
+  static constexpr std::size_t kDefaultBudget = std::size_t(512) << 20;
+
+  // Returns nullptr and reports why if the file cannot be used. The ring
+  // holds as many frames as the byte budget allows, but at least two (or
+  // every frame of a shorter file) whatever the budget.
+  static auto open(const std::string&, std::size_t = kDefaultBudget)
+      -> std::shared_ptr<StreamingVolumeFile>;
+  ~StreamingVolumeFile() override;
+  StreamingVolumeFile(const StreamingVolumeFile&) = delete;
+  auto operator=(const StreamingVolumeFile&) -> StreamingVolumeFile& = delete;
+
+  auto getDimension() const -> int override;
+  auto getFrameCount() const -> int override;
+  auto loadFrame(int) -> VolumeStorage override;
+  auto seek(int) -> void override;
+
+  auto getCapacity() const -> int { return slots.size(); }
+  auto getStalls() -> int;
+
+ private:
+  struct Slot {
+    int index;  // frame held by the slot, -1 if empty
+    bool loading;
+    // A frame handed out keeps its buffer alive; a slot whose buffer is
+    // still referenced gets a new one when it is reused.
+    std::shared_ptr<VolumeStorage> data;
+  };
+
+  StreamingVolumeFile();
+  auto openFile(const std::string&) -> bool;
+  auto readAt(void*, std::size_t, std::uint64_t) -> bool;
+  auto readFrame(int, VolumeStorage&) -> bool;
+  auto clear(VolumeStorage&) -> void;
+  auto planeBytes() const -> std::size_t;
+  auto adviseWillNeed(int) -> void;
+  auto run() -> void;
+
+  // The helpers below expect the lock to be held.
+  auto rank(int) const -> int;
+  auto findSlot(int) -> Slot*;
+  auto evictionCandidate(int) -> Slot*;
+  auto fill(Slot&, int, std::unique_lock<std::mutex>&) -> bool;
+
+  VolumeFileHeader header;
+  std::vector<VolumeFileFrame> table;
+#ifdef _WIN32
+  void* fileHandle;
+#else
+  int fd;
+#endif
+
+  std::mutex lock;
+  std::condition_variable wake;
+  std::condition_variable loaded;
+  std::vector<Slot> slots;
+  int position;
+  int direction;
+  int stalls;
+  std::uint64_t bytesRead;
+  double readSeconds;
+  bool stopping;
+  std::thread worker;
+};
+
+#endif  // CODE_STREAMINGVOLUMEFILE_H
@@ -0,0 +1,168 @@
+//
+// Created by Joshua Lowe on 17.10.26.
+//
+
+#include "TaskScheduler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iterator>
+#include <utility>
+
+namespace {
+
+// Scheduler and deque of the worker running on this thread, if any.
+thread_local TaskScheduler* currentScheduler = nullptr;
+thread_local int currentWorker = -1;
+
+// How long a waiting thread sleeps before it looks for new tasks again,
+// which tasks of its group may have queued in the meantime.
+constexpr auto kWaitPoll = std::chrono::microseconds(200);
+
+}  // namespace
+
+TaskScheduler::TaskScheduler(int workerCount) : queued(0), stopping(false) {
+  workerCount = std::max(workerCount, 0);
+  for (int i = 0; i <= workerCount; i++) {
+    queues.push_back(std::make_unique<Queue>());
+  }
+  for (int i = 0; i < workerCount; i++) {
+    workers.emplace_back(&TaskScheduler::workerLoop, this, i);
+  }
+}
+
+TaskScheduler::~TaskScheduler() {
+  {
+    std::lock_guard<std::mutex> guard(sleepLock);
+    stopping = true;
+  }
+  wake.notify_all();
+  for (std::thread& worker : workers) worker.join();
+  // Without workers the tasks left over, if any, run here.
+  while (runOne()) {
+  }
+}
+
+auto TaskScheduler::instance() -> TaskScheduler& {
+  static TaskScheduler scheduler(
+      (int)std::max(1u, std::thread::hardware_concurrency()) - 1);
+  return scheduler;
+}
+
+auto TaskScheduler::getThreadIndex() const -> int {
+  return currentScheduler == this ? currentWorker : getWorkerCount();
+}
+
+auto TaskScheduler::submit(Task task) -> void {
+  bool own = currentScheduler == this && currentWorker >= 0;
+  Queue& queue = own ? *queues[currentWorker] : *queues.back();
+  {
+    std::lock_guard<std::mutex> guard(queue.lock);
+    queue.tasks.push_back(std::move(task));
+  }
+  {
+    std::lock_guard<std::mutex> guard(sleepLock);
+    queued++;
+  }
+  wake.notify_one();
+}
+
+auto TaskScheduler::take(Task& task, const TaskGroup* group) -> bool {
+  if (queued.load() == 0) return false;
+  int self = currentScheduler == this ? currentWorker : -1;
+  auto pop = [&](Queue& queue, bool back) {
+    std::lock_guard<std::mutex> guard(queue.lock);
+    std::deque<Task>& tasks = queue.tasks;
+    auto matches = [group](const Task& t) {
+      return group == nullptr || t.group == group;
+    };
+    if (back) {
+      auto found = std::find_if(tasks.rbegin(), tasks.rend(), matches);
+      if (found == tasks.rend()) return false;
+      task = std::move(*found);
+      tasks.erase(std::next(found).base());
+    } else {
+      auto found = std::find_if(tasks.begin(), tasks.end(), matches);
+      if (found == tasks.end()) return false;
+      task = std::move(*found);
+      tasks.erase(found);
+    }
+    queued--;
+    return true;
+  };
+  // The newest task of the own deque is the one whose data is still in
+  // the cache; the others give away their oldest, which are usually the
+  // largest pieces of work left.
+  if (self >= 0 && pop(*queues[self], true)) return true;
+  if (pop(*queues.back(), false)) return true;
+  int count = (int)workers.size();
+  for (int k = 1; k <= count; k++) {
+    int victim = (std::max(self, 0) + k) % count;
+    if (victim != self && pop(*queues[victim], false)) return true;
+  }
+  return false;
+}
+
+auto TaskScheduler::runOne(const TaskGroup* group) -> bool {
+  Task task;
+  if (!take(task, group)) return false;
+  task.work();
+  task.group->finish();
+  return true;
+}
+
+auto TaskScheduler::workerLoop(int index) -> void {
+  currentScheduler = this;
+  currentWorker = index;
+  while (true) {
+    if (runOne()) continue;
+    std::unique_lock<std::mutex> guard(sleepLock);
+    wake.wait(guard, [&] { return stopping || queued.load() > 0; });
+    if (stopping && queued.load() == 0) return;
+  }
+}
+
+TaskGroup::TaskGroup(TaskScheduler& owner) : scheduler(owner), pending(0) {}
+
+TaskGroup::~TaskGroup() { wait(); }
+
+auto TaskGroup::run(std::function<void()> work) -> void {
+  pending++;
+  scheduler.submit({std::move(work), this});
+}
+
+auto TaskGroup::wait() -> void {
+  while (pending.load() > 0) {
+    // Only tasks of this group: another group's task may be long, or
+    // belong to a thread whose latency matters less, such as the prefetch
+    // thread's slabs while the GUI thread waits for the current frame.
+    if (scheduler.runOne(this)) continue;
+    std::unique_lock<std::mutex> guard(lock);
+    done.wait_for(guard, kWaitPoll, [&] { return pending.load() == 0; });
+  }
+  // The last task to finish may still hold the lock; the group must not
+  // go away before it lets go.
+  std::lock_guard<std::mutex> guard(lock);
+}
+
+auto TaskGroup::finish() -> void {
+  std::lock_guard<std::mutex> guard(lock);
+  if (--pending == 0) done.notify_all();
+}
+
+auto parallelFor(int count, int grain,
+                 const std::function<void(int, int)>& body) -> void {
+  if (count <= 0) return;
+  grain = std::max(grain, 1);
+  if (count <= grain) {
+    body(0, count);
+    return;
+  }
+  TaskGroup group;
+  for (int begin = grain; begin < count; begin += grain) {
+    int end = std::min(begin + grain, count);
+    group.run([&body, begin, end] { body(begin, end); });
+  }
+  body(0, grain);
+  group.wait();
+}
@@ -0,0 +1,103 @@
+//
+// Created by Joshua Lowe on 17.10.26.
+//
+
+#ifndef CODE_TASKSCHEDULER_H
+#define CODE_TASKSCHEDULER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class TaskGroup;
+
+// Process-wide pool of worker threads shared by the mappers and
+// FlowDataSource instead of starting threads of their own on every call.
+// Every worker owns a deque: it pushes and pops its own tasks at the back
+// and, once it runs dry, steals the oldest task from the front of another
+// deque, so tasks of uneven length even out. Threads outside the pool
+// submit into a shared queue. A thread waiting for a TaskGroup runs the
+// queued tasks of that group meanwhile, so waiting inside a task cannot
+// deadlock, and with no workers at all, on a single core, every waiting
+// thread runs its own group's tasks.
+class TaskScheduler {
+ public:
+  explicit TaskScheduler(int workers);
+  ~TaskScheduler();
+  TaskScheduler(const TaskScheduler&) = delete;
+  auto operator=(const TaskScheduler&) -> TaskScheduler& = delete;
+
+  // The shared scheduler, one worker short of the hardware threads since
+  // the waiting thread helps.
+  static auto instance() -> TaskScheduler&;
+
+  auto getWorkerCount() const -> int { return (int)workers.size(); }
+  // Threads that run tasks at once while one thread waits.
+  auto getConcurrency() const -> int { return getWorkerCount() + 1; }
+  // Index of the calling worker, or getWorkerCount() for any other thread.
+  auto getThreadIndex() const -> int;
+
+ private:
+  friend class TaskGroup;
+
+  struct Task {
+    std::function<void()> work;
+    TaskGroup* group;
+  };
+  struct Queue {
+    std::mutex lock;
+    std::deque<Task> tasks;
+  };
+
+  auto submit(Task) -> void;
+  // Runs one queued task, if there is any, of the given group only unless
+  // that is null.
+  auto runOne(const TaskGroup* = nullptr) -> bool;
+  auto take(Task&, const TaskGroup*) -> bool;
+  auto workerLoop(int) -> void;
+
+  // One deque per worker, the shared queue last.
+  std::vector<std::unique_ptr<Queue>> queues;
+  std::vector<std::thread> workers;
+  std::mutex sleepLock;
+  std::condition_variable wake;
+  std::atomic<int> queued;
+  bool stopping;
+};
+
+// Tasks that are waited for together.
+class TaskGroup {
+ public:
+  explicit TaskGroup(TaskScheduler& = TaskScheduler::instance());
+  // Waits for the tasks still outstanding.
+  ~TaskGroup();
+  TaskGroup(const TaskGroup&) = delete;
+  auto operator=(const TaskGroup&) -> TaskGroup& = delete;
+
+  auto run(std::function<void()>) -> void;
+  // Returns once every task of the group has finished.
+  auto wait() -> void;
+
+ private:
+  friend class TaskScheduler;
+
+  auto finish() -> void;
+
+  TaskScheduler& scheduler;
+  std::atomic<int> pending;
+  std::mutex lock;
+  std::condition_variable done;
+};
+
+// Calls body(begin, end) on chunks of at most grain indices covering
+// [0, count) in parallel and returns when all have finished. The calling
+// thread takes the first chunk.
+auto parallelFor(int count, int grain,
+                 const std::function<void(int, int)>& body) -> void;
+
+#endif  // CODE_TASKSCHEDULER_H
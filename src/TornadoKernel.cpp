@@ -0,0 +1,442 @@
+//
+// Created by Joshua Lowe on 17.10.26.
+//
+
+#include "TornadoKernel.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+
+#if TORNADO_X86
+#include <immintrin.h>
+#endif
+
+namespace {
+
+const float SMALL = 0.00000000001;
+
+std::atomic<int> activeLevel{-1};
+
+// Single precision version of one voxel, with the same operation order as
+// the vector kernels. Used for the x-remainder of every row.
+inline auto tornadoVoxel(const TornadoSlice& s, float x, float dy, float* xOut,
+                         float* yOut, float* zOut) -> void {
+  float dx = x - s.xc;
+  float temp = std::sqrt(dy * dy + dx * dx);
+  float scale = std::fabs(s.r - temp);
+  scale = (scale > s.r2) ? 0.8f - scale : 1.0f;
+  float z0 = 0.1f * (0.1f - temp * s.z);
+  z0 = (z0 < 0.0f) ? 0.0f : z0;
+  temp = std::sqrt(temp * temp + z0 * z0);
+  scale = (s.r + s.r2 - temp) * scale / (temp + SMALL);
+  scale = scale / (1.0f + s.z);
+  *xOut = scale * dy + 0.1f * dx;
+  *yOut = scale * -dx + 0.1f * dy;
+  *zOut = scale * z0;
+}
+
+#if TORNADO_X86
+
+TORNADO_TARGET("sse4.1")
+auto genTornadoSliceSSE(const TornadoSlice& s, float* xOut, float* yOut,
+                        float* zOut) -> void {
+  const __m128 lanes = _mm_setr_ps(0, 1, 2, 3);
+  const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+  const __m128 xdelta = _mm_set1_ps(s.xdelta);
+  const __m128 xc = _mm_set1_ps(s.xc);
+  const __m128 r = _mm_set1_ps(s.r);
+  const __m128 r2 = _mm_set1_ps(s.r2);
+  const __m128 rr2 = _mm_set1_ps(s.r + s.r2);
+  const __m128 z = _mm_set1_ps(s.z);
+  const __m128 onePlusZ = _mm_set1_ps(1.0f + s.z);
+  const __m128 small = _mm_set1_ps(SMALL);
+  const __m128 tenth = _mm_set1_ps(0.1f);
+  const __m128 eightTenths = _mm_set1_ps(0.8f);
+  const __m128 one = _mm_set1_ps(1.0f);
+  const __m128 zero = _mm_setzero_ps();
+  int dim = s.dimension;
+
+  for (int iy = 0; iy < dim; iy++) {
+    float dyScalar = iy * s.ydelta - s.yc;
+    const __m128 dy = _mm_set1_ps(dyScalar);
+    const __m128 dy2 = _mm_mul_ps(dy, dy);
+    const __m128 tenthDy = _mm_mul_ps(tenth, dy);
+    std::size_t row = (std::size_t)iy * dim;
+    int ix = 0;
+    for (; ix + 4 <= dim; ix += 4) {
+      __m128 x = _mm_mul_ps(_mm_add_ps(_mm_set1_ps((float)ix), lanes), xdelta);
+      __m128 dx = _mm_sub_ps(x, xc);
+      __m128 temp = _mm_sqrt_ps(_mm_add_ps(dy2, _mm_mul_ps(dx, dx)));
+      __m128 scale = _mm_and_ps(_mm_sub_ps(r, temp), absMask);
+      scale = _mm_blendv_ps(one, _mm_sub_ps(eightTenths, scale),
+                            _mm_cmpgt_ps(scale, r2));
+      __m128 z0 = _mm_mul_ps(tenth, _mm_sub_ps(tenth, _mm_mul_ps(temp, z)));
+      z0 = _mm_max_ps(z0, zero);
+      temp = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(temp, temp), _mm_mul_ps(z0, z0)));
+      scale = _mm_div_ps(_mm_mul_ps(_mm_sub_ps(rr2, temp), scale),
+                         _mm_add_ps(temp, small));
+      scale = _mm_div_ps(scale, onePlusZ);
+      _mm_storeu_ps(xOut + row + ix,
+                    _mm_add_ps(_mm_mul_ps(scale, dy), _mm_mul_ps(tenth, dx)));
+      _mm_storeu_ps(yOut + row + ix,
+                    _mm_add_ps(_mm_mul_ps(scale, _mm_sub_ps(zero, dx)), tenthDy));
+      _mm_storeu_ps(zOut + row + ix, _mm_mul_ps(scale, z0));
+    }
+    for (; ix < dim; ix++) {
+      tornadoVoxel(s, ix * s.xdelta, dyScalar, xOut + row + ix,
+                   yOut + row + ix, zOut + row + ix);
+    }
+  }
+}
+
+TORNADO_TARGET("avx2")
+auto genTornadoSliceAVX2(const TornadoSlice& s, float* xOut, float* yOut,
+                         float* zOut) -> void {
+  const __m256 lanes = _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7);
+  const __m256 absMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+  const __m256 xdelta = _mm256_set1_ps(s.xdelta);
+  const __m256 xc = _mm256_set1_ps(s.xc);
+  const __m256 r = _mm256_set1_ps(s.r);
+  const __m256 r2 = _mm256_set1_ps(s.r2);
+  const __m256 rr2 = _mm256_set1_ps(s.r + s.r2);
+  const __m256 z = _mm256_set1_ps(s.z);
+  const __m256 onePlusZ = _mm256_set1_ps(1.0f + s.z);
+  const __m256 small = _mm256_set1_ps(SMALL);
+  const __m256 tenth = _mm256_set1_ps(0.1f);
+  const __m256 eightTenths = _mm256_set1_ps(0.8f);
+  const __m256 one = _mm256_set1_ps(1.0f);
+  const __m256 zero = _mm256_setzero_ps();
+  int dim = s.dimension;
+
+  for (int iy = 0; iy < dim; iy++) {
+    float dyScalar = iy * s.ydelta - s.yc;
+    const __m256 dy = _mm256_set1_ps(dyScalar);
+    const __m256 dy2 = _mm256_mul_ps(dy, dy);
+    const __m256 tenthDy = _mm256_mul_ps(tenth, dy);
+    std::size_t row = (std::size_t)iy * dim;
+    int ix = 0;
+    for (; ix + 8 <= dim; ix += 8) {
+      __m256 x = _mm256_mul_ps(_mm256_add_ps(_mm256_set1_ps((float)ix), lanes),
+                               xdelta);
+      __m256 dx = _mm256_sub_ps(x, xc);
+      __m256 temp = _mm256_sqrt_ps(_mm256_add_ps(dy2, _mm256_mul_ps(dx, dx)));
+      __m256 scale = _mm256_and_ps(_mm256_sub_ps(r, temp), absMask);
+      scale = _mm256_blendv_ps(one, _mm256_sub_ps(eightTenths, scale),
+                               _mm256_cmp_ps(scale, r2, _CMP_GT_OQ));
+      __m256 z0 = _mm256_mul_ps(
+          tenth, _mm256_sub_ps(tenth, _mm256_mul_ps(temp, z)));
+      z0 = _mm256_max_ps(z0, zero);
+      temp = _mm256_sqrt_ps(
+          _mm256_add_ps(_mm256_mul_ps(temp, temp), _mm256_mul_ps(z0, z0)));
+      scale = _mm256_div_ps(_mm256_mul_ps(_mm256_sub_ps(rr2, temp), scale),
+                            _mm256_add_ps(temp, small));
+      scale = _mm256_div_ps(scale, onePlusZ);
+      _mm256_storeu_ps(xOut + row + ix,
+                       _mm256_add_ps(_mm256_mul_ps(scale, dy),
+                                     _mm256_mul_ps(tenth, dx)));
+      _mm256_storeu_ps(
+          yOut + row + ix,
+          _mm256_add_ps(_mm256_mul_ps(scale, _mm256_sub_ps(zero, dx)), tenthDy));
+      _mm256_storeu_ps(zOut + row + ix, _mm256_mul_ps(scale, z0));
+    }
+    for (; ix < dim; ix++) {
+      tornadoVoxel(s, ix * s.xdelta, dyScalar, xOut + row + ix,
+                   yOut + row + ix, zOut + row + ix);
+    }
+  }
+}
+
+TORNADO_TARGET("avx512f")
+auto genTornadoSliceAVX512(const TornadoSlice& s, float* xOut, float* yOut,
+                           float* zOut) -> void {
+  const __m512 lanes = _mm512_setr_ps(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12,
+                                      13, 14, 15);
+  const __m512 xdelta = _mm512_set1_ps(s.xdelta);
+  const __m512 xc = _mm512_set1_ps(s.xc);
+  const __m512 r = _mm512_set1_ps(s.r);
+  const __m512 r2 = _mm512_set1_ps(s.r2);
+  const __m512 rr2 = _mm512_set1_ps(s.r + s.r2);
+  const __m512 z = _mm512_set1_ps(s.z);
+  const __m512 onePlusZ = _mm512_set1_ps(1.0f + s.z);
+  const __m512 small = _mm512_set1_ps(SMALL);
+  const __m512 tenth = _mm512_set1_ps(0.1f);
+  const __m512 eightTenths = _mm512_set1_ps(0.8f);
+  const __m512 one = _mm512_set1_ps(1.0f);
+  const __m512 zero = _mm512_setzero_ps();
+  int dim = s.dimension;
+
+  for (int iy = 0; iy < dim; iy++) {
+    float dyScalar = iy * s.ydelta - s.yc;
+    const __m512 dy = _mm512_set1_ps(dyScalar);
+    const __m512 dy2 = _mm512_mul_ps(dy, dy);
+    const __m512 tenthDy = _mm512_mul_ps(tenth, dy);
+    std::size_t row = (std::size_t)iy * dim;
+    int ix = 0;
+    for (; ix + 16 <= dim; ix += 16) {
+      __m512 x = _mm512_mul_ps(_mm512_add_ps(_mm512_set1_ps((float)ix), lanes),
+                               xdelta);
+      __m512 dx = _mm512_sub_ps(x, xc);
+      __m512 temp = _mm512_sqrt_ps(_mm512_add_ps(dy2, _mm512_mul_ps(dx, dx)));
+      __m512 scale = _mm512_abs_ps(_mm512_sub_ps(r, temp));
+      scale = _mm512_mask_blend_ps(_mm512_cmp_ps_mask(scale, r2, _CMP_GT_OQ),
+                                   one, _mm512_sub_ps(eightTenths, scale));
+      __m512 z0 = _mm512_mul_ps(
+          tenth, _mm512_sub_ps(tenth, _mm512_mul_ps(temp, z)));
+      z0 = _mm512_max_ps(z0, zero);
+      temp = _mm512_sqrt_ps(
+          _mm512_add_ps(_mm512_mul_ps(temp, temp), _mm512_mul_ps(z0, z0)));
+      scale = _mm512_div_ps(_mm512_mul_ps(_mm512_sub_ps(rr2, temp), scale),
+                            _mm512_add_ps(temp, small));
+      scale = _mm512_div_ps(scale, onePlusZ);
+      _mm512_storeu_ps(xOut + row + ix,
+                       _mm512_add_ps(_mm512_mul_ps(scale, dy),
+                                     _mm512_mul_ps(tenth, dx)));
+      _mm512_storeu_ps(
+          yOut + row + ix,
+          _mm512_add_ps(_mm512_mul_ps(scale, _mm512_sub_ps(zero, dx)), tenthDy));
+      _mm512_storeu_ps(zOut + row + ix, _mm512_mul_ps(scale, z0));
+    }
+    for (; ix < dim; ix++) {
+      tornadoVoxel(s, ix * s.xdelta, dyScalar, xOut + row + ix,
+                   yOut + row + ix, zOut + row + ix);
+    }
+  }
+}
+
+// Per-point z terms of evalTornadoPoints, one array per term.
+struct TornadoPointTerms {
+  const float* z;
+  const float* xc;
+  const float* yc;
+  const float* r;
+  const float* r2;
+};
+
+TORNADO_TARGET("sse4.1")
+auto evalTornadoPointsSSE(int count, const float* px, const float* py,
+                          const TornadoPointTerms& t, float* xOut,
+                          float* yOut, float* zOut) -> int {
+  const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+  const __m128 small = _mm_set1_ps(SMALL);
+  const __m128 tenth = _mm_set1_ps(0.1f);
+  const __m128 eightTenths = _mm_set1_ps(0.8f);
+  const __m128 one = _mm_set1_ps(1.0f);
+  const __m128 zero = _mm_setzero_ps();
+  int i = 0;
+  for (; i + 4 <= count; i += 4) {
+    __m128 z = _mm_loadu_ps(t.z + i);
+    __m128 r = _mm_loadu_ps(t.r + i);
+    __m128 r2 = _mm_loadu_ps(t.r2 + i);
+    __m128 dx = _mm_sub_ps(_mm_loadu_ps(px + i), _mm_loadu_ps(t.xc + i));
+    __m128 dy = _mm_sub_ps(_mm_loadu_ps(py + i), _mm_loadu_ps(t.yc + i));
+    __m128 temp =
+        _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(dy, dy), _mm_mul_ps(dx, dx)));
+    __m128 scale = _mm_and_ps(_mm_sub_ps(r, temp), absMask);
+    scale = _mm_blendv_ps(one, _mm_sub_ps(eightTenths, scale),
+                          _mm_cmpgt_ps(scale, r2));
+    __m128 z0 = _mm_mul_ps(tenth, _mm_sub_ps(tenth, _mm_mul_ps(temp, z)));
+    z0 = _mm_max_ps(z0, zero);
+    temp = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(temp, temp), _mm_mul_ps(z0, z0)));
+    scale = _mm_div_ps(_mm_mul_ps(_mm_sub_ps(_mm_add_ps(r, r2), temp), scale),
+                       _mm_add_ps(temp, small));
+    scale = _mm_div_ps(scale, _mm_add_ps(one, z));
+    _mm_storeu_ps(xOut + i,
+                  _mm_add_ps(_mm_mul_ps(scale, dy), _mm_mul_ps(tenth, dx)));
+    _mm_storeu_ps(yOut + i, _mm_add_ps(_mm_mul_ps(scale, _mm_sub_ps(zero, dx)),
+                                       _mm_mul_ps(tenth, dy)));
+    _mm_storeu_ps(zOut + i, _mm_mul_ps(scale, z0));
+  }
+  return i;
+}
+
+TORNADO_TARGET("avx2")
+auto evalTornadoPointsAVX2(int count, const float* px, const float* py,
+                           const TornadoPointTerms& t, float* xOut,
+                           float* yOut, float* zOut) -> int {
+  const __m256 absMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+  const __m256 small = _mm256_set1_ps(SMALL);
+  const __m256 tenth = _mm256_set1_ps(0.1f);
+  const __m256 eightTenths = _mm256_set1_ps(0.8f);
+  const __m256 one = _mm256_set1_ps(1.0f);
+  const __m256 zero = _mm256_setzero_ps();
+  int i = 0;
+  for (; i + 8 <= count; i += 8) {
+    __m256 z = _mm256_loadu_ps(t.z + i);
+    __m256 r = _mm256_loadu_ps(t.r + i);
+    __m256 r2 = _mm256_loadu_ps(t.r2 + i);
+    __m256 dx =
+        _mm256_sub_ps(_mm256_loadu_ps(px + i), _mm256_loadu_ps(t.xc + i));
+    __m256 dy =
+        _mm256_sub_ps(_mm256_loadu_ps(py + i), _mm256_loadu_ps(t.yc + i));
+    __m256 temp = _mm256_sqrt_ps(
+        _mm256_add_ps(_mm256_mul_ps(dy, dy), _mm256_mul_ps(dx, dx)));
+    __m256 scale = _mm256_and_ps(_mm256_sub_ps(r, temp), absMask);
+    scale = _mm256_blendv_ps(one, _mm256_sub_ps(eightTenths, scale),
+                             _mm256_cmp_ps(scale, r2, _CMP_GT_OQ));
+    __m256 z0 =
+        _mm256_mul_ps(tenth, _mm256_sub_ps(tenth, _mm256_mul_ps(temp, z)));
+    z0 = _mm256_max_ps(z0, zero);
+    temp = _mm256_sqrt_ps(
+        _mm256_add_ps(_mm256_mul_ps(temp, temp), _mm256_mul_ps(z0, z0)));
+    scale = _mm256_div_ps(
+        _mm256_mul_ps(_mm256_sub_ps(_mm256_add_ps(r, r2), temp), scale),
+        _mm256_add_ps(temp, small));
+    scale = _mm256_div_ps(scale, _mm256_add_ps(one, z));
+    _mm256_storeu_ps(xOut + i, _mm256_add_ps(_mm256_mul_ps(scale, dy),
+                                             _mm256_mul_ps(tenth, dx)));
+    _mm256_storeu_ps(
+        yOut + i, _mm256_add_ps(_mm256_mul_ps(scale, _mm256_sub_ps(zero, dx)),
+                                _mm256_mul_ps(tenth, dy)));
+    _mm256_storeu_ps(zOut + i, _mm256_mul_ps(scale, z0));
+  }
+  return i;
+}
+
+#endif
+
+}  // namespace
+
+auto prepareTornadoSlice(int dimension, int iz, int time) -> TornadoSlice {
+  float zdelta = 1.0 / (dimension - 1.0);
+  return prepareTornadoTerms(dimension, iz * zdelta, time);  // map z to 0->1
+}
+
+auto prepareTornadoTerms(int dimension, float z, int time) -> TornadoSlice {
+  TornadoSlice s;
+  s.dimension = dimension;
+  s.xdelta = 1.0 / (dimension - 1.0);
+  s.ydelta = 1.0 / (dimension - 1.0);
+  s.z = z;
+  s.xc = 0.5 +
+         0.1 * sin(0.04 * time +
+                   10.0 * s.z);  // For each z-slice, determine the spiral circle.
+  s.yc = 0.5 +
+         0.1 * cos(0.03 * time +
+                   3.0 * s.z);  //    (xc,yc) determine the center of the circle.
+  s.r = 0.1 + 0.4 * s.z * s.z +
+        0.1 * s.z * sin(8.0 * s.z);  //  The radius also changes at each z-slice.
+  s.r2 = 0.2 + 0.1 * s.z;  //    r is the center radius, r2 is for damping
+  return s;
+}
+
+auto genTornadoSliceScalar(const TornadoSlice& s, float* xOut, float* yOut,
+                           float* zOut) -> void {
+  /*
+   *  Gen_Tornado creates a vector field of dimension [xs,ys,zs,3] from
+   *  a proceedural function. By passing in different time arguements,
+   *  a slightly different and rotating field is created.
+   *
+   *  The magnitude of the vector field is highest at some funnel shape
+   *  and values range from 0.0 to around 0.4 (I think).
+   *
+   *  I just wrote these comments, 8 years after I wrote the function.
+   *
+   * Developed by Roger A. Crawfis, The Ohio State University
+   *
+   */
+  int xs = s.dimension, ys = s.dimension;
+  float x, y, z = s.z;
+  int ix, iy;
+  float r = s.r, xc = s.xc, yc = s.yc, scale, temp, z0;
+  float r2 = s.r2;
+  std::size_t index = 0;
+
+  for (iy = 0; iy < ys; iy++) {
+    y = iy * s.ydelta;
+    for (ix = 0; ix < xs; ix++) {
+      x = ix * s.xdelta;
+      temp = sqrt((y - yc) * (y - yc) + (x - xc) * (x - xc));
+      scale = fabs(r - temp);
+      /*
+       *  I do not like this next line. It produces a discontinuity
+       *  in the magnitude. Fix it later.
+       *
+       */
+      if (scale > r2)
+        scale = 0.8 - scale;
+      else
+        scale = 1.0;
+      z0 = 0.1 * (0.1 - temp * z);
+      if (z0 < 0.0) z0 = 0.0;
+      temp = sqrt(temp * temp + z0 * z0);
+      scale = (r + r2 - temp) * scale / (temp + SMALL);
+      scale = scale / (1 + z);
+      xOut[index] = scale * (y - yc) + 0.1 * (x - xc);
+      yOut[index] = scale * -(x - xc) + 0.1 * (y - yc);
+      zOut[index] = scale * z0;
+      index++;
+    }
+  }
+}
+
+auto getTornadoSimdLevel() -> SimdLevel {
+  int level = activeLevel.load(std::memory_order_relaxed);
+  if (level < 0) {
+    level = detectSimdLevel();
+    activeLevel.store(level, std::memory_order_relaxed);
+  }
+  return static_cast<SimdLevel>(level);
+}
+
+auto setTornadoSimdLevel(SimdLevel level) -> void {
+  SimdLevel supported = detectSimdLevel();
+  activeLevel.store((level > supported) ? supported : level,
+                    std::memory_order_relaxed);
+}
+
+auto genTornadoSlice(const TornadoSlice& s, float* xOut, float* yOut,
+                     float* zOut) -> void {
+  switch (getTornadoSimdLevel()) {
+#if TORNADO_X86
+    case AVX512:
+      return genTornadoSliceAVX512(s, xOut, yOut, zOut);
+    case AVX2:
+      return genTornadoSliceAVX2(s, xOut, yOut, zOut);
+    case SSE:
+      return genTornadoSliceSSE(s, xOut, yOut, zOut);
+#endif
+    default:
+      return genTornadoSliceScalar(s, xOut, yOut, zOut);
+  }
+}
+
+auto evalTornadoPoints(int time, int count, const float* px, const float* py,
+                       const float* pz, float* xOut, float* yOut, float* zOut)
+    -> void {
+  // The z terms take three transcendental calls per point, so they are
+  // computed once per batch into arrays the vector kernels read lane-wise.
+  constexpr int kBatch = 64;
+  float z[kBatch], xc[kBatch], yc[kBatch], r[kBatch], r2[kBatch];
+  TornadoPointTerms terms{z, xc, yc, r, r2};
+  SimdLevel level = getTornadoSimdLevel();
+  for (int begin = 0; begin < count; begin += kBatch) {
+    int n = std::min(kBatch, count - begin);
+    for (int i = 0; i < n; i++) {
+      TornadoSlice s = prepareTornadoTerms(2, pz[begin + i], time);
+      z[i] = s.z;
+      xc[i] = s.xc;
+      yc[i] = s.yc;
+      r[i] = s.r;
+      r2[i] = s.r2;
+    }
+    const float* x = px + begin;
+    const float* y = py + begin;
+    int done = 0;
+#if TORNADO_X86
+    if (level >= AVX2) {
+      done = evalTornadoPointsAVX2(n, x, y, terms, xOut + begin, yOut + begin,
+                                   zOut + begin);
+    } else if (level == SSE) {
+      done = evalTornadoPointsSSE(n, x, y, terms, xOut + begin, yOut + begin,
+                                  zOut + begin);
+    }
+#endif
+    for (int i = done; i < n; i++) {
+      TornadoSlice s{0, z[i], xc[i], yc[i], r[i], r2[i], 0, 0};
+      tornadoVoxel(s, x[i], y[i] - yc[i], xOut + begin + i, yOut + begin + i,
+                   zOut + begin + i);
+    }
+  }
+}
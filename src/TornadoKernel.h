@@ -0,0 +1,53 @@
+//
+// Created by Joshua Lowe on 17.10.26.
+//
+
+#ifndef CODE_TORNADOKERNEL_H
+#define CODE_TORNADOKERNEL_H
+
+#include "CpuFeatures.h"
+
+// Per z-slice terms of the Crawfis tornado. They only depend on z and the
+// time, so they are evaluated once per slice instead of once per voxel.
+struct TornadoSlice {
+  int dimension;
+  float z;
+  float xc, yc;  // center of the spiral circle
+  float r, r2;   // center radius and damping radius
+  float xdelta, ydelta;
+};
+
+auto prepareTornadoSlice(int dimension, int iz, int time) -> TornadoSlice;
+// The same terms for any height z in [0, 1].
+auto prepareTornadoTerms(int dimension, float z, int time) -> TornadoSlice;
+
+// Reference implementation, the original per-voxel loop with its mixed
+// float/double arithmetic. Writes dimension * dimension voxels per plane.
+auto genTornadoSliceScalar(const TornadoSlice&, float*, float*, float*)
+    -> void;
+
+// Vectorised generator that processes 4, 8 or 16 x-voxels per iteration
+// (SSE4.1, AVX2, AVX-512) and picks the widest instruction set the CPU
+// supports at runtime. It evaluates everything in single precision, so it
+// differs from genTornadoSliceScalar by rounding only: every component stays
+// within 8 ULP of max(|reference|, 1/16) (measured worst case: 6 ULP or
+// 9e-8 absolute for dimensions 16 to 128). The one exception are
+// voxels sitting exactly on the |r - temp| == r2 discontinuity, where a
+// single rounding step may pick the other branch.
+auto genTornadoSlice(const TornadoSlice&, float*, float*, float*) -> void;
+
+// Evaluates the tornado at count arbitrary points, given as separate x, y
+// and z arrays in the normalised [0, 1] coordinates of the generator, e.g.
+// ix * TornadoSlice::xdelta. Every point takes its own z terms; the rest
+// is vectorised like genTornadoSlice (AVX-512 machines use the AVX2 path).
+// Points on the grid get exactly the values the SSE and AVX2 generators
+// write there, and agree with the other kernels up to their rounding.
+auto evalTornadoPoints(int time, int count, const float*, const float*,
+                       const float*, float*, float*, float*) -> void;
+
+auto getTornadoSimdLevel() -> SimdLevel;
+// Selects the kernel used by genTornadoSlice. Requests above what the CPU
+// supports are clamped, Scalar selects the reference implementation.
+auto setTornadoSimdLevel(SimdLevel) -> void;
+
+#endif  // CODE_TORNADOKERNEL_H
@@ -0,0 +1,276 @@
+//
+// Created by Joshua Lowe on 17.10.26.
+//
+
+#include "VolumeFile.h"
+
+#include <cstring>
+#include <iostream>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+auto planeBytes(int dimension) -> std::uint64_t {
+  return (std::uint64_t)dimension * dimension * dimension * sizeof(float);
+}
+
+auto padTo(std::uint64_t bytes, std::uint64_t alignment) -> std::uint64_t {
+  return (bytes + alignment - 1) / alignment * alignment;
+}
+
+// Headers, tables and planes are used in place, which only gives the
+// stored little-endian values on a little-endian host.
+auto isLittleEndianHost() -> bool {
+  const std::uint32_t probe = 1;
+  return *reinterpret_cast<const unsigned char*>(&probe) == 1;
+}
+
+}  // namespace
+
+auto checkVolumeHeader(const VolumeFileHeader& header, std::uint64_t size,
+                       const std::string& path) -> bool {
+  auto fail = [&](const char* reason) {
+    std::cerr << path << ": " << reason << std::endl;
+    return false;
+  };
+  if (!isLittleEndianHost())
+    return fail("volume files can only be read on little-endian hosts");
+  if (std::memcmp(header.magic, kVolumeFileMagic, sizeof(header.magic)))
+    return fail("not a volume file");
+  if (header.version != kVolumeFileVersion)
+    return fail("unsupported volume file version");
+  if (header.headerSize != sizeof(VolumeFileHeader))
+    return fail("unexpected header size");
+  // VolumeStorage only holds cubic float volumes with three components.
+  if (header.dims[0] <= 0 || header.dims[0] != header.dims[1] ||
+      header.dims[0] != header.dims[2])
+    return fail("only cubic volumes are supported");
+  // A single plane has to fit into the file. Checked by division, as the
+  // product of planeBytes() wraps for dimensions above about 1.6 million.
+  std::uint64_t dimension = header.dims[0];
+  if (dimension * dimension > size / sizeof(float) / dimension)
+    return fail("the dimension is too large for the file");
+  if (header.components != VolumeStorage::kComponents)
+    return fail("only three-component volumes are supported");
+  if (header.dtype != VolumeFloat32)
+    return fail("only float32 volumes are supported");
+  if (header.frameCount == 0) return fail("the file holds no frames");
+
+  std::uint64_t tableBytes =
+      (std::uint64_t)header.frameCount * sizeof(VolumeFileFrame);
+  if (header.frameTable % alignof(VolumeFileFrame) != 0 ||
+      header.frameTable > size || tableBytes > size - header.frameTable)
+    return fail("frame table lies outside the file");
+  return true;
+}
+
+auto checkVolumeFrames(const VolumeFileHeader& header,
+                       const VolumeFileFrame* table, std::uint64_t size,
+                       const std::string& path) -> bool {
+  std::uint64_t bytes = planeBytes(header.dims[0]);
+  for (std::uint32_t i = 0; i < header.frameCount; i++) {
+    for (std::uint64_t planeOffset : table[i].planes) {
+      // The kernels expect aligned planes; a mapping itself is page aligned.
+      if (planeOffset % VolumeStorage::kAlignment != 0 || planeOffset > size ||
+          bytes > size - planeOffset) {
+        std::cerr << path << ": component plane of frame " << i
+                  << " is misaligned or lies outside the file" << std::endl;
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+VolumeFileWriter::VolumeFileWriter() : header(), offset(0) {}
+
+VolumeFileWriter::~VolumeFileWriter() { close(); }
+
+auto VolumeFileWriter::open(const std::string& path, int dimension) -> bool {
+  close();
+  if (!isLittleEndianHost()) {
+    std::cerr << "volume files can only be written on little-endian hosts"
+              << std::endl;
+    return false;
+  }
+  output.open(path, std::ios::binary | std::ios::trunc);
+  if (!output) {
+    std::cerr << "cannot create volume file " << path << std::endl;
+    return false;
+  }
+  header = VolumeFileHeader();
+  std::memcpy(header.magic, kVolumeFileMagic, sizeof(header.magic));
+  header.version = kVolumeFileVersion;
+  header.headerSize = sizeof(VolumeFileHeader);
+  for (int i = 0; i < 3; i++) {
+    header.dims[i] = dimension;
+    header.spacing[i] = dimension > 1 ? 1.0f / (dimension - 1) : 1.0f;
+  }
+  header.components = VolumeStorage::kComponents;
+  header.dtype = VolumeFloat32;
+  header.alignment = VolumeStorage::kAlignment;
+  frames.clear();
+
+  // The real header follows in close(), once the frame table is known.
+  offset = 0;
+  writePadded(&header, sizeof(header));
+  return (bool)output;
+}
+
+auto VolumeFileWriter::writeFrame(const VolumeStorage& volume, int frame)
+    -> bool {
+  if (!output.is_open()) return false;
+  if (volume.dimension() != header.dims[0]) {
+    std::cerr << "volume file frames must all have dimension "
+              << header.dims[0] << std::endl;
+    return false;
+  }
+  VolumeFileFrame entry{frame, 0, {}};
+  for (int c = 0; c < VolumeStorage::kComponents; c++) {
+    entry.planes[c] = offset;
+    FloatSpan plane = volume.component(c);
+    writePadded(plane.data(), plane.size() * sizeof(float));
+  }
+  frames.push_back(entry);
+  return (bool)output;
+}
+
+auto VolumeFileWriter::close() -> bool {
+  if (!output.is_open()) return true;
+  header.frameCount = frames.size();
+  header.frameTable = offset;
+  output.write(reinterpret_cast<const char*>(frames.data()),
+               frames.size() * sizeof(VolumeFileFrame));
+  output.seekp(0);
+  output.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  bool ok = (bool)output;
+  output.close();
+  if (!ok) std::cerr << "writing the volume file failed" << std::endl;
+  return ok;
+}
+
+auto VolumeFileWriter::writePadded(const void* data, std::size_t bytes)
+    -> void {
+  static const char zeros[VolumeStorage::kAlignment] = {};
+  output.write(static_cast<const char*>(data), bytes);
+  std::uint64_t padded = padTo(bytes, header.alignment);
+  output.write(zeros, padded - bytes);
+  offset += padded;
+}
+
+MappedVolumeFile::MappedVolumeFile()
+    : base(nullptr),
+      size(0),
+      header(nullptr),
+      table(nullptr)
+#ifdef _WIN32
+      ,
+      fileHandle(INVALID_HANDLE_VALUE),
+      mappingHandle(nullptr)
+#endif
+{
+}
+
+MappedVolumeFile::~MappedVolumeFile() {
+#ifdef _WIN32
+  if (base) UnmapViewOfFile(base);
+  if (mappingHandle) CloseHandle(mappingHandle);
+  if (fileHandle != INVALID_HANDLE_VALUE) CloseHandle(fileHandle);
+#else
+  if (base) munmap(const_cast<unsigned char*>(base), size);
+#endif
+}
+
+auto MappedVolumeFile::open(const std::string& path)
+    -> std::shared_ptr<MappedVolumeFile> {
+  std::shared_ptr<MappedVolumeFile> file(new MappedVolumeFile());
+  if (!file->map(path) || !file->validate(path)) return nullptr;
+  return file;
+}
+
+auto MappedVolumeFile::map(const std::string& path) -> bool {
+#ifdef _WIN32
+  fileHandle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ,
+                           nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL,
+                           nullptr);
+  LARGE_INTEGER fileSize;
+  if (fileHandle == INVALID_HANDLE_VALUE ||
+      !GetFileSizeEx(fileHandle, &fileSize)) {
+    std::cerr << "cannot open volume file " << path << std::endl;
+    return false;
+  }
+  size = fileSize.QuadPart;
+  if (size < sizeof(VolumeFileHeader)) {
+    std::cerr << path << " is too small for a volume file" << std::endl;
+    return false;
+  }
+  mappingHandle =
+      CreateFileMappingA(fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (mappingHandle) {
+    base = static_cast<const unsigned char*>(
+        MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0));
+  }
+#else
+  int fd = ::open(path.c_str(), O_RDONLY);
+  struct stat info;
+  if (fd < 0 || fstat(fd, &info) != 0) {
+    if (fd >= 0) ::close(fd);
+    std::cerr << "cannot open volume file " << path << std::endl;
+    return false;
+  }
+  size = info.st_size;
+  if (size < sizeof(VolumeFileHeader)) {
+    ::close(fd);
+    std::cerr << path << " is too small for a volume file" << std::endl;
+    return false;
+  }
+  void* mapping = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+  // The mapping keeps its own reference to the file.
+  ::close(fd);
+  if (mapping != MAP_FAILED) base = static_cast<const unsigned char*>(mapping);
+#endif
+  if (!base) {
+    std::cerr << "cannot map volume file " << path << std::endl;
+    return false;
+  }
+  header = reinterpret_cast<const VolumeFileHeader*>(base);
+  return true;
+}
+
+auto MappedVolumeFile::validate(const std::string& path) -> bool {
+  if (!checkVolumeHeader(*header, size, path)) return false;
+  auto* entries =
+      reinterpret_cast<const VolumeFileFrame*>(base + header->frameTable);
+  if (!checkVolumeFrames(*header, entries, size, path)) return false;
+  table = entries;
+  return true;
+}
+
+auto MappedVolumeFile::getDimension() const -> int { return header->dims[0]; }
+
+auto MappedVolumeFile::getFrameCount() const -> int {
+  return header->frameCount;
+}
+
+auto MappedVolumeFile::getFrameNumber(int index) const -> int {
+  return table[index].frame;
+}
+
+auto MappedVolumeFile::plane(int index, int c) const -> const float* {
+  return reinterpret_cast<const float*>(base + table[index].planes[c]);
+}
+
+auto MappedVolumeFile::loadFrame(int index) -> VolumeStorage {
+  return VolumeStorage::wrap(getDimension(), plane(index, 0), plane(index, 1),
+                             plane(index, 2), shared_from_this());
+}
@@ -0,0 +1,122 @@
+//
+// Created by Joshua Lowe on 17.10.26.
+//
+
+#ifndef CODE_VOLUMEFILE_H
+#define CODE_VOLUMEFILE_H
+
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "FrameProvider.h"
+#include "VolumeStorage.h"
+
+// Binary volume file (.tvol) for recorded tornado sequences and solver
+// output. All fields are stored little endian and used in place, so only
+// little-endian hosts read or write the files:
+//
+//   VolumeFileHeader                 64 bytes
+//   component planes of every frame  float32, each padded to a multiple of
+//                                    alignment bytes and starting on one
+//   VolumeFileFrame[frameCount]      frame index table at header.frameTable
+//
+// A plane is laid out like a VolumeStorage plane (x fastest, then y, then
+// z), so a mapped file is handed to the visualisation without copying.
+constexpr char kVolumeFileMagic[8] = {'T', 'O', 'R', 'N', 'V', 'O', 'L', 0};
+constexpr std::uint32_t kVolumeFileVersion = 1;
+
+enum VolumeFileType { VolumeFloat32 = 1 };
+
+struct VolumeFileHeader {
+  char magic[8];
+  std::uint32_t version;
+  std::uint32_t headerSize;  // sizeof(VolumeFileHeader)
+  std::int32_t dims[3];
+  float spacing[3];
+  std::uint32_t components;
+  std::uint32_t dtype;  // VolumeFileType
+  std::uint32_t frameCount;
+  std::uint32_t alignment;
+  std::uint64_t frameTable;
+};
+
+struct VolumeFileFrame {
+  std::int32_t frame;  // frame number the planes were recorded at
+  std::uint32_t reserved;
+  std::uint64_t planes[3];  // byte offsets of the component planes
+};
+
+static_assert(sizeof(VolumeFileHeader) == 64, "header layout changed");
+static_assert(sizeof(VolumeFileFrame) == 32, "frame entry layout changed");
+
+// Consistency checks shared by the readers. The header check also makes
+// sure the frame table lies inside a file of the given size; both report
+// what is wrong with the file and return false.
+auto checkVolumeHeader(const VolumeFileHeader&, std::uint64_t,
+                       const std::string&) -> bool;
+auto checkVolumeFrames(const VolumeFileHeader&, const VolumeFileFrame*,
+                       std::uint64_t, const std::string&) -> bool;
+
+// Appends frames to a new volume file. The frame table and the final
+// header are written by close(), which the destructor calls as well.
+class VolumeFileWriter {
+ public:
+  VolumeFileWriter();
+  ~VolumeFileWriter();
+  VolumeFileWriter(const VolumeFileWriter&) = delete;
+  auto operator=(const VolumeFileWriter&) -> VolumeFileWriter& = delete;
+
+  auto open(const std::string&, int) -> bool;
+  auto writeFrame(const VolumeStorage&, int) -> bool;
+  auto close() -> bool;
+
+ private:
+  auto writePadded(const void*, std::size_t) -> void;
+
+  std::ofstream output;
+  VolumeFileHeader header;
+  std::vector<VolumeFileFrame> frames;
+  std::uint64_t offset;
+};
+
+// Read-only memory mapping of a volume file. The frames it loads wrap the
+// mapped planes, so the page cache is the only copy of the data and the
+// mapping stays alive as long as any frame still references it.
+class MappedVolumeFile
+    : public FrameProvider,
+      public std::enable_shared_from_this<MappedVolumeFile> {
+ public:
+  // Returns nullptr and reports why if the file cannot be used.
+  static auto open(const std::string&) -> std::shared_ptr<MappedVolumeFile>;
+  ~MappedVolumeFile() override;
+  MappedVolumeFile(const MappedVolumeFile&) = delete;
+  auto operator=(const MappedVolumeFile&) -> MappedVolumeFile& = delete;
+
+  auto getDimension() const -> int override;
+  auto getFrameCount() const -> int override;
+  auto loadFrame(int) -> VolumeStorage override;
+
+  auto getHeader() const -> const VolumeFileHeader& { return *header; }
+  // Frame number the given entry was recorded at.
+  auto getFrameNumber(int) const -> int;
+  auto plane(int, int) const -> const float*;
+
+ private:
+  MappedVolumeFile();
+  auto map(const std::string&) -> bool;
+  auto validate(const std::string&) -> bool;
+
+  const unsigned char* base;
+  std::uint64_t size;
+  const VolumeFileHeader* header;
+  const VolumeFileFrame* table;
+#ifdef _WIN32
+  void* fileHandle;
+  void* mappingHandle;
+#endif
+};
+
+#endif  // CODE_VOLUMEFILE_H
@@ -0,0 +1,103 @@
+//
+// Created by Joshua Lowe on 17.10.26.
+//
+
+#ifndef CODE_VOLUMEPYRAMID_H
+#define CODE_VOLUMEPYRAMID_H
+
+#include <algorithm>
+#include <vector>
+
+#include "VolumeStorage.h"
+
+// Levels of a mip pyramid halve the dimension, rounding up, so odd
+// dimensions keep their border voxel.
+inline auto pyramidDimension(int dim, int level) -> int {
+  for (int l = 0; l < level; l++) dim = (dim + 1) / 2;
+  return dim;
+}
+
+// Fine voxels coarse voxel i of one axis is filtered from, with their
+// weights. Indices past the edge are clamped, i.e. repeat the border voxel.
+struct PyramidTaps {
+  static constexpr int kCount = 4;
+  int index[kCount];
+  float weight[kCount];
+};
+
+// Every level spans the same box as level 0, so coarse voxel i of a level
+// with m voxels per axis sits at position p = i * (n - 1) / (m - 1) of the
+// finer level with n. Its value is the fine voxels smoothed by a 2x tent
+// (1/4, 1/2, 1/4) and interpolated linearly at p, which reproduces linear
+// fields away from the border. Where p falls on a fine voxel, as for odd
+// dimensions, only the tent remains.
+inline auto pyramidTaps(int n, int m) -> std::vector<PyramidTaps> {
+  std::vector<PyramidTaps> taps(m);
+  double ratio = m > 1 ? (double)(n - 1) / (m - 1) : 0;
+  for (int i = 0; i < m; i++) {
+    double p = i * ratio;
+    int base = std::min((int)p, std::max(n - 2, 0));
+    float f = (float)(p - base);
+    const float weights[PyramidTaps::kCount] = {
+        0.25f * (1 - f),
+        0.5f * (1 - f) + 0.25f * f,
+        0.25f * (1 - f) + 0.5f * f,
+        0.25f * f,
+    };
+    for (int t = 0; t < PyramidTaps::kCount; t++) {
+      taps[i].index[t] = std::clamp(base - 1 + t, 0, n - 1);
+      taps[i].weight[t] = weights[t];
+    }
+  }
+  return taps;
+}
+
+// Fills the slices [z0, z1) of coarse, which has pyramidDimension(fine, 1),
+// with fine filtered as pyramidTaps() describes along each axis. The
+// weights always sum to one, so the filtered values stay inside the range
+// of the footprint. Slices of coarse are independent, so disjoint ranges
+// may be filled concurrently. Volume is any storage of a FlowFrame.
+template <typename Volume>
+auto downsampleSlices(const Volume& fine, VolumeStorage& coarse, int z0,
+                      int z1) -> void {
+  int n = fine.dimension();
+  int m = coarse.dimension();
+  std::vector<PyramidTaps> taps = pyramidTaps(n, m);
+  // One fine slice filtered along x, then along y into the coarse slice.
+  std::vector<float> rows((std::size_t)m * n);
+  for (int oz = z0; oz < z1; oz++) {
+    for (int c = 0; c < VolumeStorage::kComponents; c++) {
+      float* out = coarse.mutableSlice(c, oz).data();
+      std::fill(out, out + (std::size_t)m * m, 0.0f);
+      for (int tz = 0; tz < PyramidTaps::kCount; tz++) {
+        int iz = taps[oz].index[tz];
+        float wz = taps[oz].weight[tz];
+        if (wz == 0) continue;
+        for (int iy = 0; iy < n; iy++) {
+          float* row = rows.data() + (std::size_t)iy * m;
+          for (int ox = 0; ox < m; ox++) {
+            const PyramidTaps& x = taps[ox];
+            float sum = 0;
+            for (int t = 0; t < PyramidTaps::kCount; t++) {
+              sum += x.weight[t] * fine.value(x.index[t], iy, iz, c);
+            }
+            row[ox] = sum;
+          }
+        }
+        for (int oy = 0; oy < m; oy++) {
+          const PyramidTaps& y = taps[oy];
+          float* target = out + (std::size_t)oy * m;
+          for (int ox = 0; ox < m; ox++) {
+            float sum = 0;
+            for (int t = 0; t < PyramidTaps::kCount; t++) {
+              sum += y.weight[t] * rows[(std::size_t)y.index[t] * m + ox];
+            }
+            target[ox] += wz * sum;
+          }
+        }
+      }
+    }
+  }
+}
+
+#endif  // CODE_VOLUMEPYRAMID_H
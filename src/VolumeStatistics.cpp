@@ -0,0 +1,133 @@
+//
+// Created by Joshua Lowe on 17.10.26.
+//
+
+#include "VolumeStatistics.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace {
+
+// Independent lanes let the compiler keep the reductions in vector
+// registers, float partial sums are flushed to double every chunk.
+constexpr int kLanes = 16;
+constexpr std::size_t kChunk = 1024;
+
+}  // namespace
+
+StatisticsAccumulator::StatisticsAccumulator() : count(0) {
+  for (int c = 0; c < 4; c++) {
+    min[c] = std::numeric_limits<float>::max();
+    max[c] = std::numeric_limits<float>::lowest();
+    sum[c] = 0;
+    sumSquares[c] = 0;
+  }
+}
+
+auto StatisticsAccumulator::add(const float* x, const float* y,
+                                const float* z, std::size_t n) -> void {
+  for (std::size_t begin = 0; begin < n; begin += kChunk) {
+    std::size_t end = std::min(n, begin + kChunk);
+    float laneMin[4][kLanes], laneMax[4][kLanes];
+    float laneSum[4][kLanes], laneSquares[4][kLanes];
+    for (int c = 0; c < 4; c++) {
+      for (int l = 0; l < kLanes; l++) {
+        laneMin[c][l] = std::numeric_limits<float>::max();
+        laneMax[c][l] = std::numeric_limits<float>::lowest();
+        laneSum[c][l] = 0;
+        laneSquares[c][l] = 0;
+      }
+    }
+
+    auto accumulate = [&](std::size_t i, int l) {
+      float v[4] = {x[i], y[i], z[i], 0};
+      v[3] = std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+      for (int c = 0; c < 4; c++) {
+        laneMin[c][l] = (v[c] < laneMin[c][l]) ? v[c] : laneMin[c][l];
+        laneMax[c][l] = (v[c] > laneMax[c][l]) ? v[c] : laneMax[c][l];
+        laneSum[c][l] += v[c];
+        laneSquares[c][l] += v[c] * v[c];
+      }
+    };
+
+    std::size_t i = begin;
+    for (; i + kLanes <= end; i += kLanes) {
+      for (int l = 0; l < kLanes; l++) accumulate(i + l, l);
+    }
+    for (; i < end; i++) accumulate(i, 0);
+
+    for (int c = 0; c < 4; c++) {
+      for (int l = 0; l < kLanes; l++) {
+        min[c] = std::min(min[c], laneMin[c][l]);
+        max[c] = std::max(max[c], laneMax[c][l]);
+        sum[c] += laneSum[c][l];
+        sumSquares[c] += laneSquares[c][l];
+      }
+    }
+  }
+  count += n;
+}
+
+auto StatisticsAccumulator::addSlices(const VolumeStorage& volume, int z0,
+                                      int z1) -> void {
+  std::size_t offset = z0 * volume.sliceSize();
+  std::size_t n = (z1 - z0) * volume.sliceSize();
+  add(volume.component(0).data() + offset, volume.component(1).data() + offset,
+      volume.component(2).data() + offset, n);
+}
+
+auto StatisticsAccumulator::merge(const StatisticsAccumulator& other)
+    -> void {
+  for (int c = 0; c < 4; c++) {
+    min[c] = std::min(min[c], other.min[c]);
+    max[c] = std::max(max[c], other.max[c]);
+    sum[c] += other.sum[c];
+    sumSquares[c] += other.sumSquares[c];
+  }
+  count += other.count;
+}
+
+auto StatisticsAccumulator::finish() const -> VolumeStatistics {
+  VolumeStatistics statistics;
+  for (int c = 0; c < 4; c++) {
+    ComponentStatistics& s = statistics.components[c];
+    s.min = count ? min[c] : 0;
+    s.max = count ? max[c] : 0;
+    s.mean = count ? sum[c] / count : 0;
+    s.variance =
+        count ? std::max(0.0, sumSquares[c] / count - s.mean * s.mean) : 0;
+    s.histogram.fill(0);
+  }
+  return statistics;
+}
+
+auto accumulateHistograms(const VolumeStorage& volume, int z0, int z1,
+                          const VolumeStatistics& ranges,
+                          VolumeStatistics& target) -> void {
+  const int last = ComponentStatistics::kBins - 1;
+  std::size_t begin = z0 * volume.sliceSize();
+  std::size_t end = z1 * volume.sliceSize();
+  const float* x = volume.component(0).data();
+  const float* y = volume.component(1).data();
+  const float* z = volume.component(2).data();
+
+  float lower[4], scale[4];
+  for (int c = 0; c < 4; c++) {
+    const ComponentStatistics& s = ranges.components[c];
+    lower[c] = s.min;
+    scale[c] = (s.max > s.min) ? ComponentStatistics::kBins / (s.max - s.min)
+                               : 0.0f;
+  }
+
+  for (std::size_t i = begin; i < end; i++) {
+    float v[4] = {x[i], y[i], z[i], 0};
+    v[3] = std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+    for (int c = 0; c < 4; c++) {
+      int bin = (int)((v[c] - lower[c]) * scale[c]);
+      bin = (bin < 0) ? 0 : (bin > last) ? last : bin;
+      target.components[c].histogram[bin]++;
+    }
+  }
+}
@@ -0,0 +1,59 @@
+//
+// Created by Joshua Lowe on 17.10.26.
+//
+
+#ifndef CODE_VOLUMESTATISTICS_H
+#define CODE_VOLUMESTATISTICS_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include "VolumeStorage.h"
+
+struct ComponentStatistics {
+  static constexpr int kBins = 64;
+
+  float min;
+  float max;
+  double mean;
+  double variance;
+  // kBins equally wide bins spanning [min, max], the last bin includes max.
+  std::array<std::uint32_t, kBins> histogram;
+
+  auto binWidth() const -> float { return (max - min) / kBins; }
+};
+
+// Statistics of x, y, z and the magnitude (index 3) of a frame.
+struct VolumeStatistics {
+  std::array<ComponentStatistics, VolumeStorage::kComponents + 1> components;
+};
+
+// Partial min/max/sum moments of a range of voxels. Generation workers fill
+// one accumulator per slab while the freshly written slices are still in
+// cache, the slabs are merged in order so the result does not depend on the
+// thread count.
+class StatisticsAccumulator {
+ public:
+  StatisticsAccumulator();
+
+  auto add(const float*, const float*, const float*, std::size_t) -> void;
+  auto addSlices(const VolumeStorage&, int, int) -> void;
+  auto merge(const StatisticsAccumulator&) -> void;
+  // Min, max, mean and variance; the histograms are left empty.
+  auto finish() const -> VolumeStatistics;
+
+ private:
+  std::size_t count;
+  float min[4];
+  float max[4];
+  double sum[4];
+  double sumSquares[4];
+};
+
+// Bins the slices [z0, z1) into histograms over the ranges of the given
+// statistics. Partial histograms of several slabs simply add up.
+auto accumulateHistograms(const VolumeStorage&, int, int,
+                          const VolumeStatistics&, VolumeStatistics&) -> void;
+
+#endif  // CODE_VOLUMESTATISTICS_H
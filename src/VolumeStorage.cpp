@@ -0,0 +1,171 @@
+//
+// Created by Joshua Lowe on 17.10.26.
+//
+
+#include "VolumeStorage.h"
+
+#include <algorithm>
+#include <new>
+#include <utility>
+
+#include "CpuFeatures.h"
+
+#if TORNADO_X86
+#include <immintrin.h>
+#endif
+
+namespace {
+
+// std::sqrt may set errno, which keeps compilers from vectorising the plain
+// loop, so the magnitude sweep uses the sqrt instructions directly. Both
+// return how many voxels they wrote, the caller finishes the remainder.
+#if TORNADO_X86
+TORNADO_TARGET("avx2")
+auto magnitudeAVX2(const float* x, const float* y, const float* z, float* out,
+                   std::size_t count) -> std::size_t {
+  std::size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    __m256 vx = _mm256_loadu_ps(x + i);
+    __m256 vy = _mm256_loadu_ps(y + i);
+    __m256 vz = _mm256_loadu_ps(z + i);
+    __m256 sum = _mm256_add_ps(
+        _mm256_add_ps(_mm256_mul_ps(vx, vx), _mm256_mul_ps(vy, vy)),
+        _mm256_mul_ps(vz, vz));
+    _mm256_storeu_ps(out + i, _mm256_sqrt_ps(sum));
+  }
+  return i;
+}
+
+TORNADO_TARGET("sse4.1")
+auto magnitudeSSE(const float* x, const float* y, const float* z, float* out,
+                  std::size_t count) -> std::size_t {
+  std::size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    __m128 vx = _mm_loadu_ps(x + i);
+    __m128 vy = _mm_loadu_ps(y + i);
+    __m128 vz = _mm_loadu_ps(z + i);
+    __m128 sum = _mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, vx), _mm_mul_ps(vy, vy)),
+                            _mm_mul_ps(vz, vz));
+    _mm_storeu_ps(out + i, _mm_sqrt_ps(sum));
+  }
+  return i;
+}
+#endif
+
+}  // namespace
+
+VolumeStorage::VolumeStorage() : dim(0), planes{} {}
+
+VolumeStorage::VolumeStorage(int dimension) : VolumeStorage() {
+  resize(dimension);
+}
+
+VolumeStorage::VolumeStorage(VolumeStorage&& other) noexcept
+    : VolumeStorage() {
+  *this = std::move(other);
+}
+
+auto VolumeStorage::operator=(VolumeStorage&& other) noexcept
+    -> VolumeStorage& {
+  dim = std::exchange(other.dim, 0);
+  for (int c = 0; c <= kComponents; c++) {
+    planes[c] = std::exchange(other.planes[c], nullptr);
+    owned[c] = std::move(other.owned[c]);
+  }
+  source = std::move(other.source);
+  return *this;
+}
+
+auto VolumeStorage::wrap(int dimension, const float* x, const float* y,
+                         const float* z, std::shared_ptr<const void> keepAlive)
+    -> VolumeStorage {
+  VolumeStorage storage;
+  storage.dim = dimension;
+  // Never written through: the mutable views are off limits while wrapped.
+  storage.planes[0] = const_cast<float*>(x);
+  storage.planes[1] = const_cast<float*>(y);
+  storage.planes[2] = const_cast<float*>(z);
+  storage.source = std::move(keepAlive);
+  return storage;
+}
+
+auto VolumeStorage::detach() -> void {
+  if (!source) return;
+  for (int c = 0; c < kComponents; c++) {
+    owned[c] = allocatePlane();
+    std::copy(planes[c], planes[c] + voxelCount(), owned[c].get());
+    planes[c] = owned[c].get();
+  }
+  source.reset();
+}
+
+auto VolumeStorage::AlignedDeleter::operator()(float* plane) const -> void {
+  ::operator delete[](plane, std::align_val_t(kAlignment));
+}
+
+auto VolumeStorage::allocatePlane() const -> AlignedPlane {
+  // Round every plane up to a whole number of cache lines so vectorised
+  // loops may run over the padded tail without leaving the allocation.
+  constexpr std::size_t lane = kAlignment / sizeof(float);
+  std::size_t padded = (voxelCount() + lane - 1) / lane * lane;
+  auto* plane = static_cast<float*>(::operator new[](
+      std::max<std::size_t>(padded, lane) * sizeof(float),
+      std::align_val_t(kAlignment)));
+  return AlignedPlane(plane);
+}
+
+auto VolumeStorage::resize(int dimension) -> void {
+  if (dimension == dim && planes[0] && !source) {
+    releaseMagnitude();
+    return;
+  }
+  dim = dimension;
+  source.reset();
+  for (int c = 0; c < kComponents; c++) {
+    owned[c] = allocatePlane();
+    planes[c] = owned[c].get();
+  }
+  releaseMagnitude();
+}
+
+auto VolumeStorage::allocateMagnitude() -> void {
+  if (planes[3]) return;
+  owned[3] = allocatePlane();
+  planes[3] = owned[3].get();
+}
+
+auto VolumeStorage::computeMagnitude(int z0, int z1) -> void {
+  allocateMagnitude();
+  // Slices start on cache line boundaries whenever dim * dim is a multiple
+  // of 16, the unaligned loads cost nothing otherwise.
+  std::size_t offset = z0 * sliceSize();
+  const float* x = planes[0] + offset;
+  const float* y = planes[1] + offset;
+  const float* z = planes[2] + offset;
+  float* betrag = planes[3] + offset;
+  std::size_t count = (z1 - z0) * sliceSize();
+  std::size_t i = 0;
+#if TORNADO_X86
+  static const SimdLevel level = detectSimdLevel();
+  if (level >= AVX2) {
+    i = magnitudeAVX2(x, y, z, betrag, count);
+  } else if (level >= SSE) {
+    i = magnitudeSSE(x, y, z, betrag, count);
+  }
+#endif
+  for (; i < count; i++) {
+    betrag[i] = std::sqrt(x[i] * x[i] + y[i] * y[i] + z[i] * z[i]);
+  }
+}
+
+auto VolumeStorage::releaseMagnitude() -> void {
+  owned[3].reset();
+  planes[3] = nullptr;
+}
+
+auto VolumeStorage::reverse() -> void {
+  detach();
+  for (float* plane : planes) {
+    if (plane) std::reverse(plane, plane + voxelCount());
+  }
+}
@@ -0,0 +1,118 @@
+//
+// Created by Joshua Lowe on 17.10.26.
+//
+
+#ifndef CODE_VOLUMESTORAGE_H
+#define CODE_VOLUMESTORAGE_H
+
+#include <QVector3D>
+#include <cmath>
+#include <cstddef>
+#include <memory>
+
+#include "Span.h"
+
+// Structure-of-arrays storage for a cubic three-component vector volume.
+// Every component lives in its own 64-byte aligned float plane laid out as
+// ix + dim * iy + dim * dim * iz, so a z-slice of one component is a single
+// contiguous run. Component 3 is the magnitude, which is derived on the fly
+// until the magnitude plane is allocated. From then on value(..., 3) reads
+// the plane, so the owner has to fill every slice it reads (see
+// FlowFrame::requireComponent).
+//
+// A storage may also wrap planes it does not own, e.g. a memory-mapped
+// file. Wrapped planes are read-only: the mutable views must not be used
+// until detach() copied them into owned planes.
+class VolumeStorage {
+ public:
+  static constexpr std::size_t kAlignment = 64;
+  static constexpr int kComponents = 3;
+
+  VolumeStorage();
+  explicit VolumeStorage(int);
+  VolumeStorage(VolumeStorage&&) noexcept;
+  auto operator=(VolumeStorage&&) noexcept -> VolumeStorage&;
+  VolumeStorage(const VolumeStorage&) = delete;
+  auto operator=(const VolumeStorage&) -> VolumeStorage& = delete;
+
+  // Reallocates the planes for the given dimension. Contents are undefined
+  // afterwards and a stored magnitude is dropped.
+  auto resize(int) -> void;
+  // Wraps three externally owned component planes of dim^3 floats without
+  // copying them. The keep-alive handle is held as long as the storage
+  // references the planes.
+  static auto wrap(int, const float*, const float*, const float*,
+                   std::shared_ptr<const void>) -> VolumeStorage;
+  // Copies wrapped planes into owned ones so they may be written.
+  auto detach() -> void;
+  auto isWrapped() const -> bool { return source != nullptr; }
+  auto allocateMagnitude() -> void;
+  // Fills the magnitude of the slices [z0, z1), allocating the plane first.
+  auto computeMagnitude(int, int) -> void;
+  auto computeMagnitude() -> void { computeMagnitude(0, dim); }
+  auto releaseMagnitude() -> void;
+  auto reverse() -> void;
+
+  auto dimension() const -> int { return dim; }
+  auto sliceSize() const -> std::size_t { return (std::size_t)dim * dim; }
+  auto voxelCount() const -> std::size_t { return sliceSize() * dim; }
+  auto hasMagnitude() const -> bool { return planes[3] != nullptr; }
+
+  // Zero-copy views of a whole component plane or of one z-slice of it.
+  // Component 3 is only available once the magnitude has been computed.
+  auto component(int c) const -> FloatSpan {
+    return {planes[c], voxelCount()};
+  }
+  auto slice(int c, int iz) const -> FloatSpan {
+    return {planes[c] + iz * sliceSize(), sliceSize()};
+  }
+  auto mutableComponent(int c) -> Span<float> {
+    return {planes[c], voxelCount()};
+  }
+  auto mutableSlice(int c, int iz) -> Span<float> {
+    return {planes[c] + iz * sliceSize(), sliceSize()};
+  }
+
+  auto index(int ix, int iy, int iz) const -> std::size_t {
+    return ix + (std::size_t)dim * (iy + (std::size_t)dim * iz);
+  }
+
+  // Unchecked accessors for hot loops. Callers guarantee that the indices
+  // are inside the volume and that c is in [0, 3].
+  auto value(int ix, int iy, int iz, int c) const -> float {
+    std::size_t i = index(ix, iy, iz);
+    if (c < kComponents || planes[3]) return planes[c][i];
+    return std::sqrt(planes[0][i] * planes[0][i] + planes[1][i] * planes[1][i] +
+                     planes[2][i] * planes[2][i]);
+  }
+  auto vector(int ix, int iy, int iz) const -> QVector3D {
+    std::size_t i = index(ix, iy, iz);
+    return {planes[0][i], planes[1][i], planes[2][i]};
+  }
+  // Corner k of the cell with base voxel (ix, iy, iz) is the voxel offset
+  // by (k & 1, k >> 1 & 1, k >> 2).
+  auto cell(int ix, int iy, int iz, QVector3D* corners) const -> void {
+    std::size_t base = index(ix, iy, iz);
+    for (int k = 0; k < 8; k++) {
+      std::size_t i = base + (k & 1) + (k >> 1 & 1) * (std::size_t)dim +
+                      (k >> 2) * sliceSize();
+      corners[k] = {planes[0][i], planes[1][i], planes[2][i]};
+    }
+  }
+
+ private:
+  struct AlignedDeleter {
+    auto operator()(float*) const -> void;
+  };
+  using AlignedPlane = std::unique_ptr<float[], AlignedDeleter>;
+
+  auto allocatePlane() const -> AlignedPlane;
+
+  int dim;
+  // Points either into owned or into the wrapped source.
+  float* planes[kComponents + 1];
+  AlignedPlane owned[kComponents + 1];
+  std::shared_ptr<const void> source;
+};
+
+#endif  // CODE_VOLUMESTORAGE_H
@@ -1,14 +1,28 @@
 #include "opengldisplaywidget.h"
 
+#include <QCoreApplication>
 #include <QMouseEvent>
 #include <QOpenGLFunctions>
 #include <QPainter>
+#include <algorithm>
 #include <cmath>
 #include <iostream>
+#include <numeric>
 
+#include "FieldGenerators.h"
 #include "HorizontalContourLinesRenderer.h"
+#include "VolumePyramid.h"
 #include "datavolumeboundingboxrenderer.h"
 
+namespace {
+
+// Largest dimension mapped while the view is busy.
+constexpr int kInteractiveDimension = 128;
+// Milliseconds without interaction before the view refines.
+constexpr int kRefineDelay = 250;
+
+}  // namespace
+
 OpenGLDisplayWidget::OpenGLDisplayWidget(QWidget *parent)
     : QOpenGLWidget(parent),
       distanceToCamera(-8.0),
@@ -19,6 +33,8 @@ OpenGLDisplayWidget::OpenGLDisplayWidget(QWidget *parent)
       frameCounter(0),
       fps(0),
       isAnimated(false),
+      detailLevel(0),
+      refineTimer(new QBasicTimer()),
       framerateCap(60) {
   setFocusPolicy(Qt::StrongFocus);
 }
@@ -162,6 +178,10 @@ auto OpenGLDisplayWidget::wheelEvent(QWheelEvent *e) -> void {
 }
 
 auto OpenGLDisplayWidget::timerEvent(QTimerEvent *event) -> void {
+  if (event->timerId() == refineTimer->timerId()) {
+    refine();
+    return;
+  }
   frame += 1;
   frameCounter += 1;
 
@@ -221,6 +241,30 @@ auto OpenGLDisplayWidget::initVisualizationPipeline() -> void {
   // Initialize data source(s).
   // ....
   flowDataSource = new FlowDataSource(32);
+  // "--field <name>" generates another analytic flow than the tornado,
+  // "--record <file> <frames>" dumps it to a volume file first,
+  // "--stream <file> <MiB>" streams a file too long to map, any other
+  // argument is a volume file to replay instead.
+  QStringList arguments = QCoreApplication::arguments();
+  int field = arguments.indexOf("--field");
+  int record = arguments.indexOf("--record");
+  int stream = arguments.indexOf("--stream");
+  if (field > 0 && field + 1 < arguments.size()) {
+    flowDataSource->setGenerator(arguments[field + 1].toStdString());
+    arguments.erase(arguments.begin() + field, arguments.begin() + field + 2);
+    record = arguments.indexOf("--record");
+    stream = arguments.indexOf("--stream");
+  }
+  if (record > 0 && record + 2 < arguments.size()) {
+    flowDataSource->exportFrames(arguments[record + 1].toStdString(), 0,
+                                 arguments[record + 2].toInt());
+  } else if (stream > 0 && stream + 2 < arguments.size()) {
+    flowDataSource->streamVolumeFile(
+        arguments[stream + 1].toStdString(),
+        (std::size_t)arguments[stream + 2].toInt() << 20);
+  } else if (arguments.size() > 1) {
+    flowDataSource->openVolumeFile(arguments[1].toStdString());
+  }
 
   // Initialize mapper modules.
   // ....
@@ -241,6 +285,54 @@ auto OpenGLDisplayWidget::setAddOn(AddOn inAddOn) -> void {
   addOn = (inAddOn == None) ? None : static_cast<AddOn>(addOn ^ inAddOn);
 }
 
+auto OpenGLDisplayWidget::setDetailLevel(int level) -> void {
+  detailLevel = level;
+  hsliceMapper->setLevel(level);
+  hcontourMapper->setLevel(level);
+  glslContourRenderer->setLevel(level);
+  streamLinesMapper->setLevel(level);
+}
+
+auto OpenGLDisplayWidget::interactiveLevel() -> int {
+  int level = 0;
+  while (pyramidDimension(flowDataSource->getDimension(), level) >
+         kInteractiveDimension) {
+    level++;
+  }
+  return level;
+}
+
+auto OpenGLDisplayWidget::coarsen() -> void {
+  if (isAnimated || interactiveLevel() == 0) return;
+  setDetailLevel(interactiveLevel());
+  refineTimer->start(kRefineDelay, this);
+}
+
+auto OpenGLDisplayWidget::refine() -> void {
+  refineTimer->stop();
+  if (isAnimated || detailLevel == 0) return;
+  setDetailLevel(0);
+  remap();
+  update();
+}
+
+auto OpenGLDisplayWidget::remap() -> void {
+  hsliceRenderer->updateTexture();
+  switch (addOn) {
+    case IsoAndStream:
+      activeContourRenderer->updateIso();
+      streamLinesRenderer->refreshStreamLines();
+      break;
+    case IsoLines:
+      activeContourRenderer->updateIso();
+      break;
+    case StreamLines:
+      streamLinesRenderer->refreshStreamLines();
+      break;
+    default:;
+  }
+}
+
 auto OpenGLDisplayWidget::displayUI() -> void {
   QPainter painter(this);
   painter.setPen(Qt::white);
@@ -277,20 +369,20 @@ auto OpenGLDisplayWidget::displayUI() -> void {
       title = QString("%1  |  IsoAndStream").arg(title);
       painter.drawText(width() / 2 - title.size() * shiftFaktor, 5, width(),
                        height(), Qt::AlignTop, title);
-      streamLineUI(painter, 185, 425);
-      isoUI(painter, 325, 605);
+      streamLineUI(painter, 185, 485);
+      isoUI(painter, 325, 665);
       break;
     case IsoLines:
       title = QString("%1  |  IsoLines").arg(title);
       painter.drawText(width() / 2 - title.size() * shiftFaktor, 5, width(),
                        height(), Qt::AlignTop, title);
-      isoUI(painter, 185, 425);
+      isoUI(painter, 185, 485);
       break;
     case StreamLines:;
       title = QString("%1  |  StreamLines").arg(title);
       painter.drawText(width() / 2 - title.size() * shiftFaktor, 5, width(),
                        height(), Qt::AlignTop, title);
-      streamLineUI(painter, 185, 425);
+      streamLineUI(painter, 185, 485);
       break;
     default:
       if (hsliceRenderer->getMode() == Data) {
@@ -349,11 +441,13 @@ auto OpenGLDisplayWidget::defaultKeybinding(QKeyEvent *e) -> void {
       streamLinesRenderer->setMaxSteps();
       break;
     case Qt::Key_Down:
+      coarsen();
       hsliceRenderer->moveSlice(-1);
       glslContourRenderer->moveSlice(-1);
       hcontourRenderer->moveSlice(-1);
       break;
     case Qt::Key_Up:
+      coarsen();
       hsliceRenderer->moveSlice(1);
       glslContourRenderer->moveSlice(1);
       hcontourRenderer->moveSlice(1);
@@ -387,6 +481,15 @@ auto OpenGLDisplayWidget::dataKeybinding(QKeyEvent *e) -> void {
       glslContourRenderer->setWindComponent(3);
       hcontourRenderer->setWindComponent(3);
       break;
+    case Qt::Key_D: {
+      // Cycle through the derived fields, starting with the vorticity.
+      derivedComponent =
+          (derivedComponent == Lambda2) ? VorticityX : derivedComponent + 1;
+      hsliceRenderer->setWindComponent(derivedComponent);
+      glslContourRenderer->setWindComponent(derivedComponent);
+      hcontourRenderer->setWindComponent(derivedComponent);
+      break;
+    }
     case Qt::Key_I:
       activeContourRenderer->toggleIsoEdit(false);
       setAddOn(IsoLines);
@@ -398,6 +501,33 @@ auto OpenGLDisplayWidget::dataKeybinding(QKeyEvent *e) -> void {
     case Qt::Key_H:
       hsliceRenderer->toggleHCL(true);
       break;
+    case Qt::Key_C: {
+      // Cycle float32 -> half -> 16-bit -> 8-bit quantised storage.
+      auto next = static_cast<VolumeEncoding>(
+          (flowDataSource->getEncoding() + 1) % (Quantized8 + 1));
+      flowDataSource->setEncoding(next);
+      std::cout << "storing frames as " << volumeEncodingName(next)
+                << std::endl;
+      remap();
+      break;
+    }
+    case Qt::Key_L: {
+      auto next = static_cast<VolumeLayout>(
+          (flowDataSource->getLayout() + 1) % (MortonLayout + 1));
+      flowDataSource->setLayout(next);
+      std::cout << "laying frames out " << volumeLayoutName(next)
+                << std::endl;
+      remap();
+      break;
+    }
+    case Qt::Key_F: {
+      int next = (flowDataSource->getGenerator() + 1) %
+                 (int)getFieldGenerators().size();
+      // The field shown is reported by dataUI().
+      flowDataSource->setGenerator(next);
+      remap();
+      break;
+    }
     case Qt::Key_G:
       //hsliceRenderer->moveSlice(-flowDataSource->getDimension());
       isGLSL = !isGLSL;
@@ -406,6 +536,10 @@ auto OpenGLDisplayWidget::dataKeybinding(QKeyEvent *e) -> void {
     case Qt::Key_1:
       if (!timer->isActive()) {
         isAnimated = true;
+        // Map a coarser level while playing; the next frame and its pyramid
+        // are built in the background while this one renders.
+        setDetailLevel(interactiveLevel());
+        flowDataSource->setPrefetchDepth(1);
         timer->start(1000 / framerateCap, this);
       }
       break;
@@ -414,6 +548,8 @@ auto OpenGLDisplayWidget::dataKeybinding(QKeyEvent *e) -> void {
         isAnimated = false;
         fps = 0;
         timer->stop();
+        flowDataSource->setPrefetchDepth(0);
+        refine();
       }
       break;
     case Qt::Key_3:
@@ -453,9 +589,11 @@ auto OpenGLDisplayWidget::isoKeybinding(QKeyEvent *e) -> void {
 auto OpenGLDisplayWidget::isoActiveKeybinding(QKeyEvent *e) -> void {
   switch (e->key()) {
     case Qt::Key_Left:
+      coarsen();
       activeContourRenderer->moveActiveIso(-0.02);
       break;
     case Qt::Key_Right:
+      coarsen();
       activeContourRenderer->moveActiveIso(0.02);
       break;
     case Qt::Key_Down:
@@ -521,6 +659,37 @@ auto OpenGLDisplayWidget::streamLineKeybinding(QKeyEvent *e) -> void {
     case Qt::Key_8:
       streamLinesRenderer->setPathLinesInterval(1);
       break;
+    case Qt::Key_9:
+      streamLinesRenderer->setPathLineSubsteps(-1);
+      break;
+    case Qt::Key_0:
+      streamLinesRenderer->setPathLineSubsteps(1);
+      break;
+    case Qt::Key_A:
+      streamLinesMapper->setAnalytic(!streamLinesMapper->isAnalytic());
+      streamLinesRenderer->refreshStreamLines();
+      break;
+    case Qt::Key_K:
+      streamLinesMapper->setCostOrdered(!streamLinesMapper->isCostOrdered());
+      streamLinesRenderer->refreshStreamLines();
+      break;
+    case Qt::Key_J:
+      streamLinesMapper->setPacketTracing(
+          !streamLinesMapper->isPacketTracing());
+      streamLinesRenderer->refreshStreamLines();
+      break;
+    case Qt::Key_BracketLeft:
+      streamLinesMapper->setTolerance(
+          streamLinesMapper->getAbsoluteTolerance() / 10,
+          streamLinesMapper->getRelativeTolerance() / 10);
+      streamLinesRenderer->refreshStreamLines();
+      break;
+    case Qt::Key_BracketRight:
+      streamLinesMapper->setTolerance(
+          streamLinesMapper->getAbsoluteTolerance() * 10,
+          streamLinesMapper->getRelativeTolerance() * 10);
+      streamLinesRenderer->refreshStreamLines();
+      break;
   }
 }
 
@@ -565,6 +734,10 @@ auto OpenGLDisplayWidget::dataUI(QPainter &painter, int left, int right)
                    QString("GLSL: %1").arg(isGLSL));
   painter.drawText(5, left + 80, width(), height(), Qt::AlignTop,
                    QString("HCL: %1").arg(hsliceRenderer->isHCL()));
+  painter.drawText(
+      5, left + 100, width(), height(), Qt::AlignTop,
+      QString("Field: %1")
+          .arg(getFieldGenerators()[flowDataSource->getGenerator()].name));
 
   painter.drawText(width() - marginRight, right, width(), height(),
                    Qt::AlignTop,
@@ -590,6 +763,9 @@ auto OpenGLDisplayWidget::dataUI(QPainter &painter, int left, int right)
   painter.drawText(width() - marginRight, right + 140, width(), height(),
                    Qt::AlignTop,
                    QString("Wind Component: b"));
+  painter.drawText(width() - marginRight, right + 260, width(), height(),
+                   Qt::AlignTop,
+                   QString("Derived Component: d"));
   painter.drawText(width() - marginRight, right + 160, width(), height(),
                    Qt::AlignTop,
                    QString("Start Animation: 1"));
@@ -602,6 +778,15 @@ auto OpenGLDisplayWidget::dataUI(QPainter &painter, int left, int right)
   painter.drawText(width() - marginRight, right + 220, width(), height(),
                    Qt::AlignTop,
                    QString("Increase Animation: 4"));
+  painter.drawText(width() - marginRight, right + 240, width(), height(),
+                   Qt::AlignTop,
+                   QString("Cycle Field: f"));
+  painter.drawText(width() - marginRight, right + 280, width(), height(),
+                   Qt::AlignTop,
+                   QString("Cycle Encoding: c"));
+  painter.drawText(width() - marginRight, right + 300, width(), height(),
+                   Qt::AlignTop,
+                   QString("Cycle Layout: l"));
 }
 
 auto OpenGLDisplayWidget::isoUI(QPainter &painter, int left, int right)
@@ -693,6 +878,9 @@ auto OpenGLDisplayWidget::streamLineUI(QPainter &painter, int left, int right)
     case Kutta4:
       result = QString("Kutta4");
       break;
+    case DormandPrince:
+      result = QString("Dormand-Prince 5(4)");
+      break;
   }
   painter.drawText(5, left, width(), height(), Qt::AlignTop,
                    QString("Integration: %1").arg(result));
@@ -713,6 +901,33 @@ auto OpenGLDisplayWidget::streamLineUI(QPainter &painter, int left, int right)
   painter.drawText(5, left + 100, width(), height(), Qt::AlignTop,
                    QString("PathLines Interval: %1")
                        .arg(streamLinesRenderer->getPathLinesInterval()));
+  painter.drawText(5, left + 120, width(), height(), Qt::AlignTop,
+                   QString("PathLines Substeps: %1")
+                       .arg(streamLinesRenderer->getPathLineSubsteps()));
+  painter.drawText(
+      5, left + 140, width(), height(), Qt::AlignTop,
+      QString("Analytic: %1").arg(streamLinesMapper->isAnalytic()));
+  painter.drawText(
+      5, left + 160, width(), height(), Qt::AlignTop,
+      QString("Cost Order: %1").arg(streamLinesMapper->isCostOrdered()));
+  painter.drawText(
+      5, left + 180, width(), height(), Qt::AlignTop,
+      QString("Packets: %1").arg(streamLinesMapper->isPacketTracing()));
+  painter.drawText(
+      5, left + 200, width(), height(), Qt::AlignTop,
+      QString("Tolerance: %1").arg(streamLinesMapper->getAbsoluteTolerance()));
+  // Busy share of the least and the average busy thread of the last pass.
+  std::vector<float> utilisation = streamLinesMapper->getUtilisation();
+  if (!utilisation.empty()) {
+    float least = *std::min_element(utilisation.begin(), utilisation.end());
+    float mean = std::accumulate(utilisation.begin(), utilisation.end(), 0.f) /
+                 utilisation.size();
+    painter.drawText(5, left + 220, width(), height(), Qt::AlignTop,
+                     QString("Utilisation: %1% avg, %2% min, %3 threads")
+                         .arg(qRound(100 * mean))
+                         .arg(qRound(100 * least))
+                         .arg(utilisation.size()));
+  }
 
   painter.drawText(width() - marginRight, right, width(), height(),
                    Qt::AlignTop,
@@ -745,4 +960,24 @@ auto OpenGLDisplayWidget::streamLineUI(QPainter &painter, int left, int right)
   painter.drawText(width() - marginRight, right + 140, width(), height(),
                    Qt::AlignTop,
                    QString("Increase Path Interval: 8"));
+
+  painter.drawText(width() - marginRight, right + 160, width(), height(),
+                   Qt::AlignTop,
+                   QString("Path Substeps: 9 / 0"));
+
+  painter.drawText(width() - marginRight, right + 180, width(), height(),
+                   Qt::AlignTop,
+                   QString("Toggle Analytic: a"));
+
+  painter.drawText(width() - marginRight, right + 200, width(), height(),
+                   Qt::AlignTop,
+                   QString("Toggle Cost Order: k"));
+
+  painter.drawText(width() - marginRight, right + 220, width(), height(),
+                   Qt::AlignTop,
+                   QString("Toggle Packets: j"));
+
+  painter.drawText(width() - marginRight, right + 240, width(), height(),
+                   Qt::AlignTop,
+                   QString("Tolerance: [ / ]"));
 }
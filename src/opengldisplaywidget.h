@@ -47,8 +47,22 @@ class OpenGLDisplayWidget : public QOpenGLWidget {
   double fps;
   QBasicTimer *timer;
   QElapsedTimer *frameTime;
+  // Pyramid level the mappers use, coarser during playback and while keys
+  // step through slices or isovalues.
+  int detailLevel;
+  QBasicTimer *refineTimer;
+  // Derived field shown last; d moves on to the next one.
+  int derivedComponent = Lambda2;
 
   auto setAddOn(AddOn) -> void;
+  auto setDetailLevel(int) -> void;
+  auto interactiveLevel() -> int;
+  // Maps a coarser level until no interaction followed for a moment.
+  auto coarsen() -> void;
+  // Maps the full resolution again unless playback is running.
+  auto refine() -> void;
+  // Maps the current frame again after the data source changed it.
+  auto remap() -> void;
 
   auto defaultUI(QPainter &, int, int) -> void;
   auto dataUI(QPainter &, int, int) -> void;
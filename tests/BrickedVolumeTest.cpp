@@ -0,0 +1,47 @@
+//
+// Created by Joshua Lowe on 17.10.26.
+//
+
+// Checks that BrickedVolume returns exactly the voxels of the VolumeStorage
+// it was built from, including the aprons of the partial bricks at the far
+// faces of dimensions that are not a multiple of the brick size.
+
+#include "BrickedVolume.h"
+#include "TestSupport.h"
+
+namespace {
+
+auto check(int dim, int frame, TestReport& report) -> void {
+  VolumeStorage linear = makeTornado(dim, frame);
+  BrickedVolume bricked(linear);
+  for (int iz = 0; iz < dim; iz++) {
+    for (int iy = 0; iy < dim; iy++) {
+      for (int ix = 0; ix < dim; ix++) {
+        for (int c = 0; c <= VolumeStorage::kComponents; c++) {
+          if (bricked.value(ix, iy, iz, c) != linear.value(ix, iy, iz, c)) {
+            report.fail("dim ", dim, " value (", ix, ", ", iy, ", ", iz,
+                        ") component ", c, " differs");
+          }
+        }
+        if (ix == dim - 1 || iy == dim - 1 || iz == dim - 1) continue;
+        QVector3D expected[8], corners[8];
+        linear.cell(ix, iy, iz, expected);
+        bricked.cell(ix, iy, iz, corners);
+        for (int k = 0; k < 8; k++) {
+          if (corners[k] != expected[k]) {
+            report.fail("dim ", dim, " cell (", ix, ", ", iy, ", ", iz,
+                        ") corner ", k, " differs");
+          }
+        }
+      }
+    }
+  }
+}
+
+}  // namespace
+
+auto main() -> int {
+  TestReport report;
+  for (int dim : {8, 20, 24, 33, 40}) check(dim, 5, report);
+  return report.finish();
+}
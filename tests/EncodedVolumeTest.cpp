@@ -0,0 +1,137 @@
+//
+// Created by Joshua Lowe on 17.10.26.
+//
+
+// Encodes tornado frames and checks every voxel against the error budgets
+// documented in EncodedVolume.h, and reports how much faster than float32
+// the encodings are to sample.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "EncodedVolume.h"
+#include "TestSupport.h"
+
+namespace {
+
+// Float rounding of the quantiser and of the decoder, on top of the
+// quantisation step itself.
+constexpr float kRoundingUlps = 4;
+
+auto ulp(float value) -> float {
+  return std::nextafter(value, std::numeric_limits<float>::infinity()) -
+         value;
+}
+
+auto checkHalf(const VolumeStorage& source, TestReport& report) -> void {
+  HalfVolume half(source);
+  int dim = source.dimension();
+  for (int iz = 0; iz < dim; iz++) {
+    for (int iy = 0; iy < dim; iy++) {
+      for (int ix = 0; ix < dim; ix++) {
+        for (int c = 0; c < VolumeStorage::kComponents; c++) {
+          float v = source.value(ix, iy, iz, c);
+          float error = std::abs(half.value(ix, iy, iz, c) - v);
+          float budget = std::max(std::abs(v) * 0x1p-11f, 0x1p-25f);
+          if (error > budget) {
+            report.fail("half dim ", dim, " voxel (", ix, ", ", iy, ", ", iz,
+                        ") component ", c, ": error ", error, " > ", budget);
+          }
+        }
+      }
+    }
+  }
+}
+
+template <typename T>
+auto checkQuantized(const VolumeStorage& source, TestReport& report)
+    -> void {
+  constexpr int kBrick = QuantizedVolume<T>::kBrick;
+  constexpr float levels = std::numeric_limits<T>::max();
+  QuantizedVolume<T> quantized(source);
+  int dim = source.dimension();
+  for (int bz = 0; bz < dim; bz += kBrick) {
+    for (int by = 0; by < dim; by += kBrick) {
+      for (int bx = 0; bx < dim; bx += kBrick) {
+        int ex = std::min(bx + kBrick, dim), ey = std::min(by + kBrick, dim),
+            ez = std::min(bz + kBrick, dim);
+        for (int c = 0; c < VolumeStorage::kComponents; c++) {
+          float low = std::numeric_limits<float>::max();
+          float high = std::numeric_limits<float>::lowest();
+          for (int iz = bz; iz < ez; iz++) {
+            for (int iy = by; iy < ey; iy++) {
+              for (int ix = bx; ix < ex; ix++) {
+                low = std::min(low, source.value(ix, iy, iz, c));
+                high = std::max(high, source.value(ix, iy, iz, c));
+              }
+            }
+          }
+          float budget =
+              (high - low) / (2 * levels) +
+              kRoundingUlps * ulp(std::max(std::abs(low), std::abs(high)));
+          for (int iz = bz; iz < ez; iz++) {
+            for (int iy = by; iy < ey; iy++) {
+              for (int ix = bx; ix < ex; ix++) {
+                float error = std::abs(quantized.value(ix, iy, iz, c) -
+                                       source.value(ix, iy, iz, c));
+                if (error > budget) {
+                  report.fail(8 * sizeof(T), "-bit dim ", dim, " voxel (", ix,
+                              ", ", iy, ", ", iz, ") component ", c,
+                              ": error ", error, " > ", budget);
+                }
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+// Samples per second of trilinear-style reads of all eight cell corners.
+template <typename Volume>
+auto cellRate(const Volume& volume) -> double {
+  int cells = volume.dimension() - 1;
+  QVector3D corners[8];
+  float sink = 0;
+  double seconds = bestSeconds(3, [&] {
+    for (int iz = 0; iz < cells; iz++) {
+      for (int iy = 0; iy < cells; iy++) {
+        for (int ix = 0; ix < cells; ix++) {
+          volume.cell(ix, iy, iz, corners);
+          sink += corners[ix & 7].x();
+        }
+      }
+    }
+  });
+  keep(sink);
+  return (double)cells * cells * cells / seconds;
+}
+
+}  // namespace
+
+auto main() -> int {
+  TestReport report;
+  // Dimensions that are and are not multiples of the brick size.
+  for (int dim : {24, 36, 64}) {
+    for (int frame : {0, 7, 50}) {
+      VolumeStorage source = makeTornado(dim, frame);
+      checkHalf(source, report);
+      checkQuantized<std::uint16_t>(source, report);
+      checkQuantized<std::uint8_t>(source, report);
+    }
+  }
+
+  VolumeStorage source = makeTornado(128, 3);
+  double float32 = cellRate(source);
+  std::cout << "cells/s at dimension 128: float32 " << float32 / 1e6
+            << "M, half " << cellRate(HalfVolume(source)) / 1e6 << "M, 16-bit "
+            << cellRate(QuantizedVolume<std::uint16_t>(source)) / 1e6
+            << "M, 8-bit "
+            << cellRate(QuantizedVolume<std::uint8_t>(source)) / 1e6 << "M"
+            << std::endl;
+  return report.finish();
+}
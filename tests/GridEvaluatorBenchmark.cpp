@@ -0,0 +1,116 @@
+//
+// Created by Joshua Lowe on 17.10.26.
+//
+
+// Time per sample of GridEvaluator on float planes against the formula it
+// replaced, which gathered the cell through a CellSampler and blended
+// QVector3D lerps, for positions that walk through neighbouring cells as
+// streamlines do and for random positions. Not a test: run it by hand on
+// the machine whose numbers matter.
+
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "FieldEvaluator.h"
+#include "FlowDataSource.h"
+#include "TestSupport.h"
+
+namespace {
+
+constexpr int kSamples = 1 << 20;
+constexpr int kPacket = 16;
+
+auto lerp(const QVector3D& a, const QVector3D& b, float f) -> QVector3D {
+  return a + f * (b - a);
+}
+
+auto gatherSample(const CellSampler& cell, int steps, QVector3D position)
+    -> InterpolationResult {
+  float base[3];
+  for (int axis = 0; axis < 3; axis++) {
+    base[axis] = std::floor(position[axis]);
+    if (position[axis] == steps) base[axis] = steps - 1;
+    if (base[axis] < 0 || base[axis] > steps - 1) return {false, {}};
+  }
+  QVector3D c[8];
+  cell(base[0], base[1], base[2], c);
+  float fx = position.x() - base[0], fy = position.y() - base[1],
+        fz = position.z() - base[2];
+  QVector3D y0 = lerp(lerp(c[0], c[1], fx), lerp(c[2], c[3], fx), fy);
+  QVector3D y1 = lerp(lerp(c[4], c[5], fx), lerp(c[6], c[7], fx), fy);
+  return {true, lerp(y0, y1, fz)};
+}
+
+auto nanoseconds(double seconds) -> double { return seconds * 1e9 / kSamples; }
+
+}  // namespace
+
+auto main() -> int {
+  std::printf("%5s %8s %12s %12s %12s\n", "dim", "walk", "gather ns",
+              "sample ns", "packet ns");
+  for (int dim : {64, 256}) {
+    FlowDataSource source(dim);
+    std::shared_ptr<const FlowFrame> frame = source.acquireFrame();
+    const VolumeStorage& volume = frame->getVolume();
+    CellSampler cell = [&volume](int x, int y, int z, QVector3D* corners) {
+      volume.cell(x, y, z, corners);
+    };
+    GridEvaluator evaluator(frame, 0);
+    int steps = dim - 1;
+
+    std::mt19937 random(dim);
+    std::uniform_real_distribution<float> inside(0, steps);
+    std::uniform_real_distribution<float> step(-0.1f, 0.1f);
+    std::vector<QVector3D> scattered(kSamples), walked(kSamples);
+    for (QVector3D& p : scattered) {
+      p = {inside(random), inside(random), inside(random)};
+    }
+    // A tenth of a voxel per step, so most samples stay in the last cell.
+    QVector3D p(steps / 2.0f, steps / 2.0f, steps / 2.0f);
+    for (QVector3D& q : walked) {
+      for (int axis = 0; axis < 3; axis++) {
+        p[axis] = std::fmod(p[axis] + step(random) + steps, (float)steps);
+      }
+      q = p;
+    }
+
+    auto measure = [&](const char* name, const std::vector<QVector3D>& at) {
+      std::vector<float> x(kSamples), y(kSamples), z(kSamples);
+      for (int i = 0; i < kSamples; i++) {
+        x[i] = at[i].x();
+        y[i] = at[i].y();
+        z[i] = at[i].z();
+      }
+      double gather = bestSeconds(3, [&] {
+        float sum = 0;
+        for (const QVector3D& q : at) {
+          sum += gatherSample(cell, steps, q).value.x();
+        }
+        keep(sum);
+      });
+      double sample = bestSeconds(3, [&] {
+        float sum = 0;
+        for (const QVector3D& q : at) sum += evaluator.sample(q).value.x();
+        keep(sum);
+      });
+      double packet = bestSeconds(3, [&] {
+        float vx[kPacket], vy[kPacket], vz[kPacket], sum = 0;
+        bool valid[kPacket];
+        for (int i = 0; i < kSamples; i += kPacket) {
+          evaluator.samplePacket(kPacket, &x[i], &y[i], &z[i], vx, vy, vz,
+                                 valid);
+          sum += vx[0];
+        }
+        keep(sum);
+      });
+      std::printf("%5d %8s %12.1f %12.1f %12.1f\n", dim, name,
+                  nanoseconds(gather), nanoseconds(sample),
+                  nanoseconds(packet));
+    };
+    measure("cells", walked);
+    measure("random", scattered);
+  }
+  return 0;
+}
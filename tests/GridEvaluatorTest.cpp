@@ -0,0 +1,151 @@
+//
+// Created by Joshua Lowe on 17.10.26.
+//
+
+// Checks GridEvaluator::sample() against the trilinear formula it
+// replaced: the cell gathered through the storage and blended as
+// QVector3D lerps. Both round alike unless the compiler contracts the
+// blends into fused multiply-adds, so the samples have to be bit-identical
+// in a build without FMA and within a few ULP otherwise. Covers float
+// planes at every level, which are read in place, and the encodings and
+// layouts that still gather.
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <random>
+#include <vector>
+
+#include "FieldEvaluator.h"
+#include "FlowDataSource.h"
+#include "TestSupport.h"
+
+namespace {
+
+#ifdef __FMA__
+// Relative to the largest corner of the cell.
+constexpr float kTolerance = 8 * std::numeric_limits<float>::epsilon();
+#else
+constexpr float kTolerance = 0;
+#endif
+
+auto lerp(const QVector3D& a, const QVector3D& b, float f) -> QVector3D {
+  return a + f * (b - a);
+}
+
+struct Reference {
+  bool success;
+  QVector3D value;
+  float largest;
+};
+
+// The formula of GridEvaluator::sample() before it read the planes.
+template <typename Volume>
+auto referenceSample(const Volume& volume, float scale, QVector3D position)
+    -> Reference {
+  int steps = volume.dimension() - 1;
+  QVector3D local = position * scale;
+  float base[3];
+  for (int axis = 0; axis < 3; axis++) {
+    base[axis] = std::floor(local[axis]);
+    if (local[axis] == steps) base[axis] = steps - 1;
+    if (base[axis] < 0 || base[axis] > steps - 1) return {false, {}, 0};
+  }
+  QVector3D c[8];
+  volume.cell(base[0], base[1], base[2], c);
+  float fx = local.x() - base[0], fy = local.y() - base[1],
+        fz = local.z() - base[2];
+  QVector3D y0 = lerp(lerp(c[0], c[1], fx), lerp(c[2], c[3], fx), fy);
+  QVector3D y1 = lerp(lerp(c[4], c[5], fx), lerp(c[6], c[7], fx), fy);
+  float largest = 0;
+  for (const QVector3D& corner : c) {
+    for (int axis = 0; axis < 3; axis++) {
+      largest = std::max(largest, std::abs(corner[axis]));
+    }
+  }
+  return {true, lerp(y0, y1, fz), largest};
+}
+
+// Random positions inside, the voxels, the far faces and just outside.
+auto makePositions(int dim) -> std::vector<QVector3D> {
+  float far = dim - 1;
+  std::mt19937 random(dim);
+  std::uniform_real_distribution<float> inside(0, far);
+  std::vector<QVector3D> positions;
+  for (int i = 0; i < 20000; i++) {
+    positions.emplace_back(inside(random), inside(random), inside(random));
+  }
+  for (int i = 0; i < 2000; i++) {
+    positions.emplace_back((int)inside(random), (int)inside(random),
+                           (int)inside(random));
+  }
+  for (float edge : {0.0f, far, std::nextafter(far, 0.0f)}) {
+    positions.emplace_back(edge, inside(random), inside(random));
+    positions.emplace_back(inside(random), edge, inside(random));
+    positions.emplace_back(inside(random), inside(random), edge);
+    positions.emplace_back(edge, edge, edge);
+  }
+  for (float outside : {-1e-3f, std::nextafter(far, 2 * far), far + 1}) {
+    positions.emplace_back(outside, inside(random), inside(random));
+    positions.emplace_back(inside(random), inside(random), outside);
+  }
+  return positions;
+}
+
+auto check(const std::shared_ptr<const FlowFrame>& frame, int level,
+           const char* name, TestReport& report) -> void {
+  int dim = frame->getDimension();
+  GridEvaluator evaluator(frame, level);
+  float scale = (level == 0) ? 1
+                             : (float)(frame->getLevelDimension(level) - 1) /
+                                   (dim - 1);
+  frame->visitLevel(level, [&](const auto& volume) {
+    for (const QVector3D& p : makePositions(dim)) {
+      Reference expected = referenceSample(volume, scale, p);
+      InterpolationResult result = evaluator.sample(p);
+      bool same = result.success == expected.success;
+      for (int axis = 0; same && expected.success && axis < 3; axis++) {
+        float error = std::abs(result.value[axis] - expected.value[axis]);
+        same = error <= kTolerance * expected.largest;
+      }
+      if (!same) {
+        report.fail(name, " dim ", dim, " level ", level, " at (", p.x(),
+                    ", ", p.y(), ", ", p.z(), "): ", result.success, " (",
+                    result.value.x(), ", ", result.value.y(), ", ",
+                    result.value.z(), "), expected ", expected.success, " (",
+                    expected.value.x(), ", ", expected.value.y(), ", ",
+                    expected.value.z(), ")");
+      }
+    }
+  });
+}
+
+}  // namespace
+
+auto main() -> int {
+  TestReport report;
+  for (int dim : {16, 33, 64}) {
+    FlowDataSource source(dim);
+    source.setFrame(4);
+    for (int level = 0; level < 3; level++) {
+      std::shared_ptr<const FlowFrame> frame = source.acquireLevel(level);
+      if (level >= frame->getLevelCount()) break;
+      check(frame, level, "float", report);
+    }
+    source.setEncoding(Half);
+    check(source.acquireFrame(), 0, "half", report);
+    source.setEncoding(Float32);
+    source.setLayout(BrickedLayout);
+    check(source.acquireFrame(), 0, "bricked", report);
+    source.setLayout(MortonLayout);
+    check(source.acquireFrame(), 0, "morton", report);
+  }
+
+  // NaN positions are rejected rather than read through.
+  FlowDataSource source(16);
+  GridEvaluator evaluator(source.acquireFrame(), 0);
+  if (evaluator.sample(QVector3D(NAN, 1, 1)).success) {
+    report.fail("a NaN position was sampled");
+  }
+  return report.finish();
+}
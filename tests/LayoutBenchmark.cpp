@@ -0,0 +1,85 @@
+//
+// Created by Joshua Lowe on 17.10.26.
+//
+
+// Trilinear samples per second of the frame layouts of FlowFrame.h, at
+// random positions and walking the volume row by row. Not a test: run it
+// by hand on the machine whose numbers matter.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "BrickedVolume.h"
+#include "MortonVolume.h"
+#include "TestSupport.h"
+
+namespace {
+
+constexpr int kSamples = 1 << 21;
+
+auto lerp(const QVector3D& a, const QVector3D& b, float f) -> QVector3D {
+  return a + f * (b - a);
+}
+
+template <typename Volume>
+auto trilinear(const Volume& volume, const QVector3D& p) -> QVector3D {
+  int ix = (int)p.x(), iy = (int)p.y(), iz = (int)p.z();
+  float fx = p.x() - ix, fy = p.y() - iy, fz = p.z() - iz;
+  QVector3D c[8];
+  volume.cell(ix, iy, iz, c);
+  QVector3D y0 = lerp(lerp(c[0], c[1], fx), lerp(c[2], c[3], fx), fy);
+  QVector3D y1 = lerp(lerp(c[4], c[5], fx), lerp(c[6], c[7], fx), fy);
+  return lerp(y0, y1, fz);
+}
+
+template <typename Volume>
+auto samplesPerSecond(const Volume& volume,
+                      const std::vector<QVector3D>& positions) -> double {
+  double seconds = bestSeconds(3, [&] {
+    QVector3D sum;
+    for (const QVector3D& p : positions) sum += trilinear(volume, p);
+    keep(sum.x());
+  });
+  return positions.size() / seconds;
+}
+
+}  // namespace
+
+auto main() -> int {
+  std::mt19937 random(17);
+  std::printf("%5s %8s %12s %12s\n", "dim", "layout", "random M/s",
+              "rows M/s");
+  for (int dim : {64, 128, 256}) {
+    std::uniform_real_distribution<float> coordinate(0, dim - 1.001f);
+    std::vector<QVector3D> scattered(kSamples), rows;
+    for (QVector3D& p : scattered) {
+      p = {coordinate(random), coordinate(random), coordinate(random)};
+    }
+    // Every step-th row in y and z, about kSamples positions in all.
+    double rowCount = (double)kSamples / dim;
+    int step = std::max(1, (int)(dim / std::sqrt(rowCount)));
+    for (int iz = 0; iz < dim - 1; iz += step) {
+      for (int iy = 0; iy < dim - 1; iy += step) {
+        for (int ix = 0; ix < dim - 1; ix++) {
+          rows.push_back({ix + 0.5f, iy + 0.5f, iz + 0.5f});
+        }
+      }
+    }
+
+    VolumeStorage linear = makeTornado(dim, 3);
+    BrickedVolume bricked(linear);
+    MortonVolume morton(linear);
+    auto report = [&](const char* name, const auto& volume) {
+      std::printf("%5d %8s %12.1f %12.1f\n", dim, name,
+                  samplesPerSecond(volume, scattered) / 1e6,
+                  samplesPerSecond(volume, rows) / 1e6);
+    };
+    report("linear", linear);
+    report("bricked", bricked);
+    report("morton", morton);
+  }
+  return 0;
+}
@@ -0,0 +1,101 @@
+//
+// Created by Joshua Lowe on 17.10.26.
+//
+
+// Checks that MinMaxIndex::mayCross() never rules out a cell the contour
+// mapper would trace, i.e. one with a corner above the isovalue and one at
+// or below it. The magnitude is the delicate component: the index ranges
+// it by its square, while the contours read the magnitude plane or derive
+// it in whatever storage the frame uses, each compiled with its own
+// contraction of the multiply-adds. Built twice, once with FMA contraction
+// forced on, which the inline value() functions then use.
+
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include "BrickedVolume.h"
+#include "MinMaxIndex.h"
+#include "MortonVolume.h"
+#include "TestSupport.h"
+
+namespace {
+
+// Exit code ctest counts as skipped.
+constexpr int kSkipped = 77;
+constexpr int kTile = MinMaxIndex::kTile;
+
+auto makeRandom(int dimension, unsigned seed) -> VolumeStorage {
+  VolumeStorage volume(dimension);
+  std::mt19937 random(seed);
+  std::uniform_real_distribution<float> component(-1, 1);
+  for (int c = 0; c < VolumeStorage::kComponents; c++) {
+    for (int iz = 0; iz < dimension; iz++) {
+      for (float& v : volume.mutableSlice(c, iz)) v = component(random);
+    }
+  }
+  return volume;
+}
+
+// Isovalues at, just below and just above every corner of the cell are the
+// ones a rounding difference between the index and the storage would trip.
+template <typename Volume>
+auto checkCells(const Volume& volume, const MinMaxIndex& index,
+                const char* field, const char* storage, TestReport& report)
+    -> void {
+  int dim = volume.dimension();
+  for (int c = 0; c < MinMaxIndex::kComponents; c++) {
+    for (int iz = 0; iz < dim; iz++) {
+      for (int i = 0; i + 1 < dim; i++) {
+        for (int j = 0; j + 1 < dim; j++) {
+          const float corner[4] = {
+              volume.value(j, i, iz, c), volume.value(j + 1, i, iz, c),
+              volume.value(j + 1, i + 1, iz, c), volume.value(j, i + 1, iz, c)};
+          for (float v : corner) {
+            for (float iso : {std::nextafter(v, -2.0f), v,
+                              std::nextafter(v, 2.0f)}) {
+              int above = 0;
+              for (float k : corner) above += k > iso;
+              if (above == 0 || above == 4) continue;
+              if (!index.mayCross(iz, c, j / kTile, i / kTile, iso)) {
+                report.fail(field, " ", storage, " dim ", dim,
+                            " component ", c, ": cell (", j, ", ", i, ", ",
+                            iz, ") skipped at isovalue ", iso);
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+auto checkVolume(VolumeStorage volume, const char* name, TestReport& report)
+    -> void {
+  int dim = volume.dimension();
+  MinMaxIndex index(dim);
+  for (int iz = 0; iz < dim; iz++) index.build(volume, iz);
+
+  // Derived on the fly by every storage, then read from the plane the
+  // contour mapper has FlowFrame::requireComponent() fill in.
+  checkCells(BrickedVolume(volume), index, name, "bricked", report);
+  checkCells(MortonVolume(volume), index, name, "morton", report);
+  checkCells(volume, index, name, "linear", report);
+  volume.computeMagnitude();
+  checkCells(volume, index, name, "magnitude plane", report);
+}
+
+}  // namespace
+
+auto main() -> int {
+#if defined(__FMA__) && (defined(__GNUC__) || defined(__clang__))
+  if (!__builtin_cpu_supports("fma")) return kSkipped;
+#endif
+  TestReport report;
+  // Partial tiles, whole tiles and a partial block of the row sweep.
+  for (int dim : {9, 17, 24, 33, 40}) {
+    checkVolume(makeRandom(dim, dim), "random", report);
+    checkVolume(makeTornado(dim, 3), "tornado", report);
+  }
+  return report.finish();
+}
@@ -0,0 +1,111 @@
+//
+// Created by Joshua Lowe on 17.10.26.
+//
+
+// Checks the Morton codes against a bit-by-bit reference and MortonVolume
+// against the VolumeStorage it was built from, cells straddling the tile
+// boundaries included. Built twice, once with BMI2 enabled, as
+// mortonEncode() and mortonDecode() pick pdep/pext or the tables at
+// compile time.
+
+#include <cstdint>
+
+#include "MortonVolume.h"
+#include "TestSupport.h"
+
+namespace {
+
+// Exit code ctest counts as skipped.
+constexpr int kSkipped = 77;
+
+auto referenceEncode(int x, int y, int z) -> std::uint32_t {
+  std::uint32_t code = 0;
+  for (int bit = 0; bit < MortonVolume::kMaxTileShift; bit++) {
+    code |= (std::uint32_t)((x >> bit) & 1) << (3 * bit);
+    code |= (std::uint32_t)((y >> bit) & 1) << (3 * bit + 1);
+    code |= (std::uint32_t)((z >> bit) & 1) << (3 * bit + 2);
+  }
+  return code;
+}
+
+auto checkCodes(TestReport& report) -> void {
+  constexpr int kEdge = 1 << MortonVolume::kMaxTileShift;
+  for (int z = 0; z < kEdge; z++) {
+    for (int y = 0; y < kEdge; y++) {
+      for (int x = 0; x < kEdge; x++) {
+        std::uint32_t code = mortonEncode(x, y, z);
+        if (code != referenceEncode(x, y, z)) {
+          report.fail("mortonEncode(", x, ", ", y, ", ", z, ") = ", code,
+                      ", expected ", referenceEncode(x, y, z));
+        }
+        int dx, dy, dz;
+        mortonDecode(code, dx, dy, dz);
+        if (dx != x || dy != y || dz != z) {
+          report.fail("mortonDecode(", code, ") = (", dx, ", ", dy, ", ", dz,
+                      "), expected (", x, ", ", y, ", ", z, ")");
+        }
+        // Increments that stay inside the largest tile.
+        const std::uint32_t masks[3] = {kMortonX, kMortonY, kMortonZ};
+        const int coordinates[3] = {x, y, z};
+        for (int axis = 0; axis < 3; axis++) {
+          if (coordinates[axis] == kEdge - 1) continue;
+          std::uint32_t expected = referenceEncode(
+              x + (axis == 0), y + (axis == 1), z + (axis == 2));
+          if (mortonIncrement(code, masks[axis]) != expected) {
+            report.fail("mortonIncrement of (", x, ", ", y, ", ", z,
+                        ") along axis ", axis, " is wrong");
+          }
+        }
+      }
+    }
+  }
+}
+
+// Dimension 24 gets 8^3 tiles, 32 a single 32^3 tile and 40 again 8^3
+// tiles, so every cell in the last row of a tile straddles a boundary.
+auto checkVolume(int dim, TestReport& report) -> void {
+  VolumeStorage linear = makeTornado(dim, 9);
+  MortonVolume morton(linear);
+  for (int iz = 0; iz < dim; iz++) {
+    for (int iy = 0; iy < dim; iy++) {
+      for (int ix = 0; ix < dim; ix++) {
+        for (int c = 0; c <= VolumeStorage::kComponents; c++) {
+          if (morton.value(ix, iy, iz, c) != linear.value(ix, iy, iz, c)) {
+            report.fail("dim ", dim, " value (", ix, ", ", iy, ", ", iz,
+                        ") component ", c, " differs");
+          }
+        }
+        if (ix == dim - 1 || iy == dim - 1 || iz == dim - 1) continue;
+        QVector3D expected[8], corners[8];
+        linear.cell(ix, iy, iz, expected);
+        morton.cell(ix, iy, iz, corners);
+        for (int k = 0; k < 8; k++) {
+          if (corners[k] != expected[k]) {
+            report.fail("dim ", dim, " cell (", ix, ", ", iy, ", ", iz,
+                        ") corner ", k, " differs");
+          }
+        }
+      }
+    }
+  }
+}
+
+}  // namespace
+
+auto main() -> int {
+#if defined(__BMI2__)
+#if defined(__GNUC__) || defined(__clang__)
+  if (!__builtin_cpu_supports("bmi2")) {
+    std::cout << "the CPU has no BMI2, skipping" << std::endl;
+    return kSkipped;
+  }
+#endif
+  std::cout << "Morton codes via pdep/pext" << std::endl;
+#else
+  std::cout << "Morton codes via tables" << std::endl;
+#endif
+  TestReport report;
+  checkCodes(report);
+  for (int dim : {24, 32, 40}) checkVolume(dim, report);
+  return report.finish();
+}
@@ -0,0 +1,162 @@
+//
+// Created by Joshua Lowe on 17.10.26.
+//
+
+// Checks that streamlines traced in packets match the scalar tracer, and
+// that samplePacket() matches sample() lane by lane. Both paths round
+// alike unless the compiler contracts their multiply-adds into FMAs, so
+// the results have to be bit-identical in a build without FMA and close
+// otherwise.
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "FieldEvaluator.h"
+#include "FlowDataSource.h"
+#include "StreamLinesMapper.h"
+#include "TestSupport.h"
+
+namespace {
+
+#ifdef __FMA__
+// Vertices in voxels; contracted steps drift apart slowly along a line.
+constexpr float kLineTolerance = 1e-3f;
+// Velocities relative to the peak of about 0.3.
+constexpr float kSampleTolerance = 8 * std::numeric_limits<float>::epsilon();
+#else
+constexpr float kLineTolerance = 0;
+constexpr float kSampleTolerance = 0;
+#endif
+
+constexpr int kDimension = 32;
+constexpr const char* kIntegrations[] = {"Euler", "RK2", "RK4",
+                                         "Dormand-Prince"};
+
+// Seeds inside and on the faces, not a multiple of the packet width. The
+// mapper takes seeds inside the volume only.
+auto makeSeeds() -> std::vector<QVector3D> {
+  float far = kDimension - 1;
+  std::mt19937 random(kDimension);
+  std::uniform_real_distribution<float> inside(0, far);
+  std::vector<QVector3D> seeds;
+  for (int i = 0; i < 200; i++) {
+    seeds.emplace_back(inside(random), inside(random), inside(random));
+  }
+  seeds.emplace_back(0, far / 2, far / 2);
+  seeds.emplace_back(far / 2, far, far / 2);
+  seeds.emplace_back(far / 2, far / 2, far);
+  return seeds;
+}
+
+auto close(const QVector3D& a, const QVector3D& b, float tolerance)
+    -> bool {
+  for (int axis = 0; axis < 3; axis++) {
+    if (!(std::abs(a[axis] - b[axis]) <= tolerance)) return false;
+  }
+  return true;
+}
+
+auto checkLines(FlowDataSource& source, const char* storage, int level,
+                TestReport& report) -> void {
+  std::vector<QVector3D> seeds = makeSeeds();
+  for (int integration = Euler; integration <= DormandPrince; integration++) {
+    for (bool analytic : {false, true}) {
+      std::vector<QVector3D> lines[2];
+      for (bool packets : {false, true}) {
+        StreamLinesMapper mapper(&source);
+        for (int i = 0; i < integration; i++) {
+          mapper.setCurrentIntegration(1);
+        }
+        mapper.setAnalytic(analytic);
+        mapper.setLevel(level);
+        mapper.setPacketTracing(packets);
+        lines[packets] = mapper.computeStreamLines(seeds);
+      }
+      const std::vector<QVector3D>& scalar = lines[0];
+      const std::vector<QVector3D>& packet = lines[1];
+      bool same = !scalar.empty() && packet.size() == scalar.size();
+      if (same && kLineTolerance == 0) {
+        same = std::memcmp(packet.data(), scalar.data(),
+                           scalar.size() * sizeof(QVector3D)) == 0;
+      } else {
+        for (std::size_t i = 0; same && i < scalar.size(); i++) {
+          same = close(packet[i], scalar[i], kLineTolerance);
+        }
+      }
+      if (!same) {
+        report.fail(storage, " level ", level, " ",
+                    kIntegrations[integration], analytic ? " analytic" : "",
+                    ": ", packet.size(), " vertices in packets, ",
+                    scalar.size(), " scalar");
+      }
+    }
+  }
+}
+
+// A count past a whole block of lanes, with lanes outside the volume.
+auto checkSamples(const FieldEvaluator& field, const char* name,
+                  TestReport& report) -> void {
+  constexpr int kCount = 37;
+  float far = kDimension - 1;
+  std::mt19937 random(kCount);
+  std::uniform_real_distribution<float> around(-2, far + 2);
+  float x[kCount], y[kCount], z[kCount];
+  float vx[kCount], vy[kCount], vz[kCount];
+  bool valid[kCount];
+  for (int round = 0; round < 200; round++) {
+    for (int i = 0; i < kCount; i++) {
+      x[i] = around(random);
+      y[i] = around(random);
+      z[i] = around(random);
+    }
+    x[0] = far;
+    y[1] = NAN;
+    field.samplePacket(kCount, x, y, z, vx, vy, vz, valid);
+    for (int i = 0; i < kCount; i++) {
+      QVector3D p(x[i], y[i], z[i]);
+      InterpolationResult expected = field.sample(p);
+      bool same = valid[i] == expected.success;
+      if (same && valid[i]) {
+        same = close(QVector3D(vx[i], vy[i], vz[i]), expected.value,
+                     kSampleTolerance);
+      }
+      if (!same) {
+        report.fail(name, " lane ", i, " at (", p.x(), ", ", p.y(), ", ",
+                    p.z(), "): ", valid[i], " (", vx[i], ", ", vy[i], ", ",
+                    vz[i], "), expected ", expected.success, " (",
+                    expected.value.x(), ", ", expected.value.y(), ", ",
+                    expected.value.z(), ")");
+      }
+    }
+  }
+}
+
+}  // namespace
+
+auto main() -> int {
+  TestReport report;
+  FlowDataSource source(kDimension);
+  source.setFrame(6);
+
+  checkSamples(GridEvaluator(source.acquireLevel(1), 0), "grid", report);
+  checkSamples(GridEvaluator(source.acquireLevel(1), 1), "grid level 1",
+               report);
+  checkSamples(AnalyticEvaluator(0, kDimension, 6, false), "analytic",
+               report);
+  checkSamples(AnalyticEvaluator(0, kDimension, 6, true), "analytic reversed",
+               report);
+
+  checkLines(source, "float", 0, report);
+  checkLines(source, "float", 1, report);
+  source.setEncoding(Half);
+  checkLines(source, "half", 0, report);
+  source.setEncoding(Float32);
+  source.setLayout(BrickedLayout);
+  checkLines(source, "bricked", 0, report);
+  return report.finish();
+}
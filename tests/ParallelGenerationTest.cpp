@@ -0,0 +1,136 @@
+//
+// Created by Joshua Lowe on 17.10.26.
+//
+
+// Checks that frames generated on the task scheduler are bit-identical to
+// a serial loop over the slices, whatever the slab count and in whatever
+// order the slices are asked for, and that their tile ranges and
+// statistics do not depend on the slab count either.
+
+#include <cstring>
+#include <vector>
+
+#include "FieldGenerators.h"
+#include "FlowDataSource.h"
+#include "TestSupport.h"
+
+namespace {
+
+auto generateSerially(int generator, int dim, int frame, bool reversed)
+    -> VolumeStorage {
+  const FieldGenerator& field = getFieldGenerators()[generator];
+  VolumeStorage volume(dim);
+  for (int iz = 0; iz < dim; iz++) {
+    field.slice(dim, iz, frame, volume.mutableSlice(0, iz).data(),
+                volume.mutableSlice(1, iz).data(),
+                volume.mutableSlice(2, iz).data());
+  }
+  if (reversed) volume.reverse();
+  return volume;
+}
+
+auto sameBits(float a, float b) -> bool {
+  return std::memcmp(&a, &b, sizeof(float)) == 0;
+}
+
+auto sameBits(double a, double b) -> bool {
+  return std::memcmp(&a, &b, sizeof(double)) == 0;
+}
+
+struct Case {
+  int generator;
+  int dim;
+  int frame;
+  bool reversed;
+};
+
+auto generate(const Case& test, int threads, bool scattered)
+    -> std::shared_ptr<const FlowFrame> {
+  FlowDataSource source(test.dim);
+  source.setGenerator(test.generator);
+  source.setFrame(test.frame);
+  if (test.reversed) source.reverseArray();
+  source.setThreadCount(threads);
+  if (scattered) {
+    // Slices become resident in pieces, as the mappers ask for them.
+    int dim = test.dim;
+    source.acquireSlices(dim / 2, dim / 2 + 3);
+    source.acquireSlices(dim - 2, dim);
+    source.acquireSlices(0, dim / 3);
+  }
+  return source.acquireFrame();
+}
+
+auto check(const Case& test, TestReport& report) -> void {
+  const char* name = getFieldGenerators()[test.generator].name;
+  VolumeStorage expected =
+      generateSerially(test.generator, test.dim, test.frame, test.reversed);
+  MinMaxIndex ranges(test.dim);
+  for (int iz = 0; iz < test.dim; iz++) ranges.build(expected, iz);
+
+  std::shared_ptr<const FlowFrame> first;
+  for (int threads : {1, 2, 3, 5, 16}) {
+    for (bool scattered : {false, true}) {
+      std::shared_ptr<const FlowFrame> frame =
+          generate(test, threads, scattered);
+      const VolumeStorage& volume = frame->getVolume();
+      for (int c = 0; c < VolumeStorage::kComponents; c++) {
+        for (std::size_t i = 0; i < expected.component(c).size(); i++) {
+          if (!sameBits(volume.component(c)[i], expected.component(c)[i])) {
+            report.fail(name, " dim ", test.dim, " frame ", test.frame,
+                        test.reversed ? " reversed" : "", " with ", threads,
+                        " slabs: component ", c, " differs at voxel ", i);
+            break;
+          }
+        }
+      }
+
+      const MinMaxIndex& tiles = frame->getTileRanges();
+      for (int iz = 0; iz < test.dim; iz++) {
+        for (int c = 0; c < MinMaxIndex::kComponents; c++) {
+          for (int ty = 0; ty < tiles.getTileCount(); ty++) {
+            for (int tx = 0; tx < tiles.getTileCount(); tx++) {
+              auto [lo, hi] = tiles.getTileRange(iz, c, tx, ty);
+              auto [expectedLo, expectedHi] =
+                  ranges.getTileRange(iz, c, tx, ty);
+              if (!sameBits(lo, expectedLo) || !sameBits(hi, expectedHi)) {
+                report.fail(name, " dim ", test.dim, " with ", threads,
+                            " slabs: tile range ", tx, ", ", ty, " of slice ",
+                            iz, " component ", c, " differs");
+              }
+            }
+          }
+        }
+      }
+
+      if (!first) {
+        first = frame;
+        continue;
+      }
+      for (int c = 0; c <= VolumeStorage::kComponents; c++) {
+        const ComponentStatistics& a = frame->getStatistics().components[c];
+        const ComponentStatistics& b = first->getStatistics().components[c];
+        if (!sameBits(a.min, b.min) || !sameBits(a.max, b.max) ||
+            !sameBits(a.mean, b.mean) || !sameBits(a.variance, b.variance) ||
+            a.histogram != b.histogram) {
+          report.fail(name, " dim ", test.dim, " with ", threads,
+                      " slabs: statistics of component ", c, " differ");
+        }
+      }
+    }
+  }
+}
+
+}  // namespace
+
+auto main() -> int {
+  TestReport report;
+  int generators = (int)getFieldGenerators().size();
+  for (int generator = 0; generator < generators; generator++) {
+    for (int dim : {16, 33}) {
+      check({generator, dim, 0, false}, report);
+      check({generator, dim, 11, true}, report);
+    }
+  }
+  return report.finish();
+}
@@ -0,0 +1,127 @@
+//
+// Created by Joshua Lowe on 17.10.26.
+//
+
+// Checks that the pyramid levels line up with level 0: the same position
+// sampled at any level has to give the same value. The frame replayed
+// holds its own voxel position as the velocity, a linear field the levels
+// reproduce exactly away from the border, so every level sampled at a
+// position has to return that position.
+
+#include <cmath>
+#include <memory>
+#include <random>
+
+#include "FieldEvaluator.h"
+#include "FlowDataSource.h"
+#include "TestSupport.h"
+
+namespace {
+
+// Sampling error allowed, in level 0 voxels. Misaligned levels are off by
+// a quarter voxel or more.
+constexpr float kTolerance = 1e-3f;
+
+class PositionField : public FrameProvider {
+ public:
+  explicit PositionField(int dimension) : dim(dimension) {}
+
+  auto getDimension() const -> int override { return dim; }
+  auto getFrameCount() const -> int override { return 1; }
+  auto loadFrame(int) -> VolumeStorage override {
+    VolumeStorage volume(dim);
+    for (int iz = 0; iz < dim; iz++) {
+      for (int iy = 0; iy < dim; iy++) {
+        for (int ix = 0; ix < dim; ix++) {
+          std::size_t i = volume.index(ix, iy, iz);
+          volume.mutableComponent(0)[i] = ix;
+          volume.mutableComponent(1)[i] = iy;
+          volume.mutableComponent(2)[i] = iz;
+        }
+      }
+    }
+    return volume;
+  }
+
+ private:
+  int dim;
+};
+
+auto check(int dim, TestReport& report) -> void {
+  FlowDataSource source;
+  source.setFrameProvider(std::make_shared<PositionField>(dim));
+  std::mt19937 random(dim);
+  for (int level = 1;; level++) {
+    std::shared_ptr<const FlowFrame> frame = source.acquireLevel(level);
+    if (frame->getLevelCount() <= level) break;
+    int steps = frame->getLevelDimension(level) - 1;
+    float spacing = (float)(dim - 1) / steps;
+    // The border voxels repeat themselves in the filter, so positions
+    // within its footprint of a face are biased towards the inside. The
+    // footprint of a level stays below twice its spacing, and sampling
+    // reaches one more cell.
+    float margin = 3 * spacing;
+    if (2 * margin >= dim - 1) break;
+
+    // Positions sampled through the evaluator the streamlines use.
+    GridEvaluator coarse(frame, level);
+    std::uniform_real_distribution<float> inside(margin, dim - 1 - margin);
+    for (int i = 0; i < 2000; i++) {
+      QVector3D p(inside(random), inside(random), inside(random));
+      InterpolationResult result = coarse.sample(p);
+      if (!result.success || (result.value - p).length() > kTolerance) {
+        report.fail("dim ", dim, " level ", level, " at (", p.x(), ", ",
+                    p.y(), ", ", p.z(), ") sampled (", result.value.x(), ", ",
+                    result.value.y(), ", ", result.value.z(), ")");
+      }
+    }
+
+    // Voxels of the slice getLevelIndex() picks, which the slice and
+    // contour mappers read directly and place at the same box.
+    const VolumeStorage& volume = frame->getLevel(level);
+    for (int z = 0; z < dim; z++) {
+      int iz = frame->getLevelIndex(z, level);
+      if (std::abs(iz * spacing - z) > spacing / 2 + kTolerance) {
+        report.fail("dim ", dim, " level ", level, ": slice ", z,
+                    " maps to level slice ", iz);
+      }
+    }
+    for (int iz = 0; iz <= steps; iz++) {
+      VolumeStatistics statistics = frame->getLevelSliceStatistics(level, iz);
+      for (int iy = 0; iy <= steps; iy++) {
+        for (int ix = 0; ix <= steps; ix++) {
+          QVector3D expected(ix * spacing, iy * spacing, iz * spacing);
+          bool interior = true;
+          for (int axis = 0; axis < 3; axis++) {
+            interior = interior && expected[axis] >= margin &&
+                       expected[axis] <= dim - 1 - margin;
+          }
+          QVector3D value = volume.vector(ix, iy, iz);
+          if (interior && (value - expected).length() > kTolerance) {
+            report.fail("dim ", dim, " level ", level, " voxel (", ix, ", ",
+                        iy, ", ", iz, ") holds (", value.x(), ", ", value.y(),
+                        ", ", value.z(), ")");
+          }
+          // The slice statistics have to cover the slice wherever it is.
+          for (int c = 0; c < VolumeStorage::kComponents; c++) {
+            const ComponentStatistics& range = statistics.components[c];
+            if (value[c] < range.min || value[c] > range.max) {
+              report.fail("dim ", dim, " level ", level, " slice ", iz,
+                          " component ", c, ": ", value[c], " outside [",
+                          range.min, ", ", range.max, "]");
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+}  // namespace
+
+auto main() -> int {
+  TestReport report;
+  // The application steps the dimension by 8; odd ones take the tent only.
+  for (int dim : {32, 40, 63, 64, 72}) check(dim, report);
+  return report.finish();
+}
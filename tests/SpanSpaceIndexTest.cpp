@@ -0,0 +1,116 @@
+//
+// Created by Joshua Lowe on 17.10.26.
+//
+
+// Checks SpanSpaceIndex::query() against a scan of all spans: it has to
+// report exactly the cells with min <= c < max, each once. The isovalues
+// include the bounds and midpoints of the spans, so every split value and
+// its neighbours are queried, and the spans include few distinct values,
+// which makes splits coincide, and fewer spans than fit into one leaf.
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include "SpanSpaceIndex.h"
+#include "TestSupport.h"
+
+namespace {
+
+// Isovalues queried per set of spans at most.
+constexpr int kMaxQueries = 1000;
+
+auto scan(const std::vector<float>& lo, const std::vector<float>& hi,
+          float value) -> std::vector<int> {
+  std::vector<int> cells;
+  for (int i = 0; i < (int)lo.size(); i++) {
+    if (lo[i] <= value && value < hi[i]) cells.push_back(i);
+  }
+  return cells;
+}
+
+auto checkSpans(const std::vector<float>& lo, const std::vector<float>& hi,
+                const char* name, TestReport& report) -> void {
+  int count = (int)lo.size();
+  SpanSpaceIndex index(lo.data(), hi.data(), count);
+
+  // The splits are midpoints of spans, so querying the midpoints of all
+  // spans hits each of them.
+  std::vector<float> values = {-2, 2};
+  for (int i = 0; i < count; i++) {
+    float middle = lo[i] / 2 + hi[i] / 2;
+    for (float v : {lo[i], hi[i], middle}) {
+      values.push_back(v);
+      values.push_back(std::nextafter(v, -3.0f));
+      values.push_back(std::nextafter(v, 3.0f));
+    }
+  }
+  std::sort(values.begin(), values.end());
+  values.erase(std::unique(values.begin(), values.end()), values.end());
+  std::shuffle(values.begin(), values.end(), std::mt19937(count));
+  if ((int)values.size() > kMaxQueries) values.resize(kMaxQueries);
+
+  std::vector<int> cells;
+  for (float value : values) {
+    cells.clear();
+    index.query(value, cells);
+    std::sort(cells.begin(), cells.end());
+    std::vector<int> expected = scan(lo, hi, value);
+    if (cells != expected) {
+      report.fail(name, " with ", count, " spans: query(", value, ") found ",
+                  cells.size(), " cells, expected ", expected.size());
+    }
+  }
+}
+
+// Spans between values drawn from levels evenly spaced values in [-1, 1],
+// or from the whole range for levels 0. Some spans are empty.
+auto checkRandom(int count, int levels, TestReport& report) -> void {
+  std::mt19937 random(count * 31 + levels);
+  std::uniform_real_distribution<float> uniform(-1, 1);
+  std::uniform_int_distribution<int> level(0, std::max(levels - 1, 0));
+  auto draw = [&]() {
+    if (levels == 0) return uniform(random);
+    return -1 + 2.0f * level(random) / std::max(levels - 1, 1);
+  };
+  std::vector<float> lo(count), hi(count);
+  for (int i = 0; i < count; i++) {
+    float a = draw(), b = draw();
+    lo[i] = std::min(a, b);
+    hi[i] = std::max(a, b);
+  }
+  checkSpans(lo, hi, levels == 0 ? "uniform" : "quantised", report);
+}
+
+}  // namespace
+
+auto main() -> int {
+  TestReport report;
+  for (int count : {0, 1, 2, SpanSpaceIndex::kLeafSize - 1,
+                    SpanSpaceIndex::kLeafSize, 2 * SpanSpaceIndex::kLeafSize,
+                    1000, 10000}) {
+    for (int levels : {0, 2, 3, 17}) checkRandom(count, levels, report);
+  }
+
+  // The cell spans of tornado slices, as the contour mapper indexes them.
+  int dim = 64;
+  VolumeStorage volume = makeTornado(dim, 5);
+  for (int c = 0; c < VolumeStorage::kComponents; c++) {
+    for (int iz : {0, dim / 2, dim - 1}) {
+      std::vector<float> lo, hi;
+      for (int i = 0; i + 1 < dim; i++) {
+        for (int j = 0; j + 1 < dim; j++) {
+          auto [min, max] = std::minmax(
+              {volume.value(j, i, iz, c), volume.value(j + 1, i, iz, c),
+               volume.value(j, i + 1, iz, c),
+               volume.value(j + 1, i + 1, iz, c)});
+          lo.push_back(min);
+          hi.push_back(max);
+        }
+      }
+      checkSpans(lo, hi, "tornado", report);
+    }
+  }
+  return report.finish();
+}
@@ -0,0 +1,81 @@
+//
+// Created by Joshua Lowe on 17.10.26.
+//
+
+// Checks that tracing the seeds longest first gives exactly the lines of
+// tracing them in seed order, for every integrator, on the grid and the
+// analytic field, with and without packets, over several frames so the
+// cost model has the lines of the last call to go by.
+
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "FlowDataSource.h"
+#include "StreamLinesMapper.h"
+#include "TestSupport.h"
+
+namespace {
+
+constexpr int kDimension = 32;
+constexpr int kFrames = 3;
+constexpr const char* kIntegrations[] = {"Euler", "RK2", "RK4",
+                                         "Dormand-Prince"};
+
+auto sameBits(const std::vector<QVector3D>& a,
+              const std::vector<QVector3D>& b) -> bool {
+  return a.size() == b.size() &&
+         std::memcmp(a.data(), b.data(), a.size() * sizeof(QVector3D)) == 0;
+}
+
+auto makeSeeds(int count, unsigned seed) -> std::vector<QVector3D> {
+  std::mt19937 random(seed);
+  std::uniform_real_distribution<float> inside(0, kDimension - 1);
+  std::vector<QVector3D> seeds;
+  for (int i = 0; i < count; i++) {
+    seeds.emplace_back(inside(random), inside(random), inside(random));
+  }
+  return seeds;
+}
+
+auto check(int integration, bool analytic, bool packets, TestReport& report)
+    -> void {
+  FlowDataSource source(kDimension);
+  StreamLinesMapper ordered(&source), plain(&source);
+  for (StreamLinesMapper* mapper : {&ordered, &plain}) {
+    for (int i = 0; i < integration; i++) mapper->setCurrentIntegration(1);
+    mapper->setAnalytic(analytic);
+    mapper->setPacketTracing(packets);
+  }
+  ordered.setCostOrdered(true);
+  plain.setCostOrdered(false);
+
+  // The same seeds twice, then a different count, which drops the costs.
+  std::vector<QVector3D> seeds = makeSeeds(200, integration);
+  for (int frame = 0; frame < kFrames; frame++) {
+    source.setFrame(frame);
+    if (frame == kFrames - 1) seeds = makeSeeds(129, frame);
+    std::vector<QVector3D> expected = plain.computeStreamLines(seeds);
+    std::vector<QVector3D> lines = ordered.computeStreamLines(seeds);
+    if (expected.empty() || !sameBits(lines, expected)) {
+      report.fail(kIntegrations[integration], analytic ? " analytic" : "",
+                  packets ? " packets" : "", " frame ", frame, ": ",
+                  lines.size(), " vertices cost ordered, ", expected.size(),
+                  " in seed order");
+    }
+  }
+}
+
+}  // namespace
+
+auto main() -> int {
+  TestReport report;
+  for (int integration = Euler; integration <= DormandPrince; integration++) {
+    for (bool analytic : {false, true}) {
+      for (bool packets : {false, true}) {
+        check(integration, analytic, packets, report);
+      }
+    }
+  }
+  return report.finish();
+}
@@ -0,0 +1,67 @@
+//
+// Created by Joshua Lowe on 17.10.26.
+//
+
+#ifndef CODE_TESTSUPPORT_H
+#define CODE_TESTSUPPORT_H
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+#include "TornadoKernel.h"
+#include "VolumeStorage.h"
+
+// The tornado frame FlowDataSource generates for the given dimension and
+// frame number.
+inline auto makeTornado(int dimension, int frame) -> VolumeStorage {
+  VolumeStorage volume(dimension);
+  for (int iz = 0; iz < dimension; iz++) {
+    genTornadoSlice(prepareTornadoSlice(dimension, iz, frame),
+                    volume.mutableSlice(0, iz).data(),
+                    volume.mutableSlice(1, iz).data(),
+                    volume.mutableSlice(2, iz).data());
+  }
+  return volume;
+}
+
+// Counts the failed checks of a test and prints the first few of them.
+class TestReport {
+ public:
+  template <typename... Args>
+  auto fail(const Args&... what) -> void {
+    if (failures++ < kPrinted) (std::cerr << ... << what) << std::endl;
+  }
+  // The exit code of the test.
+  auto finish() const -> int {
+    if (failures > 0) std::cerr << failures << " checks failed" << std::endl;
+    return failures > 0 ? 1 : 0;
+  }
+
+ private:
+  static constexpr int kPrinted = 10;
+  int failures = 0;
+};
+
+// Keeps the compiler from dropping a benchmark loop whose result is unused.
+inline auto keep(float value) -> void {
+  static volatile float sink;
+  sink = value;
+}
+
+// Wall time of the best of a few runs of work, so a benchmark is not
+// thrown off by a single preemption.
+template <typename Work>
+auto bestSeconds(int runs, Work&& work) -> double {
+  double best = 1e30;
+  for (int i = 0; i < runs; i++) {
+    auto start = std::chrono::steady_clock::now();
+    work();
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    best = std::min(best, elapsed.count());
+  }
+  return best;
+}
+
+#endif  // CODE_TESTSUPPORT_H
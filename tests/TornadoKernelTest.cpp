@@ -0,0 +1,83 @@
+//
+// Created by Joshua Lowe on 17.10.26.
+//
+
+// Compares every vectorised tornado kernel the CPU supports against the
+// scalar reference, with the tolerance documented in TornadoKernel.h.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <limits>
+#include <vector>
+
+#include "CpuFeatures.h"
+#include "TornadoKernel.h"
+
+namespace {
+
+constexpr float kMaxUlps = 8;
+constexpr float kUlpFloor = 1.0f / 16;
+// Voxels closer than this to the |r - temp| == r2 branch of the tornado
+// may legitimately take the other branch.
+constexpr double kDiscontinuity = 1e-6;
+
+auto ulp(float value) -> float {
+  return std::nextafter(value, std::numeric_limits<float>::infinity()) -
+         value;
+}
+
+auto onDiscontinuity(const TornadoSlice& s, int ix, int iy) -> bool {
+  double x = ix * s.xdelta, y = iy * s.ydelta;
+  double temp = std::sqrt((y - s.yc) * (y - s.yc) + (x - s.xc) * (x - s.xc));
+  return std::abs(std::abs(s.r - temp) - s.r2) < kDiscontinuity;
+}
+
+}  // namespace
+
+auto main() -> int {
+  int failures = 0;
+  SimdLevel supported = detectSimdLevel();
+  std::cout << "widest kernel: " << simdLevelName(supported) << std::endl;
+  for (int level = SSE; level <= supported; level++) {
+    setTornadoSimdLevel(static_cast<SimdLevel>(level));
+    float worst = 0;
+    for (int dim = 16; dim <= 128; dim += 8) {
+      std::size_t voxels = (std::size_t)dim * dim;
+      std::vector<float> ref(3 * voxels), out(3 * voxels);
+      for (int time : {0, 1, 7, 50, 1000}) {
+        for (int iz = 0; iz < dim; iz++) {
+          TornadoSlice s = prepareTornadoSlice(dim, iz, time);
+          genTornadoSliceScalar(s, ref.data(), ref.data() + voxels,
+                                ref.data() + 2 * voxels);
+          genTornadoSlice(s, out.data(), out.data() + voxels,
+                          out.data() + 2 * voxels);
+          for (std::size_t i = 0; i < 3 * voxels; i++) {
+            int ix = (i % voxels) % dim, iy = (i % voxels) / dim;
+            if (onDiscontinuity(s, ix, iy)) continue;
+            float ulps = std::abs(out[i] - ref[i]) /
+                         ulp(std::max(std::abs(ref[i]), kUlpFloor));
+            worst = std::max(worst, ulps);
+            if (ulps <= kMaxUlps) continue;
+            if (failures++ < 10) {
+              std::cerr << simdLevelName(static_cast<SimdLevel>(level))
+                        << " dim " << dim << " frame " << time << " voxel ("
+                        << ix << ", " << iy << ", " << iz << ") component "
+                        << i / voxels << ": " << out[i] << " vs " << ref[i]
+                        << " (" << ulps << " ULP)" << std::endl;
+            }
+          }
+        }
+      }
+    }
+    std::cout << simdLevelName(static_cast<SimdLevel>(level))
+              << ": worst " << worst << " ULP" << std::endl;
+  }
+  if (failures > 0) {
+    std::cerr << failures << " values outside " << kMaxUlps << " ULP"
+              << std::endl;
+    return 1;
+  }
+  return 0;
+}